@@ -1,11 +1,27 @@
 #include <iostream>
 #include <chrono>
 #include <functional>
+#include <atomic>
+#include <thread>
 
 #include "RingBufLock.hpp"
 #include "TAS.hpp"
 #include "TTAS.hpp"
 #include "TicketLock.hpp"
+#include "../bench/bench.hpp"
+
+// Thread i runs on core i, so the lock line moves between the same caches every run
+inline void PinToCore(std::thread& thread, std::size_t i_thread)
+{
+    bench::PinThread(thread, i_thread % std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+// Workers wait for the start flag, so none of them takes the lock before all are pinned
+inline void WaitStart(const std::atomic<bool>& is_started)
+{
+    while (!is_started.load(std::memory_order_acquire))
+        std::this_thread::yield();
+}
 
 template <std::size_t num_threads>
 void TrueOrderLockPerfTest(std::size_t num_repeats)
@@ -15,10 +31,12 @@ void TrueOrderLockPerfTest(std::size_t num_repeats)
     std::size_t ctr = 0;
     RingBufLock<num_threads> tol;
 
+    std::atomic<bool> is_started{ false };
     std::array <std::thread, num_threads> threads;
-    for (auto& th : threads)
+    for (std::size_t i_thread = 0; i_thread < num_threads; ++i_thread)
     {
-        th = std::thread([&tol, &ctr, num_repeats](){
+        threads[i_thread] = std::thread([&tol, &ctr, &is_started, num_repeats](){
+            WaitStart(is_started);
             for (std::size_t i_repeat = 0; i_repeat < num_repeats; ++i_repeat)
             {
                 const auto index = tol.lock();
@@ -26,7 +44,9 @@ void TrueOrderLockPerfTest(std::size_t num_repeats)
                 tol.unlock(index);
             }
         });
+        PinToCore(threads[i_thread], i_thread);
     }
+    is_started.store(true, std::memory_order_release);
 
     for (auto& thread : threads)
         thread.join();
@@ -43,10 +63,12 @@ void StdPerfTest(std::size_t num_repeats)
     std::size_t ctr = 0;
     SpinLock sl;
 
+    std::atomic<bool> is_started{ false };
     std::array <std::thread, num_threads> threads;
-    for (auto& th : threads)
+    for (std::size_t i_thread = 0; i_thread < num_threads; ++i_thread)
     {
-        th = std::thread([&sl, &ctr, num_repeats](){
+        threads[i_thread] = std::thread([&sl, &ctr, &is_started, num_repeats](){
+            WaitStart(is_started);
             for (std::size_t i_repeat = 0; i_repeat < num_repeats; ++i_repeat)
             {
                 sl.lock();
@@ -54,7 +76,9 @@ void StdPerfTest(std::size_t num_repeats)
                 sl.unlock();
             }
         });
+        PinToCore(threads[i_thread], i_thread);
     }
+    is_started.store(true, std::memory_order_release);
 
     for (auto& thread : threads)
         thread.join();
@@ -93,36 +117,47 @@ void RunPerfTest(std::size_t num_repeats)
     }
 }
 
-template <typename Func, typename... Args>
-auto CalcTimeExecution(Func&& func, Args&&... args)
+// Names of the baseline entries, the same as the suffixes of the res_ files
+inline std::string GetSpinLockName(SPIN_LOCK spin_lock)
 {
-    const auto time_begin = std::chrono::high_resolution_clock::now();
-    std::invoke(std::forward<Func>(func), std::forward<Args>(args)...);
-    const auto time_end = std::chrono::high_resolution_clock::now();
-    
-    const auto dtime = time_end - time_begin;
-    const auto dtime_ms = std::chrono::duration_cast<std::chrono::microseconds>(dtime).count();
-    return dtime_ms;
+    switch(spin_lock)
+    {
+        case SPIN_LOCK::RB_LOCK:
+            return "RB_LOCK";
+        case SPIN_LOCK::TAS:
+            return "TAS";
+        case SPIN_LOCK::TTAS:
+            return "TTAS";
+        case SPIN_LOCK::TICKET_LOCK:
+            return "TICKET_LOCK";
+        default:
+            throw std::runtime_error("Unknown spin lock type");
+    }
 }
 
+// Prints: num_threads and the time of every sample in microseconds.
+// The samples go to runner as <spin lock>_<num_threads>
 template<SPIN_LOCK spin_lock, std::size_t num_threads>
-void PrintTimePerfTest(std::size_t counter_end, std::size_t num_repeats, std::size_t num_skip)
+void PrintTimePerfTest(bench::BenchRunner& runner, std::size_t counter_end)
 {
+    const auto& stats = runner.Run(GetSpinLockName(spin_lock) + '_' + std::to_string(num_threads), [counter_end]() {
+        RunPerfTest<spin_lock, num_threads>(counter_end);
+    });
+
     std::cout << num_threads;
-    for (std::size_t i_repeat = 0; i_repeat < num_repeats; ++i_repeat)
+    for (const double dt_ms : stats.samples)
     {
-        auto dt_ms = CalcTimeExecution(RunPerfTest<spin_lock, num_threads>, counter_end);
-        if (i_repeat < num_skip)
-            continue;
-        
-        std::cout << ' ' << dt_ms;
+        std::cout << ' ' << static_cast<long>(dt_ms * 1000);
     }
     std::cout << std::endl;
 }
 
-int main()
+// a.out [--save-baseline <path>] [--baseline <path>]: the samples are kept or compared with
+// the kept ones, the comparison goes to stderr so that stdout stays the input of plot_res.py
+int main(int argc, char* argv[])
 {
     std::ios_base::sync_with_stdio(false);
+    const auto baseline_args = bench::ParseBaselineArgs(argc, argv);
 
     constexpr auto spin_lock = SPIN_LOCK::RB_LOCK;
     constexpr std::size_t counter_end  = 1'000'000;
@@ -131,17 +166,23 @@ int main()
     static_assert(num_skip < num_repeats);
 
     std::cout << num_repeats - num_skip << '\n';
-
-    // PrintTimePerfTest<spin_lock, 1>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 2>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 3>(counter_end, num_repeats, num_skip);
-    PrintTimePerfTest<spin_lock, 4>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 5>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 6>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 7>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 8>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 9>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 10>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 11>(counter_end, num_repeats, num_skip);
-    // PrintTimePerfTest<spin_lock, 12>(counter_end, num_repeats, num_skip);
-}
\ No newline at end of file
+    bench::BenchConfig config;
+    config.num_warmups = num_skip;
+    config.num_repeats = num_repeats - num_skip;
+    bench::BenchRunner runner{ config };
+
+    // PrintTimePerfTest<spin_lock, 1>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 2>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 3>(runner, counter_end);
+    PrintTimePerfTest<spin_lock, 4>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 5>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 6>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 7>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 8>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 9>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 10>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 11>(runner, counter_end);
+    // PrintTimePerfTest<spin_lock, 12>(runner, counter_end);
+
+    return baseline_args.Apply(runner, std::cerr) > 0;
+}
@@ -2,10 +2,14 @@
 #include <vector>
 #include <algorithm>
 #include <barrier>
+#include <atomic>
+#include <memory>
+#include <string>
 
 #include "HazardPointer.hpp"
 #include "SplitOrderedList.hpp"
 #include "List.hpp"
+#include "../../bench/bench.hpp"
 
 void TestListNative()
 {
@@ -230,19 +234,20 @@ void TestMultiThredingSOL(int num_threads)
     }}.join();
 }
 
-int64_t PerfTestSOL(unsigned num_threads)
+// Inserts, finds and erases num_insert keys split between num_threads threads.
+// Thread i runs on core i and waits for the start flag, so none of them starts before all are pinned
+void PerfTestSOL(lf::SplitOrderedList<int>& sol, unsigned num_threads)
 {
     const int num_insert = 50'000;
-    const int num_erase = num_insert / 20;
-
-    lf::SplitOrderedList<int> sol{(unsigned)num_threads};
-
-    auto time_begin = std::chrono::high_resolution_clock::now();
 
+    std::atomic<bool> is_started{ false };
     std::vector<std::thread> threads;
     for (int i_th = 0; i_th < num_threads; ++i_th)
     {
-        threads.emplace_back([&sol, num_insert, i_th, num_threads](){
+        threads.emplace_back([&sol, &is_started, num_insert, i_th, num_threads](){
+            while (!is_started.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
             int i_begin = i_th * num_insert / num_threads;
             int i_end = (i_th + 1) * num_insert / num_threads;
 
@@ -258,28 +263,41 @@ int64_t PerfTestSOL(unsigned num_threads)
             for (int i = i_begin; i < i_end; ++i)
                 sol.Erase(10 * i);
         });
+        bench::PinThread(threads.back(), i_th % std::max(std::thread::hardware_concurrency(), 1u));
     }
+    is_started.store(true, std::memory_order_release);
 
     for (auto& th : threads)
         th.join();
-
-    auto time_end = std::chrono::high_resolution_clock::now();
-    auto dtime = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_begin).count();
-
-    return dtime;
 }
 
+// a.out <num_threads> [--save-baseline <path>] [--baseline <path>]
+// Prints: num_threads median_time_ms for 1..num_threads, the samples go to runner as sol_<num_threads>.
+// The comparison with the baseline goes to stderr so that stdout stays the input of plot.py
 int main(int argc, char* argv[])
 {
-    int num_threads = argc == 2 ? atoi(argv[1]) : -1;
+    int num_threads = argc >= 2 ? atoi(argv[1]) : -1;
     if (num_threads <= 0)
     {
         std::cerr << "Inter the number of threads, please" << std::endl;
         return 0;
     }
+    // argv[1] takes the place of the program name
+    const auto baseline_args = bench::ParseBaselineArgs(argc - 1, argv + 1);
+
+    bench::BenchConfig config;
+    config.num_warmups = 1;
+    config.num_repeats = 5;
+    bench::BenchRunner runner{ config };
 
     for (int i = 1; i <= num_threads; ++i)
-        std::cout << i << " " << PerfTestSOL(i) << std::endl;
+    {
+        // The list is made before every sample and is not timed
+        const auto& stats = runner.Run("sol_" + std::to_string(i),
+            [i]() { return std::make_unique<lf::SplitOrderedList<int>>((unsigned)i); },
+            [i](auto& sol) { PerfTestSOL(*sol, i); });
+        std::cout << i << " " << stats.median << std::endl;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return baseline_args.Apply(runner, std::cerr) > 0;
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <limits>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Benchmark runner shared by the subprojects: warmup runs, pinning to a core,
+// median / p95 / stddev of the samples and comparison with a saved baseline.
+//
+//  bench::BenchRunner runner{ { 2, 10 } }; // 2 warmups, 10 samples
+//  runner.Run("mxcl_1024", [] { return MakeOperands(); }, [](auto& operands) { Multiply(operands); });
+//  runner.CompareWithBaseline("baseline.txt");
+//
+// Drivers take --save-baseline <path> or --baseline <path> through ParseBaselineArgs.
+//
+// The setup part is called before every sample and is not timed, so operands are
+// made when they are needed instead of being held for all repeats at once.
+
+namespace bench
+{
+
+class ThreadPins;
+
+struct BenchConfig
+{
+    // Runs before the samples, not counted: page faults, caches, frequency ramp-up
+    std::size_t num_warmups = 2;
+    std::size_t num_repeats = 10;
+    // The calling thread runs on this core during the benchmark, -1 - not pinned
+    int pin_cpu = -1;
+    // With pin_cpu set, pins the worker threads of the measured code through ThreadPins starting
+    // from the given core. It is called before every run, workers started by a previous run get
+    // pinned too. Their previous affinity is restored when the measurement ends
+    std::function<void(unsigned, ThreadPins&)> pin_workers;
+};
+
+// Sample times are in milliseconds
+struct BenchStats
+{
+    std::vector<double> samples;
+    double mean, median, p95, stddev, min;
+};
+
+inline BenchStats CalcStats(std::vector<double> samples)
+{
+    if (samples.empty())
+    {
+        throw std::invalid_argument("No samples");
+    }
+
+    BenchStats stats{};
+    stats.samples = samples;
+
+    std::sort(samples.begin(), samples.end());
+    const auto num_samples = samples.size();
+    const auto calc_percentile = [&](double fraction) {
+        // Linear interpolation between the closest ranks
+        const double pos = fraction * (num_samples - 1);
+        const auto i_low = static_cast<std::size_t>(pos);
+        const auto i_high = std::min(i_low + 1, num_samples - 1);
+        return samples[i_low] + (samples[i_high] - samples[i_low]) * (pos - i_low);
+    };
+
+    stats.min = samples.front();
+    stats.median = calc_percentile(0.5);
+    stats.p95 = calc_percentile(0.95);
+    stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / num_samples;
+
+    double sum_sq = 0;
+    for (const double sample : samples)
+    {
+        sum_sq += (sample - stats.mean) * (sample - stats.mean);
+    }
+    stats.stddev = num_samples > 1 ? std::sqrt(sum_sq / (num_samples - 1)) : 0;
+
+    return stats;
+}
+
+// Thread affinity ----------------------------------------------------------------------------------
+
+#ifdef __linux__
+
+inline bool PinThread(pthread_t thread, unsigned cpu) noexcept
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) == 0;
+}
+
+inline bool PinThread(std::thread& thread, unsigned cpu) noexcept
+{
+    return PinThread(thread.native_handle(), cpu);
+}
+
+// The core the calling thread is running on now, -1 - unknown
+inline int GetCurrentCpu() noexcept
+{
+    return sched_getcpu();
+}
+
+// Pins other threads and restores their affinity from before the first Pin on destruction,
+// the threads must outlive the object
+class ThreadPins
+{
+public:
+    ThreadPins() = default;
+    ThreadPins(const ThreadPins&) = delete;
+    ThreadPins& operator=(const ThreadPins&) = delete;
+
+    ~ThreadPins()
+    {
+        for (const auto& [thread, old_cpu_set] : m_old_cpu_sets)
+        {
+            pthread_setaffinity_np(thread, sizeof(old_cpu_set), &old_cpu_set);
+        }
+    }
+
+    bool Pin(std::thread& thread, unsigned cpu)
+    {
+        const auto handle = thread.native_handle();
+        const bool is_saved = std::any_of(m_old_cpu_sets.begin(), m_old_cpu_sets.end(),
+                                          [handle](const auto& old) { return pthread_equal(old.first, handle); });
+        if (!is_saved)
+        {
+            cpu_set_t old_cpu_set;
+            if (pthread_getaffinity_np(handle, sizeof(old_cpu_set), &old_cpu_set) != 0)
+            {
+                return false;
+            }
+            m_old_cpu_sets.emplace_back(handle, old_cpu_set);
+        }
+
+        return PinThread(handle, cpu);
+    }
+
+private:
+    std::vector<std::pair<pthread_t, cpu_set_t>> m_old_cpu_sets;
+};
+
+// Pins the calling thread for the lifetime of the object, then restores its affinity
+class ScopedPin
+{
+public:
+    explicit ScopedPin(int cpu) noexcept
+        : m_is_pinned{ false }
+    {
+        if (cpu >= 0 && pthread_getaffinity_np(pthread_self(), sizeof(m_old_cpu_set), &m_old_cpu_set) == 0)
+        {
+            m_is_pinned = PinThread(pthread_self(), cpu);
+        }
+    }
+
+    ScopedPin(const ScopedPin&) = delete;
+    ScopedPin& operator=(const ScopedPin&) = delete;
+
+    ~ScopedPin()
+    {
+        if (m_is_pinned)
+        {
+            pthread_setaffinity_np(pthread_self(), sizeof(m_old_cpu_set), &m_old_cpu_set);
+        }
+    }
+
+private:
+    bool m_is_pinned;
+    cpu_set_t m_old_cpu_set;
+};
+
+#else
+
+inline bool PinThread(std::thread&, unsigned) noexcept
+{
+    return false;
+}
+
+inline int GetCurrentCpu() noexcept
+{
+    return -1;
+}
+
+class ThreadPins
+{
+public:
+    bool Pin(std::thread&, unsigned) { return false; }
+};
+
+class ScopedPin
+{
+public:
+    explicit ScopedPin(int) noexcept
+    {}
+};
+
+#endif // __linux__
+
+// Measurement --------------------------------------------------------------------------------------
+
+// run(setup()) num_warmups + num_repeats times, only run is timed
+template <typename Setup, typename Run>
+BenchStats Measure(const BenchConfig& config, Setup&& setup, Run&& run)
+{
+    if (config.num_repeats == 0)
+    {
+        throw std::invalid_argument("num_repeats must be above zero");
+    }
+
+    ScopedPin pin{ config.pin_cpu };
+    ThreadPins worker_pins;
+
+    std::vector<double> samples;
+    samples.reserve(config.num_repeats);
+    for (std::size_t i_run = 0; i_run < config.num_warmups + config.num_repeats; ++i_run)
+    {
+        auto state = setup();
+        if (config.pin_cpu >= 0 && config.pin_workers)
+        {
+            config.pin_workers(config.pin_cpu + 1, worker_pins);
+        }
+
+        const auto time_begin = std::chrono::steady_clock::now();
+        run(state);
+        const auto time_end = std::chrono::steady_clock::now();
+
+        if (i_run >= config.num_warmups)
+        {
+            samples.push_back(std::chrono::duration<double, std::milli>(time_end - time_begin).count());
+        }
+    }
+
+    return CalcStats(std::move(samples));
+}
+
+template <typename Run>
+BenchStats Measure(const BenchConfig& config, Run&& run)
+{
+    return Measure(config, [] { return 0; }, [&run](int) { run(); });
+}
+
+// Baseline comparison ------------------------------------------------------------------------------
+
+// Named results of a session. A baseline file keeps one line per benchmark:
+// <name> <median> <p95> <stddev>, names must not contain spaces
+class BenchRunner
+{
+public:
+    explicit BenchRunner(BenchConfig config = {})
+        : m_config{ config }
+    {}
+
+    template <typename SetupFunc, typename RunFunc>
+    const BenchStats& Run(const std::string& name, SetupFunc&& setup, RunFunc&& run)
+    {
+        return Add(name, Measure(m_config, std::forward<SetupFunc>(setup), std::forward<RunFunc>(run)));
+    }
+
+    template <typename RunFunc>
+    const BenchStats& Run(const std::string& name, RunFunc&& run)
+    {
+        return Add(name, Measure(m_config, std::forward<RunFunc>(run)));
+    }
+
+    const BenchStats& Add(const std::string& name, BenchStats stats)
+    {
+        if (name.empty() || name.find_first_of(" \t\n") != std::string::npos)
+        {
+            throw std::invalid_argument("Invalid benchmark name: " + name);
+        }
+
+        m_results.emplace_back(name, std::move(stats));
+        return m_results.back().second;
+    }
+
+    const std::vector<std::pair<std::string, BenchStats>>& GetResults() const noexcept { return m_results; }
+
+    // Prints: name median p95 stddev mean, milliseconds
+    void Print(std::ostream& os = std::cout) const
+    {
+        for (const auto& [name, stats] : m_results)
+        {
+            os << name << ' ' << stats.median << ' ' << stats.p95 << ' ' << stats.stddev << ' '
+               << stats.mean << '\n';
+        }
+    }
+
+    void SaveBaseline(const std::string& path) const
+    {
+        std::ofstream file{ path, std::ios::trunc };
+        if (!file)
+        {
+            throw std::runtime_error("Can not write baseline: " + path);
+        }
+
+        file.precision(std::numeric_limits<double>::max_digits10);
+        for (const auto& [name, stats] : m_results)
+        {
+            file << name << ' ' << stats.median << ' ' << stats.p95 << ' ' << stats.stddev << '\n';
+        }
+    }
+
+    // Prints: name base_median median change, change = median / base_median - 1.
+    // A benchmark regresses when its median is slower by more than threshold and by more
+    // than the noise (the larger of both stddevs). Returns the number of regressions
+    std::size_t CompareWithBaseline(const std::string& path, double threshold = 0.05,
+                                    std::ostream& os = std::cout) const
+    {
+        std::ifstream file{ path };
+        if (!file)
+        {
+            throw std::runtime_error("Can not read baseline: " + path);
+        }
+
+        std::map<std::string, std::pair<double, double>> baseline;
+        std::string name;
+        double median = 0, p95 = 0, stddev = 0;
+        while (file >> name >> median >> p95 >> stddev)
+        {
+            baseline[name] = { median, stddev };
+        }
+
+        std::size_t num_regressions = 0;
+        for (const auto& [name, stats] : m_results)
+        {
+            const auto it = baseline.find(name);
+            if (it == baseline.end())
+            {
+                os << name << " - - new\n";
+                continue;
+            }
+
+            const auto [base_median, base_stddev] = it->second;
+            const double change = stats.median / base_median - 1;
+            const bool is_regression = change > threshold &&
+                                       stats.median - base_median > std::max(stats.stddev, base_stddev);
+            num_regressions += is_regression;
+
+            os << name << ' ' << base_median << ' ' << stats.median << ' ' << std::showpos << change * 100
+               << std::noshowpos << '%' << (is_regression ? " REGRESSION" : "") << '\n';
+        }
+
+        return num_regressions;
+    }
+
+private:
+    BenchConfig m_config;
+    std::vector<std::pair<std::string, BenchStats>> m_results;
+};
+
+// Command line of a benchmark driver: --save-baseline <path> keeps the results of the session,
+// --baseline <path> compares them with the kept ones. Empty paths - not requested
+struct BaselineArgs
+{
+    std::string save_path;
+    std::string compare_path;
+
+    // Does what was requested, returns the number of regressions
+    std::size_t Apply(const BenchRunner& runner, std::ostream& os = std::cout) const
+    {
+        if (!save_path.empty())
+        {
+            runner.SaveBaseline(save_path);
+        }
+        return compare_path.empty() ? 0 : runner.CompareWithBaseline(compare_path, 0.05, os);
+    }
+};
+
+inline BaselineArgs ParseBaselineArgs(int argc, const char* const argv[])
+{
+    BaselineArgs args;
+    for (int i_arg = 1; i_arg < argc; ++i_arg)
+    {
+        const std::string arg = argv[i_arg];
+        if ((arg != "--save-baseline" && arg != "--baseline") || i_arg + 1 == argc)
+        {
+            throw std::invalid_argument("Usage: [--save-baseline <path>] [--baseline <path>], got: " + arg);
+        }
+        (arg == "--baseline" ? args.compare_path : args.save_path) = argv[++i_arg];
+    }
+    return args;
+}
+
+} // namespace bench
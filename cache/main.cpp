@@ -2,11 +2,24 @@
 #include <iomanip>
 #include <vector>
 #include <chrono>
+#include <string>
 
 #include "other_func.hpp"
+#include "../bench/bench.hpp"
 
-int main()
+// a.out [--save-baseline <path>] [--baseline <path>]
+// Prints: step time_per_access_ns, the samples go to runner as step_<step>.
+// The comparison with the baseline goes to stderr so that stdout stays the input of plot.py
+int main(int argc, char* argv[])
 {
+    const auto baseline_args = bench::ParseBaselineArgs(argc, argv);
+
+    bench::BenchConfig config;
+    config.num_warmups = 1;
+    config.num_repeats = 5;
+    config.pin_cpu = bench::GetCurrentCpu();
+    bench::BenchRunner runner{ config };
+
     const std::size_t buf_size_mb = 200;
 
     const std::size_t buf_num_elems = buf_size_mb * 1'000'000;
@@ -30,22 +43,20 @@ int main()
             auto buf = RandGen.get_vector<uint8_t>(buf_num_elems);
             const auto size_buf = buf.size();
 
-            auto begin = std::chrono::high_resolution_clock::now();
-
-            uint64_t acc{};
-            for (std::size_t pos = 0; pos < size_buf; pos += step)
-            {
-                acc += buf[pos];
-            }
-            
-            // Save result in memory
-            {
-                volatile auto _ {acc};
-            }
-            auto end = std::chrono::high_resolution_clock::now();
-
-            auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
-            double time =  double(dt) / (double (size_buf) / step);
+            const auto& stats = runner.Run("step_" + std::to_string(step), [&buf, size_buf, step]() {
+                uint64_t acc{};
+                for (std::size_t pos = 0; pos < size_buf; pos += step)
+                {
+                    acc += buf[pos];
+                }
+
+                // Save result in memory
+                {
+                    volatile auto _ {acc};
+                }
+            });
+
+            double time = stats.median * 1e6 / (double (size_buf) / step);
             res.emplace_back(step, time);
         }
 
@@ -55,4 +66,6 @@ int main()
     {
         std::cout << std::setw(5) << step << ' ' << time << std::endl;
     }
-}
\ No newline at end of file
+
+    return baseline_args.Apply(runner, std::cerr) > 0;
+}
@@ -1,5 +1,7 @@
 #!/bin/python3
 
+import os
+
 import matplotlib.pyplot as plt
 import numpy as np
 
@@ -7,6 +9,12 @@ path_nv="../results/time_native"
 path_cl="../results/time_cachelike"
 path_nvpl="../results/time_native_parallel"
 path_clpl="../results/time_cachelike_parallel"
+path_perf="../results/perf.csv"
+
+# Roofs of the machine for the roofline: peak double FLOPs of all cores and memory
+# bandwidth (e.g. from STREAM). Set them for the machine the results come from
+PEAK_GFLOPS = 500.0
+PEAK_BANDWIDTH_GBS = 40.0
 
 def ProcessTimeSize(path):
     data = np.loadtxt(path)
@@ -104,4 +112,32 @@ plt.xlabel("Number threads")
 plt.ylabel("log(Time)")
 plt.title("Native and Cache-like implementation")
 
+################################################################
+# Roofline from graphics' perf.csv: GFLOP/s against FLOPs per byte of memory traffic
+def PlotRoofline(path):
+    data = np.genfromtxt(path, delimiter=',', names=True, dtype=None, encoding=None)
+    data = data[data['intensity'] > 0]
+    if data.size == 0:
+        print("No LLC miss counters in", path, "- perf_event_open is not available?")
+        return
+
+    plt.figure()
+
+    intensity = np.logspace(np.log10(data['intensity'].min() / 2), np.log10(data['intensity'].max() * 2))
+    roof = np.minimum(PEAK_GFLOPS, PEAK_BANDWIDTH_GBS * intensity)
+    plt.loglog(intensity, roof, color='r', linestyle='--', label='roof')
+
+    for name in np.unique(data['name']):
+        sample = data[data['name'] == name]
+        plt.scatter(sample['intensity'], sample['gflops'], marker='x', label=name)
+
+    plt.grid(which='both')
+    plt.xlabel("FLOP / byte of memory traffic")
+    plt.ylabel("GFLOP/s")
+    plt.title("Roofline")
+    plt.legend()
+
+if os.path.exists(path_perf):
+    PlotRoofline(path_perf)
+
 plt.show()
\ No newline at end of file
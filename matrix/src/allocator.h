@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace mxcmn
+{
+
+// Storage allocators for the Alloc template parameter of the matrix classes.
+//
+// Both of them leave vector elements default-initialized, so the pages of a fresh
+// matrix are not touched by the allocating thread. The matrix zeroes its storage
+// itself, the parallel engines do it from the pool workers in the same order they
+// later compute on it. On NUMA machines the first touch places every page on the node
+// of a thread that uses it instead of putting the whole matrix on one node.
+
+template <typename Alloc, typename = void>
+constexpr bool IsDefaultInitAllocator = false;
+
+template <typename Alloc>
+constexpr bool IsDefaultInitAllocator<Alloc, std::void_t<typename Alloc::is_default_init>> =
+    Alloc::is_default_init::value;
+
+// Fills the storage of a vector built on a default-init allocator by value
+template <typename Vector, typename T>
+void InitStorage(Vector& buf, const T& value)
+{
+    if constexpr (IsDefaultInitAllocator<typename Vector::allocator_type>)
+    {
+        std::fill(buf.begin(), buf.end(), value);
+    }
+}
+
+template <typename T>
+class DefaultInitConstruct
+{
+public:
+    using value_type = T;
+    using is_default_init = std::true_type;
+
+    template <typename U>
+    void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args)
+    {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
+// Alignment = 64 puts every row (block) of a matrix on a cache line boundary
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator : public DefaultInitConstruct<T>
+{
+public:
+    static constexpr std::size_t alignment = std::max(Alignment, alignof(T));
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+    {}
+
+    T* allocate(std::size_t num)
+    {
+        return static_cast<T*>(::operator new(num * sizeof(T), std::align_val_t{ alignment }));
+    }
+
+    void deallocate(T* ptr, std::size_t) noexcept
+    {
+        ::operator delete(ptr, std::align_val_t{ alignment });
+    }
+};
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) noexcept
+{
+    return false;
+}
+
+// Buffers of at least HugePageSize bytes are 2 MB aligned and marked with
+// madvise(MADV_HUGEPAGE), so transparent huge pages back them: a 20 MB matrix needs
+// ten TLB entries instead of five thousand. Smaller buffers are cache line aligned.
+template <typename T>
+class HugePageAllocator : public DefaultInitConstruct<T>
+{
+public:
+    static constexpr std::size_t HugePageSize = std::size_t{ 2 } << 20;
+    static constexpr std::size_t SmallAlignment = std::max<std::size_t>(64, alignof(T));
+
+    template <typename U>
+    struct rebind
+    {
+        using other = HugePageAllocator<U>;
+    };
+
+    HugePageAllocator() noexcept = default;
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) noexcept
+    {}
+
+    T* allocate(std::size_t num)
+    {
+        const std::size_t size = num * sizeof(T);
+        if (size < HugePageSize)
+        {
+            return static_cast<T*>(::operator new(size, std::align_val_t{ SmallAlignment }));
+        }
+
+        const std::size_t size_aligned = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+        void* ptr = std::aligned_alloc(HugePageSize, size_aligned);
+        if (ptr == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Only a hint: fails harmlessly when transparent huge pages are disabled
+        madvise(ptr, size_aligned, MADV_HUGEPAGE);
+#endif
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t num) noexcept
+    {
+        if (num * sizeof(T) < HugePageSize)
+        {
+            ::operator delete(ptr, std::align_val_t{ SmallAlignment });
+        }
+        else
+        {
+            std::free(ptr);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) noexcept
+{
+    return false;
+}
+
+} // namespace mxcmn
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <optional>
+#include <exception>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace mxcmn
+{
+
+// out = lhs * rhs on the pool of the parallel engines, the future is ready when out is.
+// lhs, rhs and out must stay alive and untouched until then
+template <typename MOut, typename MIn>
+std::future<void> MultiplyAsync(const MIn& lhs, const MIn& rhs, MOut& out)
+{
+    return ThreadPool::Get().Submit([&lhs, &rhs, &out] { Multiply(lhs, rhs, out); });
+}
+
+// Engines which can pack rhs ahead of the product, see mxclpl::Matrix::PackRhs
+template <typename M, typename = void>
+constexpr bool HasPackRhs = false;
+
+template <typename M>
+constexpr bool HasPackRhs<M, std::void_t<decltype(std::declval<M&>().PackRhs(1, std::declval<const M&>()))>> =
+    true;
+
+// Products submitted one after another are computed in the order of submission, one at a time
+// on all threads of the engine. Up to prepare_depth products behind the computed one are
+// prepared: their outputs are allocated and first touched, and engines with PackRhs pack rhs.
+// So the preparation of the next product overlaps the compute of the current one and the workers
+// do not idle between them, while the memory of the queue stays at prepare_depth + 1 outputs.
+// No task of the pipeline waits for another one, every stage is started by the previous stage.
+template <typename M>
+class MultiplyPipeline
+{
+public:
+    // num_threads of the outputs for the engines which take it
+    explicit MultiplyPipeline(int num_threads = -1, std::size_t prepare_depth = 1) noexcept
+        : m_num_threads{ num_threads }, m_prepare_depth{ std::max<std::size_t>(prepare_depth, 1) }
+    {}
+
+    MultiplyPipeline(const MultiplyPipeline&) = delete;
+    MultiplyPipeline& operator=(const MultiplyPipeline&) = delete;
+
+    // Waits for all submitted products
+    ~MultiplyPipeline() { Wait(); }
+
+    // lhs * rhs, the operands are kept until the product is ready. Errors are reported by the future
+    std::future<M> Submit(M lhs, M rhs);
+
+    void Wait();
+
+    // Most products prepared or being prepared at once, not counting the computed one
+    std::size_t GetMaxNumAhead() const;
+
+private:
+    struct Item
+    {
+        M lhs, rhs;
+        std::optional<M> out;
+        std::exception_ptr error;
+        std::promise<M> promise;
+    };
+
+    M MakeOut(const Item& item) const;
+    void Prepare(std::size_t i_item, const std::shared_ptr<Item>& item);
+    void Compute(Item& item);
+    // Start the next stages while there is room for them, m_mutex is held
+    void TryStartPrepare();
+    void TryStartCompute();
+
+private:
+    int m_num_threads;
+    std::size_t m_prepare_depth;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::shared_ptr<Item>> m_waiting;
+    std::map<std::size_t, std::shared_ptr<Item>> m_prepared;
+    std::size_t m_num_submitted = 0;
+    std::size_t m_i_next_prepare = 0;
+    std::size_t m_i_next_compute = 0;
+    std::size_t m_num_ahead = 0;
+    std::size_t m_max_num_ahead = 0;
+    bool m_is_computing = false;
+};
+
+template <typename M>
+std::future<M> MultiplyPipeline<M>::Submit(M lhs, M rhs)
+{
+    auto item = std::make_shared<Item>(Item{ std::move(lhs), std::move(rhs), {}, {}, {} });
+    auto future = item->promise.get_future();
+
+    std::lock_guard lock{ m_mutex };
+    ++m_num_submitted;
+    m_waiting.push_back(std::move(item));
+    TryStartPrepare();
+    return future;
+}
+
+template <typename M>
+void MultiplyPipeline<M>::Wait()
+{
+    std::unique_lock lock{ m_mutex };
+    m_cv.wait(lock, [this] { return m_i_next_compute == m_num_submitted; });
+}
+
+template <typename M>
+std::size_t MultiplyPipeline<M>::GetMaxNumAhead() const
+{
+    std::lock_guard lock{ m_mutex };
+    return m_max_num_ahead;
+}
+
+template <typename M>
+M MultiplyPipeline<M>::MakeOut(const Item& item) const
+{
+    const auto num_rows = item.lhs.GetNumRows(), num_cols = item.rhs.GetNumCols();
+    if constexpr (std::is_constructible_v<M, decltype(num_rows), decltype(num_cols), int>)
+    {
+        return M{ num_rows, num_cols, m_num_threads };
+    }
+    else
+    {
+        return M{ num_rows, num_cols };
+    }
+}
+
+template <typename M>
+void MultiplyPipeline<M>::Prepare(std::size_t i_item, const std::shared_ptr<Item>& item)
+{
+    try
+    {
+        auto& out = item->out.emplace(MakeOut(*item));
+        if constexpr (HasPackRhs<M>)
+        {
+            out.PackRhs(1, item->rhs);
+        }
+    }
+    catch (...)
+    {
+        item->error = std::current_exception();
+    }
+
+    std::lock_guard lock{ m_mutex };
+    m_prepared.emplace(i_item, item);
+    TryStartCompute();
+}
+
+template <typename M>
+void MultiplyPipeline<M>::Compute(Item& item)
+{
+    if (item.error)
+    {
+        item.promise.set_exception(item.error);
+        return;
+    }
+
+    try
+    {
+        auto& out = *item.out;
+        if constexpr (HasPackRhs<M>)
+        {
+            out.GemmPacked(item.lhs, 0);
+            out.ReleaseScratch();
+        }
+        else
+        {
+            Multiply(item.lhs, item.rhs, out);
+        }
+        item.promise.set_value(std::move(out));
+    }
+    catch (...)
+    {
+        item.promise.set_exception(std::current_exception());
+    }
+}
+
+template <typename M>
+void MultiplyPipeline<M>::TryStartPrepare()
+{
+    for (; m_num_ahead < m_prepare_depth && !m_waiting.empty(); ++m_num_ahead)
+    {
+        auto item = std::move(m_waiting.front());
+        m_waiting.pop_front();
+        ThreadPool::Get().Submit([this, i_item = m_i_next_prepare++, item] { Prepare(i_item, item); });
+    }
+    m_max_num_ahead = std::max(m_max_num_ahead, m_num_ahead);
+}
+
+template <typename M>
+void MultiplyPipeline<M>::TryStartCompute()
+{
+    const auto it = m_prepared.find(m_i_next_compute);
+    if (m_is_computing || it == m_prepared.end())
+    {
+        return;
+    }
+
+    auto item = std::move(it->second);
+    m_prepared.erase(it);
+    m_is_computing = true;
+
+    ThreadPool::Get().Submit([this, item] {
+        Compute(*item);
+
+        std::lock_guard lock{ m_mutex };
+        m_is_computing = false;
+        ++m_i_next_compute;
+        TryStartCompute();
+        m_cv.notify_all();
+    });
+
+    // The computed item leaves the window, the next one is prepared meanwhile
+    --m_num_ahead;
+    TryStartPrepare();
+}
+
+} // namespace mxcmn
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "matrix.h"
+#include "perf_test.h"
+
+namespace mxat
+{
+
+using PositionT = mxcmn::PositionT;
+using SizeT = mxcmn::SizeT;
+
+// Runtime choice of engine, QSize and number of threads for out = lhs * rhs.
+// On first use of a (type, shape) every candidate is timed on views of that shape, the
+// fastest one is written to the tune file and serves all later products of the shape.
+// Operands are row-major views, they are copied into the storage of the chosen engine
+// and back: O(n^2) next to the O(n^3) product, but larger for the block layouts.
+// Candidates are timed with these copies, so the winner is the fastest Multiply.
+
+enum class Engine
+{
+    Native,
+    NativeTr,
+    CacheLike,
+    NativeParallel,
+    CacheLikeParallel,
+    PackedGemm
+};
+
+inline const char* GetEngineName(Engine engine) noexcept
+{
+    switch (engine)
+    {
+    case Engine::Native: return "mxnv";
+    case Engine::NativeTr: return "mxtr";
+    case Engine::CacheLike: return "mxcl";
+    case Engine::NativeParallel: return "mxnvpl";
+    case Engine::CacheLikeParallel: return "mxclpl";
+    case Engine::PackedGemm: return "mxgemm";
+    }
+    return "";
+}
+
+inline Engine GetEngineByName(const std::string& name)
+{
+    for (auto engine : { Engine::Native, Engine::NativeTr, Engine::CacheLike,
+                         Engine::NativeParallel, Engine::CacheLikeParallel, Engine::PackedGemm })
+    {
+        if (name == GetEngineName(engine))
+        {
+            return engine;
+        }
+    }
+    throw std::invalid_argument("Invalide engine name: " + name);
+}
+
+struct TuneConfig
+{
+    Engine engine;
+    // Only for block engines
+    unsigned qsize;
+    // Only for parallel engines, 1 for the rest
+    unsigned num_threads;
+};
+
+struct TuneResult
+{
+    TuneConfig config;
+    // Milliseconds per product
+    double time;
+};
+
+// Engines x QSize {16, 32, 64, 128} x threads {1, half, all of the hardware threads}.
+// mxnv is left out: mxtr is the same loop with a contiguous rhs
+inline std::vector<TuneConfig> GetDefaultCandidates()
+{
+    const unsigned num_hw_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> threads = { 1, num_hw_threads / 2, num_hw_threads };
+    threads.erase(std::remove(threads.begin(), threads.end(), 0u), threads.end());
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+    std::vector<TuneConfig> candidates = { { Engine::NativeTr, 0, 1 }, { Engine::PackedGemm, 0, 1 } };
+    for (unsigned qsize : { 16, 32, 64, 128 })
+    {
+        candidates.push_back({ Engine::CacheLike, qsize, 1 });
+        for (unsigned num_threads : threads)
+        {
+            if (num_threads > 1)
+            {
+                candidates.push_back({ Engine::CacheLikeParallel, qsize, num_threads });
+            }
+        }
+    }
+    for (unsigned num_threads : threads)
+    {
+        if (num_threads > 1)
+        {
+            candidates.push_back({ Engine::NativeParallel, 0, num_threads });
+        }
+    }
+
+    return candidates;
+}
+
+template <typename M>
+struct EngineTag
+{
+    using type = M;
+};
+
+template <typename T>
+struct CacheLikeTag
+{
+    template <std::size_t QSize>
+    using type = mxcl::Matrix<T, QSize>;
+};
+
+template <typename T>
+struct CacheLikeParallelTag
+{
+    template <std::size_t QSize>
+    using type = mxclpl::Matrix<T, QSize>;
+};
+
+// Calls func(EngineTag<M>{}) with the matrix type M of config
+template <typename T, typename F>
+void VisitEngine(const TuneConfig& config, F&& func)
+{
+    const auto visit_block = [&](auto block_tag) {
+        using BlockTag = decltype(block_tag);
+        switch (config.qsize)
+        {
+        case 16: func(EngineTag<typename BlockTag::template type<16>>{}); return;
+        case 32: func(EngineTag<typename BlockTag::template type<32>>{}); return;
+        case 64: func(EngineTag<typename BlockTag::template type<64>>{}); return;
+        case 128: func(EngineTag<typename BlockTag::template type<128>>{}); return;
+        }
+        throw std::invalid_argument("Invalide qsize");
+    };
+
+    switch (config.engine)
+    {
+    case Engine::Native: func(EngineTag<mxnv::Matrix<T>>{}); return;
+    case Engine::NativeTr: func(EngineTag<mxtr::Matrix<T>>{}); return;
+    case Engine::NativeParallel: func(EngineTag<mxnvpl::Matrix<T>>{}); return;
+    case Engine::PackedGemm: func(EngineTag<mxgemm::Matrix<T>>{}); return;
+    case Engine::CacheLike: visit_block(CacheLikeTag<T>{}); return;
+    case Engine::CacheLikeParallel: visit_block(CacheLikeParallelTag<T>{}); return;
+    }
+}
+
+template <typename M>
+M MakeMatrix(SizeT num_rows, SizeT num_cols, unsigned num_threads)
+{
+    if constexpr (std::is_constructible_v<M, SizeT, SizeT, int>)
+    {
+        return M{ num_rows, num_cols, static_cast<int>(num_threads) };
+    }
+    else
+    {
+        return M{ num_rows, num_cols };
+    }
+}
+
+template <typename M, typename T>
+M MakeMatrix(mxcmn::MatrixView<const T> view, unsigned num_threads)
+{
+    auto m = MakeMatrix<M>(view.GetNumRows(), view.GetNumCols(), num_threads);
+    for (PositionT i_row = 0; i_row < view.GetNumRows(); ++i_row)
+    {
+        auto row = m[i_row];
+        for (PositionT i_col = 0; i_col < view.GetNumCols(); ++i_col)
+        {
+            row[i_col] = view(i_row, i_col);
+        }
+    }
+
+    return m;
+}
+
+template <typename T>
+class Autotuner
+{
+public:
+    // Winners are loaded from and saved to tune_path, empty path - keep them in memory only
+    explicit Autotuner(std::string tune_path = "matrix_autotune.txt",
+                       std::vector<TuneConfig> candidates = GetDefaultCandidates());
+
+    // out = lhs * rhs with the fastest config for the shape, tunes on first use
+    void Multiply(mxcmn::MatrixView<const T> lhs, mxcmn::MatrixView<const T> rhs, mxcmn::MatrixView<T> out);
+
+    // The winner for lhs (num_rows x num_k) * rhs (num_k x num_cols), tunes on first use
+    TuneResult GetBest(SizeT num_rows, SizeT num_k, SizeT num_cols);
+
+    // Time of every candidate on the shape, nothing is stored
+    std::vector<TuneResult> Benchmark(SizeT num_rows, SizeT num_k, SizeT num_cols) const;
+
+private:
+    // "<type> <num_rows>x<num_k>x<num_cols>", e.g. "f8 512x512x512"
+    static std::string GetKey(SizeT num_rows, SizeT num_k, SizeT num_cols);
+    // Start of the keys of T, "f8 " for double
+    static std::string GetTypePrefix();
+    static double RunCandidate(const TuneConfig& config, SizeT num_rows, SizeT num_k, SizeT num_cols);
+    // Multiply with config: copies into the engine, Gemm and the copy back
+    static void MultiplyWith(const TuneConfig& config, mxcmn::MatrixView<const T> lhs,
+                             mxcmn::MatrixView<const T> rhs, mxcmn::MatrixView<T> out);
+
+    void Load();
+    void Save() const;
+
+private:
+    std::string m_tune_path;
+    std::vector<TuneConfig> m_candidates;
+    std::map<std::string, TuneResult> m_best;
+    std::mutex m_mutex;
+};
+
+// Autotuner implementation -----------------------------------------------------------------------
+
+template <typename T>
+Autotuner<T>::Autotuner(std::string tune_path, std::vector<TuneConfig> candidates)
+    : m_tune_path{ std::move(tune_path) }
+    , m_candidates{ std::move(candidates) }
+{
+    if (m_candidates.empty())
+    {
+        throw std::invalid_argument("No candidates");
+    }
+
+    Load();
+}
+
+template <typename T>
+std::string Autotuner<T>::GetTypePrefix()
+{
+    std::ostringstream prefix;
+    prefix << (std::is_floating_point_v<T> ? 'f' : std::is_signed_v<T> ? 'i' : 'u') << sizeof(T) << ' ';
+    return prefix.str();
+}
+
+template <typename T>
+std::string Autotuner<T>::GetKey(SizeT num_rows, SizeT num_k, SizeT num_cols)
+{
+    std::ostringstream key;
+    key << GetTypePrefix() << num_rows << 'x' << num_k << 'x' << num_cols;
+    return key.str();
+}
+
+template <typename T>
+double Autotuner<T>::RunCandidate(const TuneConfig& config, SizeT num_rows, SizeT num_k, SizeT num_cols)
+{
+    // About 1 GFLOP per candidate, at least one product
+    const double num_flops = 2.0 * num_rows * num_k * num_cols;
+    const auto num_repeats = static_cast<std::size_t>(std::clamp(1e9 / num_flops, 1.0, 16.0));
+
+    std::vector<T> lhs_buf(std::size_t{ num_rows } * num_k), rhs_buf(std::size_t{ num_k } * num_cols),
+        out_buf(std::size_t{ num_rows } * num_cols);
+    const mxcmn::MatrixView<const T> lhs{ lhs_buf.data(), num_rows, num_k, num_k };
+    const mxcmn::MatrixView<const T> rhs{ rhs_buf.data(), num_k, num_cols, num_cols };
+    const mxcmn::MatrixView<T> out{ out_buf.data(), num_rows, num_cols, num_cols };
+
+    return bench::Measure(GetPerfConfig(1, num_repeats), [&] {
+        MultiplyWith(config, lhs, rhs, out);
+
+        volatile auto tmp = out(num_rows - 1, num_cols - 1);
+        (void)tmp;
+    }).median;
+}
+
+template <typename T>
+std::vector<TuneResult> Autotuner<T>::Benchmark(SizeT num_rows, SizeT num_k, SizeT num_cols) const
+{
+    std::vector<TuneResult> results;
+    for (const auto& config : m_candidates)
+    {
+        results.push_back({ config, RunCandidate(config, num_rows, num_k, num_cols) });
+    }
+
+    return results;
+}
+
+template <typename T>
+TuneResult Autotuner<T>::GetBest(SizeT num_rows, SizeT num_k, SizeT num_cols)
+{
+    if (!num_rows || !num_k || !num_cols)
+    {
+        throw std::invalid_argument("num_rows, num_k and num_cols must be above zero");
+    }
+
+    std::lock_guard lock{ m_mutex };
+
+    const auto key = GetKey(num_rows, num_k, num_cols);
+    if (const auto it = m_best.find(key); it != m_best.end())
+    {
+        return it->second;
+    }
+
+    const auto results = Benchmark(num_rows, num_k, num_cols);
+    const auto best = *std::min_element(results.begin(), results.end(),
+                                        [](const auto& lhs, const auto& rhs) { return lhs.time < rhs.time; });
+    m_best.emplace(key, best);
+    Save();
+
+    return best;
+}
+
+template <typename T>
+void Autotuner<T>::Multiply(mxcmn::MatrixView<const T> lhs, mxcmn::MatrixView<const T> rhs,
+                            mxcmn::MatrixView<T> out)
+{
+    mxcmn::CheckCorrectGemmArgs<T>(lhs, rhs, out);
+
+    MultiplyWith(GetBest(lhs.GetNumRows(), lhs.GetNumCols(), rhs.GetNumCols()).config, lhs, rhs, out);
+}
+
+template <typename T>
+void Autotuner<T>::MultiplyWith(const TuneConfig& config, mxcmn::MatrixView<const T> lhs,
+                                mxcmn::MatrixView<const T> rhs, mxcmn::MatrixView<T> out)
+{
+    VisitEngine<T>(config, [&](auto tag) {
+        using M = typename decltype(tag)::type;
+        const auto lhs_m = MakeMatrix<M>(lhs, config.num_threads);
+        const auto rhs_m = MakeMatrix<M>(rhs, config.num_threads);
+        auto out_m = MakeMatrix<M>(out.GetNumRows(), out.GetNumCols(), config.num_threads);
+        out_m.Gemm(T{1}, lhs_m, rhs_m, T{0});
+
+        for (PositionT i_row = 0; i_row < out.GetNumRows(); ++i_row)
+        {
+            const auto& row = std::as_const(out_m)[i_row];
+            for (PositionT i_col = 0; i_col < out.GetNumCols(); ++i_col)
+            {
+                out(i_row, i_col) = row[i_col];
+            }
+        }
+    });
+}
+
+// Tune file: one winner per line,
+// <type> <num_rows>x<num_k>x<num_cols> <engine> <qsize> <num_threads> <ms per product>.
+// Tuners of all types share the file, each one loads and saves only the lines of its type
+template <typename T>
+void Autotuner<T>::Load()
+{
+    if (m_tune_path.empty())
+    {
+        return;
+    }
+
+    const auto prefix = GetTypePrefix();
+    std::ifstream file{ m_tune_path };
+    std::string type, shape, engine_name;
+    TuneResult result{};
+    while (file >> type >> shape >> engine_name >> result.config.qsize >> result.config.num_threads >> result.time)
+    {
+        const auto key = type + ' ' + shape;
+        if (key.compare(0, prefix.size(), prefix) == 0)
+        {
+            result.config.engine = GetEngineByName(engine_name);
+            m_best[key] = result;
+        }
+    }
+}
+
+template <typename T>
+void Autotuner<T>::Save() const
+{
+    if (m_tune_path.empty())
+    {
+        return;
+    }
+
+    // Keep the lines of other types, m_best holds all lines of T
+    const auto prefix = GetTypePrefix();
+    std::vector<std::string> lines;
+    {
+        std::ifstream file{ m_tune_path };
+        for (std::string line; std::getline(file, line);)
+        {
+            if (!line.empty() && line.compare(0, prefix.size(), prefix) != 0)
+            {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    std::ofstream file{ m_tune_path, std::ios::trunc };
+    file.precision(std::numeric_limits<double>::max_digits10);
+    for (const auto& line : lines)
+    {
+        file << line << '\n';
+    }
+    for (const auto& [key, result] : m_best)
+    {
+        file << key << ' ' << GetEngineName(result.config.engine) << ' ' << result.config.qsize << ' '
+             << result.config.num_threads << ' ' << result.time << '\n';
+    }
+}
+
+} // namespace mxat
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+#include "qmatrix.h"
+#include "thread_pool.h"
+
+namespace mxcmn
+{
+
+// Many independent products: the batch is split between the pool workers and every
+// product runs on one thread, so small matrices do not pay for a parallel multiply.
+// Use single-threaded engines (mxnv, mxtr, mxcl, mxgemm) as M.
+
+// Chunks of the batch claimed by a worker at once: about 8 claims per worker
+inline std::size_t CalcBatchChunkSize(std::size_t num_items, unsigned num_workers) noexcept
+{
+    return std::max<std::size_t>(1, num_items / (8 * std::size_t{ num_workers }));
+}
+
+// Calls func(i_item) for i_item in [0, num_items) on up to num_threads threads,
+// num_threads == 0 - one per hardware thread. The first exception of func is rethrown
+// after all threads are finished, the items not started by then are skipped
+template <typename F>
+void BatchFor(std::size_t num_items, unsigned num_threads, F&& func)
+{
+    if (num_threads == 0)
+    {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    const auto chunk_size = CalcBatchChunkSize(num_items, num_threads);
+    const auto num_chunks = (num_items + chunk_size - 1) / chunk_size;
+    const auto num_workers = static_cast<unsigned>(std::min<std::size_t>(num_threads, num_chunks));
+
+    std::atomic<std::size_t> i_next_chunk{ 0 };
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    ThreadPool::Get().Run(num_workers, [&](unsigned) {
+        // Run only skips tasks not started yet, the chunks of a running task are stopped here
+        try
+        {
+            for (auto i_chunk = i_next_chunk++; i_chunk < num_chunks; i_chunk = i_next_chunk++)
+            {
+                const auto i_item_end = std::min(num_items, (i_chunk + 1) * chunk_size);
+                for (auto i_item = i_chunk * chunk_size; i_item < i_item_end; ++i_item)
+                {
+                    func(i_item);
+                }
+            }
+        }
+        catch (...)
+        {
+            // Other threads stop at their next chunk
+            i_next_chunk = num_chunks;
+
+            std::lock_guard lock{ error_mutex };
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    });
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+// lhs[i] *= rhs[i] for i in [0, num_items). The sizes of all pairs are checked
+// before the first product, so a bad pair does not leave the batch half multiplied
+template <typename M>
+void BatchMultiply(M* lhs, const M* rhs, std::size_t num_items, unsigned num_threads = 0)
+{
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        if (lhs[i_item].GetNumCols() != rhs[i_item].GetNumRows())
+        {
+            throw std::invalid_argument("Invalide mult sizes");
+        }
+    }
+
+    BatchFor(num_items, num_threads, [lhs, rhs](std::size_t i_item) {
+        lhs[i_item] *= rhs[i_item];
+    });
+}
+
+// Compile-time sized N x N products: lhs[i] = lhs[i] * rhs[i] straight on the QMatrix kernel
+template <typename T, std::size_t N>
+void BatchMultiply(qmx::QMatrix<T, N>* lhs, const qmx::QMatrix<T, N>* rhs, std::size_t num_items,
+                   unsigned num_threads = 0)
+{
+    BatchFor(num_items, num_threads, [lhs, rhs](std::size_t i_item) {
+        qmx::QMatrix<T, N> rhs_tr, res{};
+        rhs[i_item].Transpose(rhs_tr);
+        res.MultAddToTransposed(lhs[i_item], rhs_tr);
+        lhs[i_item] = res;
+    });
+}
+
+template <typename M, typename AllocL, typename AllocR>
+void BatchMultiply(std::vector<M, AllocL>& lhs, const std::vector<M, AllocR>& rhs, unsigned num_threads = 0)
+{
+    if (lhs.size() != rhs.size())
+    {
+        throw std::invalid_argument("Invalide batch sizes");
+    }
+
+    BatchMultiply(lhs.data(), rhs.data(), lhs.size(), num_threads);
+}
+
+} // namespace mxcmn
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+namespace mxcl
+{
+
+// Block layouts map (i_qrow, i_qcol) of a num_qrows x num_qcols block grid
+// to a position in the contiguous block buffer. GetRowIndexer(i_qrow) does the part
+// of the mapping shared by a block row once, its i_qcol -> position is cheap
+
+// Blocks of a row are neighbours, blocks of a column are num_qcols apart
+class RowMajorLayout
+{
+public:
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+
+    RowMajorLayout(SizeT, SizeT num_qcols) noexcept
+        : m_num_qcols{ num_qcols }
+    {}
+
+    inline PositionT GetIndex(PositionT i_qrow, PositionT i_qcol) const noexcept
+    {
+        return m_num_qcols * i_qrow + i_qcol;
+    }
+
+    struct RowIndexer
+    {
+        PositionT operator()(PositionT i_qcol) const noexcept { return i_begin + i_qcol; }
+
+        PositionT i_begin;
+    };
+
+    RowIndexer GetRowIndexer(PositionT i_qrow) const noexcept { return { m_num_qcols * i_qrow }; }
+
+private:
+    SizeT m_num_qcols;
+};
+
+// Z-order: every aligned 2^k x 2^k square of blocks is contiguous, so blocks used
+// together stay close at every cache and TLB level without knowing their sizes.
+// The grid need not be square or a power of two: the Morton codes of the existing
+// blocks are ranked, so the buffer has no holes.
+class MortonLayout
+{
+public:
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+
+    MortonLayout(SizeT num_qrows, SizeT num_qcols);
+
+    inline PositionT GetIndex(PositionT i_qrow, PositionT i_qcol) const noexcept
+    {
+        return m_rank[m_num_qcols * i_qrow + i_qcol];
+    }
+
+    // Ranks of the blocks of one row
+    struct RowIndexer
+    {
+        PositionT operator()(PositionT i_qcol) const noexcept { return ranks[i_qcol]; }
+
+        const PositionT* ranks;
+    };
+
+    RowIndexer GetRowIndexer(PositionT i_qrow) const noexcept { return { m_rank.data() + m_num_qcols * i_qrow }; }
+
+    // 0b abcd -> 0b 0a0b0c0d
+    static std::uint64_t SpreadBits(std::uint32_t value) noexcept;
+    static std::uint64_t GetMortonCode(PositionT i_qrow, PositionT i_qcol) noexcept;
+
+private:
+    SizeT m_num_qcols;
+    std::vector<PositionT> m_rank;
+};
+
+inline MortonLayout::MortonLayout(SizeT num_qrows, SizeT num_qcols)
+    : m_num_qcols{ num_qcols },
+      m_rank(num_qrows * num_qcols)
+{
+    std::vector<PositionT> order(m_rank.size());
+    std::iota(order.begin(), order.end(), PositionT{});
+
+    const auto get_code = [num_qcols](PositionT i_block) {
+        return GetMortonCode(i_block / num_qcols, i_block % num_qcols);
+    };
+    std::sort(order.begin(), order.end(), [&get_code](PositionT lhs, PositionT rhs) {
+        return get_code(lhs) < get_code(rhs);
+    });
+
+    for (PositionT i_pos = 0; i_pos < order.size(); ++i_pos)
+    {
+        m_rank[order[i_pos]] = i_pos;
+    }
+}
+
+inline std::uint64_t MortonLayout::SpreadBits(std::uint32_t value) noexcept
+{
+    std::uint64_t x = value;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+inline std::uint64_t MortonLayout::GetMortonCode(PositionT i_qrow, PositionT i_qcol) noexcept
+{
+    return (SpreadBits(i_qrow) << 1) | SpreadBits(i_qcol);
+}
+
+} // namespace mxcl
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "gemv.h"
+
+namespace mxcmn
+{
+
+// Products of chains A1 * A2 * ... * An with very different sizes. The cost of the chain
+// depends on the parenthesization only: (10x1000 * 1000x10) * 10x1000 needs 200 000
+// multiply-adds, 10x1000 * (1000x10 * 10x1000) needs 20 000 000.
+
+struct ChainOrder
+{
+    // Multiply-adds of the whole chain, FLOPs are twice as many
+    std::uint64_t num_fmas;
+    // splits[i][j] = s: the product of chain[i..j] is (chain[i..s]) * (chain[s + 1..j])
+    std::vector<std::vector<std::size_t>> splits;
+};
+
+// Classic O(n^3) dynamic programming over the sizes {num_rows, num_cols} of the chain
+inline ChainOrder CalcChainOrder(const std::vector<std::pair<SizeT, SizeT>>& sizes)
+{
+    const auto num_items = sizes.size();
+    if (num_items == 0)
+    {
+        throw std::invalid_argument("Empty chain");
+    }
+    for (std::size_t i_item = 1; i_item < num_items; ++i_item)
+    {
+        if (sizes[i_item - 1].second != sizes[i_item].first)
+        {
+            throw std::invalid_argument("Invalide mult sizes");
+        }
+    }
+
+    // Rows of item i are dims[i], cols are dims[i + 1]
+    std::vector<std::uint64_t> dims(num_items + 1);
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        dims[i_item] = sizes[i_item].first;
+    }
+    dims[num_items] = sizes.back().second;
+
+    std::vector<std::vector<std::uint64_t>> costs(num_items, std::vector<std::uint64_t>(num_items));
+    ChainOrder order{ 0, std::vector<std::vector<std::size_t>>(num_items, std::vector<std::size_t>(num_items)) };
+    for (std::size_t len = 2; len <= num_items; ++len)
+    {
+        for (std::size_t i = 0; i + len <= num_items; ++i)
+        {
+            const auto j = i + len - 1;
+            costs[i][j] = std::numeric_limits<std::uint64_t>::max();
+            for (std::size_t s = i; s < j; ++s)
+            {
+                const auto cost = costs[i][s] + costs[s + 1][j] + dims[i] * dims[s + 1] * dims[j + 1];
+                if (cost < costs[i][j])
+                {
+                    costs[i][j] = cost;
+                    order.splits[i][j] = s;
+                }
+            }
+        }
+    }
+
+    order.num_fmas = costs[0][num_items - 1];
+    return order;
+}
+
+template <typename M>
+using MatrixValueT = std::remove_cv_t<std::remove_reference_t<decltype(std::declval<const M&>()[0][0])>>;
+
+// out = lhs * rhs. Row-major engines run matrix-vector steps on the parallel GEMV:
+// a column on the right is contiguous, so is a row on the left (out^T = rhs^T * lhs^T)
+template <typename M>
+void MultiplyChainStep(const M& lhs, const M& rhs, M& out)
+{
+    using T = MatrixValueT<M>;
+
+    if constexpr (HasView<M>)
+    {
+        if (rhs.GetNumCols() == 1)
+        {
+            Gemv<T>(T{1}, lhs.GetView(), rhs.GetView().GetData(), T{0}, out.GetView().GetData());
+            return;
+        }
+        if (lhs.GetNumRows() == 1)
+        {
+            Gemv<T>(T{1}, rhs.GetView().Transposed(), lhs.GetView().GetData(), T{0}, out.GetView().GetData());
+            return;
+        }
+    }
+
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename M>
+M MultiplyChainRange(const std::vector<const M*>& chain, const ChainOrder& order, std::size_t i, std::size_t j)
+{
+    const auto s = order.splits[i][j];
+
+    // Single matrices of the chain are used in place, only partial products are stored
+    std::optional<M> lhs_tmp, rhs_tmp;
+    const M& lhs = s == i ? *chain[i] : lhs_tmp.emplace(MultiplyChainRange(chain, order, i, s));
+    const M& rhs = s + 1 == j ? *chain[j] : rhs_tmp.emplace(MultiplyChainRange(chain, order, s + 1, j));
+
+    M out{lhs.GetNumRows(), rhs.GetNumCols()};
+    MultiplyChainStep(lhs, rhs, out);
+    return out;
+}
+
+// chain[0] * chain[1] * ... * chain[n - 1] in the order with the fewest multiply-adds
+template <typename M>
+M MultiplyChain(const std::vector<const M*>& chain)
+{
+    std::vector<std::pair<SizeT, SizeT>> sizes;
+    sizes.reserve(chain.size());
+    for (const M* item : chain)
+    {
+        sizes.emplace_back(item->GetNumRows(), item->GetNumCols());
+    }
+
+    const auto order = CalcChainOrder(sizes);
+    if (chain.size() == 1)
+    {
+        return *chain.front();
+    }
+
+    return MultiplyChainRange(chain, order, 0, chain.size() - 1);
+}
+
+template <typename M, typename... Ms>
+M MultiplyChain(const M& first, const Ms&... rest)
+{
+    static_assert((std::is_same_v<M, Ms> && ...), "All matrices of a chain must have the same type");
+    return MultiplyChain(std::vector<const M*>{ &first, &rest... });
+}
+
+} // namespace mxcmn
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_view.h"
+#include "gemm_kernel.h"
+#include "gemv.h"
+#include "chain.h"
+
+namespace mxex
+{
+
+// Lazy matrix expressions evaluated in one pass over the output:
+//  mxex::Assign(d, mxex::Relu(2 * mxex::Lazy(a) * b + c));
+// An expression is a root - a product alpha * A * B or a scaled matrix factor * A -
+// followed by elementwise operations: add a matrix or a scalar, scale, add a bias to
+// every row, map. For a product of row-major engines (GetView()) the operations are the
+// epilogue of the packed mxgemm kernel: a tile goes through them when its last KC panel
+// is written, so out is written once and an added C is read once. Block engines (mxcl,
+// mxclpl) have no such write-back point: their Gemm computes the product and the
+// operations take one more pass.
+// An expression keeps pointers to its operands, assign it before they are gone.
+// out + ... right after a product is beta of Gemm; out must not be read elsewhere
+// by a product expression, it holds partial sums until the end.
+
+using PositionT = mxcmn::PositionT;
+using SizeT = mxcmn::SizeT;
+
+template <typename M, typename = void>
+constexpr bool IsMatrix = false;
+
+template <typename M>
+constexpr bool IsMatrix<M, std::void_t<decltype(std::declval<const M&>().GetNumRows()),
+                                       decltype(std::declval<const M&>()[0][0])>> = true;
+
+// Roots --------------------------------------------------------------------------------------------
+
+// factor * matrix
+template <typename M>
+struct MatrixRoot
+{
+    using ValueT = mxcmn::MatrixValueT<M>;
+
+    SizeT GetNumRows() const noexcept { return matrix->GetNumRows(); }
+    SizeT GetNumCols() const noexcept { return matrix->GetNumCols(); }
+    MatrixRoot Scaled(ValueT scale) const noexcept { return { factor * scale, matrix }; }
+
+    ValueT factor;
+    const M* matrix;
+};
+
+// alpha * lhs * rhs
+template <typename L, typename R>
+struct ProductRoot
+{
+    using ValueT = mxcmn::MatrixValueT<L>;
+
+    SizeT GetNumRows() const noexcept { return lhs->GetNumRows(); }
+    SizeT GetNumCols() const noexcept { return rhs->GetNumCols(); }
+    ProductRoot Scaled(ValueT scale) const noexcept { return { alpha * scale, lhs, rhs }; }
+
+    ValueT alpha;
+    const L* lhs;
+    const R* rhs;
+};
+
+// Elementwise operations: value -> op(i_row, i_col, value) ---------------------------------------
+
+template <typename T>
+struct ScaleOp
+{
+    T operator()(PositionT, PositionT, T value) const noexcept { return factor * value; }
+    bool Reads(const void*) const noexcept { return false; }
+
+    T factor;
+};
+
+template <typename T>
+struct AddScalarOp
+{
+    T operator()(PositionT, PositionT, T value) const noexcept { return value + addend; }
+    bool Reads(const void*) const noexcept { return false; }
+
+    T addend;
+};
+
+// bias[i_col] is added to every row
+template <typename T>
+struct AddBiasOp
+{
+    T operator()(PositionT, PositionT i_col, T value) const noexcept { return value + bias[i_col]; }
+    bool Reads(const void*) const noexcept { return false; }
+
+    const T* bias;
+};
+
+template <typename F>
+struct MapOp
+{
+    template <typename T>
+    T operator()(PositionT, PositionT, T value) const { return func(value); }
+    bool Reads(const void*) const noexcept { return false; }
+
+    F func;
+};
+
+// value + factor * matrix(i_row, i_col), row-major engines are read through their view
+template <typename M>
+struct AddMatrixOp
+{
+    using T = mxcmn::MatrixValueT<M>;
+
+    T operator()(PositionT i_row, PositionT i_col, T value) const
+    {
+        if constexpr (mxcmn::HasView<M>)
+        {
+            return value + factor * view(i_row, i_col);
+        }
+        else
+        {
+            return value + factor * (*matrix)[i_row][i_col];
+        }
+    }
+    bool Reads(const void* ptr) const noexcept { return ptr == matrix; }
+
+    T factor;
+    const M* matrix;
+    std::conditional_t<mxcmn::HasView<M>, mxcmn::MatrixView<const T>, const M*> view;
+};
+
+template <typename M>
+AddMatrixOp<M> MakeAddMatrixOp(mxcmn::MatrixValueT<M> factor, const M* matrix)
+{
+    if constexpr (mxcmn::HasView<M>)
+    {
+        return { factor, matrix, matrix->GetView() };
+    }
+    else
+    {
+        return { factor, matrix, matrix };
+    }
+}
+
+// Expr ---------------------------------------------------------------------------------------------
+
+template <typename Root, typename... Ops>
+class Expr
+{
+public:
+    using ValueT = typename Root::ValueT;
+
+    Expr(Root root, std::tuple<Ops...> ops)
+        : m_root{ root }, m_ops{ std::move(ops) }
+    {}
+
+    SizeT GetNumRows() const noexcept { return m_root.GetNumRows(); }
+    SizeT GetNumCols() const noexcept { return m_root.GetNumCols(); }
+    const Root& GetRoot() const noexcept { return m_root; }
+    const std::tuple<Ops...>& GetOps() const noexcept { return m_ops; }
+
+    template <typename Op>
+    Expr<Root, Ops..., Op> Append(Op op) const
+    {
+        return { m_root, std::tuple_cat(m_ops, std::make_tuple(std::move(op))) };
+    }
+
+    // A scale right after the root goes into its alpha (factor)
+    Expr Scaled(ValueT scale) const
+    {
+        static_assert(sizeof...(Ops) == 0, "Scale after operations is ScaleOp");
+        return { m_root.Scaled(scale), m_ops };
+    }
+
+private:
+    Root m_root;
+    std::tuple<Ops...> m_ops;
+};
+
+template <typename Root>
+constexpr bool IsMatrixRoot = false;
+
+template <typename M>
+constexpr bool IsMatrixRoot<MatrixRoot<M>> = true;
+
+template <typename E>
+constexpr bool IsExpr = false;
+
+template <typename Root, typename... Ops>
+constexpr bool IsExpr<Expr<Root, Ops...>> = true;
+
+// Applies the operations one after another
+template <typename T, typename... Ops>
+struct OpsEpilogue
+{
+    T operator()(PositionT i_row, PositionT i_col, T value) const
+    {
+        std::apply([&](const auto&... op) { ((value = op(i_row, i_col, value)), ...); }, *ops);
+        return value;
+    }
+
+    const std::tuple<Ops...>* ops;
+};
+
+template <typename First, typename... Rest>
+std::tuple<Rest...> GetTupleTail(const std::tuple<First, Rest...>& items)
+{
+    return std::apply([](const First&, const Rest&... rest) { return std::tuple<Rest...>{ rest... }; }, items);
+}
+
+// Building -----------------------------------------------------------------------------------------
+
+template <typename M>
+Expr<MatrixRoot<M>> Lazy(const M& matrix)
+{
+    return { { mxcmn::MatrixValueT<M>{1}, &matrix }, {} };
+}
+
+template <typename X>
+auto ToExpr(const X& item)
+{
+    if constexpr (IsExpr<X>)
+    {
+        return item;
+    }
+    else
+    {
+        static_assert(IsMatrix<X>, "Operand must be a matrix or an expression");
+        return Lazy(item);
+    }
+}
+
+// Only plain (scaled) matrices are multiplied, a product of a product is mxcmn::MultiplyChain
+template <typename L, typename R>
+Expr<ProductRoot<L, R>> operator*(const Expr<MatrixRoot<L>>& lhs, const Expr<MatrixRoot<R>>& rhs)
+{
+    const auto& lhs_root = lhs.GetRoot();
+    const auto& rhs_root = rhs.GetRoot();
+    if (lhs_root.GetNumCols() != rhs_root.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+
+    return { { lhs_root.factor * rhs_root.factor, lhs_root.matrix, rhs_root.matrix }, {} };
+}
+
+template <typename L, typename R, typename = std::enable_if_t<IsMatrix<R>>>
+auto operator*(const Expr<MatrixRoot<L>>& lhs, const R& rhs)
+{
+    return lhs * Lazy(rhs);
+}
+
+template <typename L, typename R, typename = std::enable_if_t<IsMatrix<L>>>
+auto operator*(const L& lhs, const Expr<MatrixRoot<R>>& rhs)
+{
+    return Lazy(lhs) * rhs;
+}
+
+template <typename Root, typename... Ops>
+auto operator*(mxcmn::NonDeducedT<typename Root::ValueT> scale, const Expr<Root, Ops...>& expr)
+{
+    if constexpr (sizeof...(Ops) == 0)
+    {
+        return expr.Scaled(scale);
+    }
+    else
+    {
+        return expr.Append(ScaleOp<typename Root::ValueT>{ scale });
+    }
+}
+
+template <typename Root, typename... Ops>
+auto operator*(const Expr<Root, Ops...>& expr, mxcmn::NonDeducedT<typename Root::ValueT> scale)
+{
+    return scale * expr;
+}
+
+// expr + factor * matrix
+template <typename Root, typename... Ops, typename X, typename = std::enable_if_t<IsMatrix<X> || IsExpr<X>>>
+auto operator+(const Expr<Root, Ops...>& expr, const X& term)
+{
+    const auto term_expr = ToExpr(term);
+    static_assert(IsMatrixRoot<std::decay_t<decltype(term_expr.GetRoot())>>,
+                  "Only one product per expression: for A * B + C * D assign C * D to out first, "
+                  "then out = A * B + out adds it as beta of Gemm");
+    static_assert(std::tuple_size_v<std::decay_t<decltype(term_expr.GetOps())>> == 0,
+                  "Only a scaled matrix is added to an expression");
+
+    const auto& term_root = term_expr.GetRoot();
+    if (term_root.GetNumRows() != expr.GetNumRows() || term_root.GetNumCols() != expr.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide operand size");
+    }
+
+    return expr.Append(MakeAddMatrixOp(term_root.factor, term_root.matrix));
+}
+
+template <typename Root, typename... Ops, typename M, typename = std::enable_if_t<IsMatrix<M>>>
+auto operator+(const M& term, const Expr<Root, Ops...>& expr)
+{
+    return expr + term;
+}
+
+template <typename Root, typename... Ops, typename X, typename = std::enable_if_t<IsMatrix<X> || IsExpr<X>>>
+auto operator-(const Expr<Root, Ops...>& expr, const X& term)
+{
+    return expr + typename Root::ValueT{-1} * ToExpr(term);
+}
+
+template <typename Root, typename... Ops>
+auto operator+(const Expr<Root, Ops...>& expr, mxcmn::NonDeducedT<typename Root::ValueT> addend)
+{
+    return expr.Append(AddScalarOp<typename Root::ValueT>{ addend });
+}
+
+template <typename Root, typename... Ops>
+auto operator-(const Expr<Root, Ops...>& expr, mxcmn::NonDeducedT<typename Root::ValueT> subtrahend)
+{
+    return expr + -subtrahend;
+}
+
+// bias has one value per column, it must live until the expression is assigned
+template <typename Root, typename... Ops, typename Alloc>
+auto AddBias(const Expr<Root, Ops...>& expr, const std::vector<typename Root::ValueT, Alloc>& bias)
+{
+    if (bias.size() != expr.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide bias size");
+    }
+
+    return expr.Append(AddBiasOp<typename Root::ValueT>{ bias.data() });
+}
+
+// func(value) for every element
+template <typename Root, typename... Ops, typename F>
+auto Map(const Expr<Root, Ops...>& expr, F func)
+{
+    return expr.Append(MapOp<F>{ std::move(func) });
+}
+
+template <typename Root, typename... Ops>
+auto Relu(const Expr<Root, Ops...>& expr)
+{
+    using T = typename Root::ValueT;
+    return Map(expr, [](T value) { return std::max(value, T{}); });
+}
+
+// Evaluation ---------------------------------------------------------------------------------------
+
+template <typename Out, typename L, typename R, typename... Ops>
+void AssignProduct(Out& out, const ProductRoot<L, R>& root, mxcmn::MatrixValueT<Out> beta,
+                   const std::tuple<Ops...>& ops, unsigned num_threads)
+{
+    using T = mxcmn::MatrixValueT<Out>;
+
+    const void* out_ptr = &out;
+    if (out_ptr == root.lhs || out_ptr == root.rhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+    const bool is_out_read = std::apply([out_ptr](const auto&... op) { return (op.Reads(out_ptr) || ...); }, ops);
+    if (is_out_read)
+    {
+        throw std::invalid_argument("out must not be read by the operations of a product");
+    }
+
+    const OpsEpilogue<T, Ops...> epilogue{ &ops };
+    constexpr bool has_ops = sizeof...(Ops) != 0;
+
+    if constexpr (mxcmn::HasView<L> && mxcmn::HasView<R> && mxcmn::HasView<Out>)
+    {
+        static_assert(std::is_same_v<T, mxcmn::MatrixValueT<L>> && std::is_same_v<T, mxcmn::MatrixValueT<R>>,
+                      "Operands must have one element type");
+
+        const auto lhs = root.lhs->GetView();
+        const auto rhs = root.rhs->GetView();
+        const auto res = out.GetView();
+        const auto K = lhs.GetNumCols(), N = rhs.GetNumCols();
+
+        // Threads share every packed panel of rhs and split the rows of out
+        const auto num_tasks = mxcmn::GetNumGemvTasks(res.GetNumRows(), std::size_t{ K } * N, num_threads);
+        const auto run = [&](const auto& epilogue_rc) {
+            mxgemm::kernel::GemmParallel<T>(num_tasks, res.GetNumRows(), N, K, root.alpha,
+                                            lhs.GetData(), lhs.GetRowStride(), lhs.GetColStride(),
+                                            rhs.GetData(), rhs.GetRowStride(), rhs.GetColStride(),
+                                            beta, res.GetData(), res.GetRowStride(), epilogue_rc);
+        };
+
+        if constexpr (has_ops)
+        {
+            run([&](std::size_t i_row, std::size_t i_col, T value) {
+                return epilogue(static_cast<PositionT>(i_row), static_cast<PositionT>(i_col), value);
+            });
+        }
+        else
+        {
+            run(mxgemm::kernel::NoEpilogue{});
+        }
+    }
+    else
+    {
+        static_assert(std::is_same_v<L, Out> && std::is_same_v<R, Out>,
+                      "Block engines need lhs, rhs and out of one type");
+
+        out.Gemm(root.alpha, *root.lhs, *root.rhs, beta);
+        if constexpr (has_ops)
+        {
+            for (PositionT i_row = 0; i_row < out.GetNumRows(); ++i_row)
+            {
+                for (PositionT i_col = 0; i_col < out.GetNumCols(); ++i_col)
+                {
+                    out[i_row][i_col] = epilogue(i_row, i_col, out[i_row][i_col]);
+                }
+            }
+        }
+    }
+}
+
+// out = expr, num_threads == 0 - one per hardware thread
+template <typename Out, typename Root, typename... Ops>
+void Assign(Out& out, const Expr<Root, Ops...>& expr, unsigned num_threads = 0)
+{
+    using T = mxcmn::MatrixValueT<Out>;
+
+    if (out.GetNumRows() != expr.GetNumRows() || out.GetNumCols() != expr.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    const auto& root = expr.GetRoot();
+    const auto& ops = expr.GetOps();
+    if constexpr (IsMatrixRoot<Root>)
+    {
+        // Elementwise only: every element is read before it is written, out may be anywhere
+        const OpsEpilogue<T, Ops...> epilogue{ &ops };
+        for (PositionT i_row = 0; i_row < out.GetNumRows(); ++i_row)
+        {
+            for (PositionT i_col = 0; i_col < out.GetNumCols(); ++i_col)
+            {
+                out[i_row][i_col] = epilogue(i_row, i_col, root.factor * (*root.matrix)[i_row][i_col]);
+            }
+        }
+    }
+    else
+    {
+        if constexpr (sizeof...(Ops) != 0)
+        {
+            const auto& first = std::get<0>(ops);
+            if constexpr (std::is_same_v<std::decay_t<decltype(first)>, AddMatrixOp<Out>>)
+            {
+                if (first.matrix == &out)
+                {
+                    AssignProduct(out, root, first.factor, GetTupleTail(ops), num_threads);
+                    return;
+                }
+            }
+        }
+
+        AssignProduct(out, root, T{}, ops, num_threads);
+    }
+}
+
+// New Out = expr
+template <typename Out, typename Root, typename... Ops>
+Out Eval(const Expr<Root, Ops...>& expr, unsigned num_threads = 0)
+{
+    Out out{ expr.GetNumRows(), expr.GetNumCols() };
+    Assign(out, expr, num_threads);
+    return out;
+}
+
+} // namespace mxex
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <stdexcept>
+#include <array>
+#include <cstddef>
+#include <ostream>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+
+#include "qmatrix.h"
+#include "matrix_cachelike.h"
+
+// Matrices with sizes known at compile time. Every loop is unrolled through index
+// sequences, so a 4 x 4 or 8 x 8 product has no loop counters and no index math left.
+// Everything is constexpr, at run time the double 4 x 4 and float 8 x 8 products go
+// through AVX2 (one row of rhs is one YMM register). double 8 x 8 needs 16 registers for
+// rhs alone, so it stays on the unrolled scalar code.
+//
+//  constexpr auto a = mxfx::FixedMatrix<double, 4, 4>::Identity();
+//  auto c = a * b;               // unrolled
+//  mxfx::MultAdd(c, a, b);       // c += a * b
+//  auto block = mxfx::LoadQBlock(mxcl_matrix, i_qrow, i_qcol);
+
+namespace mxfx
+{
+
+template <typename F, std::size_t... Is>
+constexpr void UnrollFor(F&& func, std::index_sequence<Is...>)
+{
+    (func(std::integral_constant<std::size_t, Is>{}), ...);
+}
+
+// func(integral_constant<0>{}), ..., func(integral_constant<N - 1>{})
+template <std::size_t N, typename F>
+constexpr void UnrollFor(F&& func)
+{
+    UnrollFor(func, std::make_index_sequence<N>{});
+}
+
+constexpr bool IsConstantEvaluated() noexcept
+{
+#if defined(__GNUC__)
+    return __builtin_is_constant_evaluated();
+#else
+    return true; // Can not tell, the AVX path is never taken
+#endif
+}
+
+template <typename T, std::size_t R, std::size_t C>
+struct FixedMatrix
+{
+    static_assert(R != 0 && C != 0, "Size must be above zero");
+
+    using value_type = T;
+
+    static constexpr std::size_t GetNumRows() noexcept { return R; }
+    static constexpr std::size_t GetNumCols() noexcept { return C; }
+
+    static constexpr FixedMatrix Filled(T value) noexcept;
+    static constexpr FixedMatrix Identity() noexcept;
+
+    constexpr T& operator()(std::size_t i_row, std::size_t i_col) noexcept { return m_buf[i_row][i_col]; }
+    constexpr const T& operator()(std::size_t i_row, std::size_t i_col) const noexcept
+    {
+        return m_buf[i_row][i_col];
+    }
+
+    constexpr std::array<T, C>& operator[](std::size_t i_row) noexcept { return m_buf[i_row]; }
+    constexpr const std::array<T, C>& operator[](std::size_t i_row) const noexcept { return m_buf[i_row]; }
+
+    constexpr void Fill(T value) noexcept;
+    constexpr FixedMatrix<T, C, R> Transpose() const noexcept;
+
+    constexpr FixedMatrix& operator+=(const FixedMatrix& other) noexcept;
+    constexpr FixedMatrix& operator-=(const FixedMatrix& other) noexcept;
+    constexpr FixedMatrix& operator*=(T factor) noexcept;
+
+    std::array<std::array<T, C>, R> m_buf;
+};
+
+// FixedMatrix implementation -----------------------------------------------------------------------
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> FixedMatrix<T, R, C>::Filled(T value) noexcept
+{
+    FixedMatrix res{};
+    res.Fill(value);
+    return res;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> FixedMatrix<T, R, C>::Identity() noexcept
+{
+    static_assert(R == C, "Identity matrix must be square");
+
+    FixedMatrix res{};
+    UnrollFor<R>([&](auto i) { res.m_buf[i][i] = T{ 1 }; });
+    return res;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr void FixedMatrix<T, R, C>::Fill(T value) noexcept
+{
+    UnrollFor<R * C>([&](auto i) { m_buf[i / C][i % C] = value; });
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, C, R> FixedMatrix<T, R, C>::Transpose() const noexcept
+{
+    FixedMatrix<T, C, R> res{};
+    UnrollFor<R * C>([&](auto i) { res.m_buf[i % C][i / C] = m_buf[i / C][i % C]; });
+    return res;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C>& FixedMatrix<T, R, C>::operator+=(const FixedMatrix& other) noexcept
+{
+    UnrollFor<R * C>([&](auto i) { m_buf[i / C][i % C] += other.m_buf[i / C][i % C]; });
+    return *this;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C>& FixedMatrix<T, R, C>::operator-=(const FixedMatrix& other) noexcept
+{
+    UnrollFor<R * C>([&](auto i) { m_buf[i / C][i % C] -= other.m_buf[i / C][i % C]; });
+    return *this;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C>& FixedMatrix<T, R, C>::operator*=(T factor) noexcept
+{
+    UnrollFor<R * C>([&](auto i) { m_buf[i / C][i % C] *= factor; });
+    return *this;
+}
+
+// Product ------------------------------------------------------------------------------------------
+
+namespace avx
+{
+
+// A row of rhs fills whole YMM registers, and rhs, the accumulators of a row of res and
+// the broadcast element of lhs fit into the 16 of them together, otherwise rhs spills
+template <typename T, std::size_t K, std::size_t C>
+constexpr bool HasMultAddKernel = QMX_HAS_AVX2_FMA && (std::is_same_v<T, double> || std::is_same_v<T, float>) &&
+                                  C % qmx::avx::VecLen<T> == 0 &&
+                                  K * (C / qmx::avx::VecLen<T>) + C / qmx::avx::VecLen<T> + 1 <= 16;
+
+#if QMX_HAS_AVX2_FMA
+
+template <typename T>
+struct VecOps;
+
+template <>
+struct VecOps<double>
+{
+    using Vec = __m256d;
+    static Vec Load(const double* ptr) noexcept { return _mm256_loadu_pd(ptr); }
+    static void Store(double* ptr, Vec vec) noexcept { _mm256_storeu_pd(ptr, vec); }
+    static Vec Broadcast(double value) noexcept { return _mm256_set1_pd(value); }
+    static Vec FMAdd(Vec a, Vec b, Vec c) noexcept { return _mm256_fmadd_pd(a, b, c); }
+};
+
+template <>
+struct VecOps<float>
+{
+    using Vec = __m256;
+    static Vec Load(const float* ptr) noexcept { return _mm256_loadu_ps(ptr); }
+    static void Store(float* ptr, Vec vec) noexcept { _mm256_storeu_ps(ptr, vec); }
+    static Vec Broadcast(float value) noexcept { return _mm256_set1_ps(value); }
+    static Vec FMAdd(Vec a, Vec b, Vec c) noexcept { return _mm256_fmadd_ps(a, b, c); }
+};
+
+// res += lhs * rhs: rhs stays in K * C / VecLen registers, every row of res is
+// a chain of FMAs with broadcast elements of lhs
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+inline void MultAdd(T* res, const T* lhs, const T* rhs) noexcept
+{
+    using Ops = VecOps<T>;
+    using Vec = typename Ops::Vec;
+    constexpr std::size_t VecLen = qmx::avx::VecLen<T>;
+    constexpr std::size_t NumVecs = C / VecLen;
+
+    Vec rhs_vecs[K * NumVecs];
+    UnrollFor<K * NumVecs>([&](auto i) { rhs_vecs[i] = Ops::Load(rhs + i * VecLen); });
+
+    Vec acc[NumVecs];
+    UnrollFor<R * K * NumVecs>([&](auto i) {
+        constexpr std::size_t i_row = i / (K * NumVecs), k = i / NumVecs % K, i_vec = i % NumVecs;
+        if constexpr (k == 0)
+        {
+            acc[i_vec] = Ops::Load(res + i_row * C + i_vec * VecLen);
+        }
+        acc[i_vec] = Ops::FMAdd(Ops::Broadcast(lhs[i_row * K + k]), rhs_vecs[k * NumVecs + i_vec], acc[i_vec]);
+        if constexpr (k == K - 1)
+        {
+            Ops::Store(res + i_row * C + i_vec * VecLen, acc[i_vec]);
+        }
+    });
+}
+
+#endif // QMX_HAS_AVX2_FMA
+
+} // namespace avx
+
+// Larger products are left to loops, unrolling them only bloats the code
+constexpr std::size_t MaxUnrolledMultAdds = 1024;
+
+// res += lhs * rhs
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+constexpr void MultAdd(FixedMatrix<T, R, C>& res, const FixedMatrix<T, R, K>& lhs,
+                       const FixedMatrix<T, K, C>& rhs) noexcept
+{
+#if QMX_HAS_AVX2_FMA
+    if constexpr (avx::HasMultAddKernel<T, K, C>)
+    {
+        if (!IsConstantEvaluated())
+        {
+            avx::MultAdd<T, R, K, C>(&res.m_buf[0][0], &lhs.m_buf[0][0], &rhs.m_buf[0][0]);
+            return;
+        }
+    }
+#endif
+
+    // A local copy: res may alias lhs or rhs, stores to it would reload them
+    FixedMatrix<T, R, C> acc = res;
+    if constexpr (R * K * C <= MaxUnrolledMultAdds)
+    {
+        UnrollFor<R * K * C>([&](auto i) {
+            constexpr std::size_t i_row = i / (K * C), k = i / C % K, i_col = i % C;
+            acc.m_buf[i_row][i_col] += lhs.m_buf[i_row][k] * rhs.m_buf[k][i_col];
+        });
+    }
+    else
+    {
+        for (std::size_t i_row = 0; i_row < R; ++i_row)
+        {
+            for (std::size_t k = 0; k < K; ++k)
+            {
+                const T lhs_value = lhs.m_buf[i_row][k];
+                for (std::size_t i_col = 0; i_col < C; ++i_col)
+                {
+                    acc.m_buf[i_row][i_col] += lhs_value * rhs.m_buf[k][i_col];
+                }
+            }
+        }
+    }
+    res = acc;
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+constexpr FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, K>& lhs, const FixedMatrix<T, K, C>& rhs) noexcept
+{
+    FixedMatrix<T, R, C> res{};
+    MultAdd(res, lhs, rhs);
+    return res;
+}
+
+// Elementwise operators ----------------------------------------------------------------------------
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> operator+(FixedMatrix<T, R, C> lhs, const FixedMatrix<T, R, C>& rhs) noexcept
+{
+    return lhs += rhs;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> operator-(FixedMatrix<T, R, C> lhs, const FixedMatrix<T, R, C>& rhs) noexcept
+{
+    return lhs -= rhs;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> operator*(FixedMatrix<T, R, C> matrix, mxcmn::NonDeducedT<T> factor) noexcept
+{
+    return matrix *= factor;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr FixedMatrix<T, R, C> operator*(mxcmn::NonDeducedT<T> factor, FixedMatrix<T, R, C> matrix) noexcept
+{
+    return matrix *= factor;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr bool operator==(const FixedMatrix<T, R, C>& lhs, const FixedMatrix<T, R, C>& rhs) noexcept
+{
+    bool is_equal = true;
+    UnrollFor<R * C>([&](auto i) { is_equal = is_equal && lhs.m_buf[i / C][i % C] == rhs.m_buf[i / C][i % C]; });
+    return is_equal;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+constexpr bool operator!=(const FixedMatrix<T, R, C>& lhs, const FixedMatrix<T, R, C>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+template <typename T, std::size_t R, std::size_t C>
+std::ostream& operator<<(std::ostream& os, const FixedMatrix<T, R, C>& matrix)
+{
+    for (std::size_t i_row = 0; i_row < R; ++i_row)
+    {
+        os << matrix.m_buf[i_row][0];
+        for (std::size_t i_col = 1; i_col < C; ++i_col)
+        {
+            os << ' ' << matrix.m_buf[i_row][i_col];
+        }
+        os << '\n';
+    }
+
+    return os;
+}
+
+// Blocks of mxcl -----------------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedMatrix<T, N, N> FromQMatrix(const qmx::QMatrix<T, N>& qmatrix) noexcept
+{
+    return { qmatrix.m_buf };
+}
+
+template <typename T, std::size_t N>
+constexpr qmx::QMatrix<T, N> ToQMatrix(const FixedMatrix<T, N, N>& matrix) noexcept
+{
+    return { matrix.m_buf };
+}
+
+// Block (i_qrow, i_qcol) of an mxcl matrix, the padding of edge blocks is zero
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+FixedMatrix<T, QSize, QSize> LoadQBlock(const mxcl::Matrix<T, QSize, Layout, Alloc>& matrix,
+                                        mxcmn::PositionT i_qrow, mxcmn::PositionT i_qcol)
+{
+    if (i_qrow >= matrix.GetNumQRows() || i_qcol >= matrix.GetNumQCols())
+    {
+        throw std::invalid_argument("Invalide block position");
+    }
+
+    return FromQMatrix(matrix.GetQMatrix(i_qrow, i_qcol));
+}
+
+// Writes block (i_qrow, i_qcol), the part of an edge block past the matrix is not written
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void StoreQBlock(mxcl::Matrix<T, QSize, Layout, Alloc>& matrix, mxcmn::PositionT i_qrow, mxcmn::PositionT i_qcol,
+                 const FixedMatrix<T, QSize, QSize>& block)
+{
+    if (i_qrow >= matrix.GetNumQRows() || i_qcol >= matrix.GetNumQCols())
+    {
+        throw std::invalid_argument("Invalide block position");
+    }
+
+    const std::size_t num_rows = std::min<std::size_t>(QSize, matrix.GetNumRows() - i_qrow * QSize);
+    const std::size_t num_cols = std::min<std::size_t>(QSize, matrix.GetNumCols() - i_qcol * QSize);
+
+    auto& qmatrix = matrix.GetQMatrix(i_qrow, i_qcol);
+    for (std::size_t i_row = 0; i_row < num_rows; ++i_row)
+    {
+        std::copy_n(block.m_buf[i_row].begin(), num_cols, qmatrix.m_buf[i_row].begin());
+    }
+}
+
+} // namespace mxfx
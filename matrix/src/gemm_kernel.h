@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+#include "qmatrix_avx.h"
+#include "thread_pool.h"
+#include "scratch.h"
+
+namespace mxgemm::kernel
+{
+
+// Blocking parameters of the Goto/BLIS loop nest:
+//  MR x NR - register tile of the micro-kernel
+//  KC x NR - packed B sliver, stays in L1
+//  MC x KC - packed A block, stays in L2
+//  KC x NC - packed B panel, stays in L3
+template <typename T, typename = void>
+struct BlockSizes
+{
+    static constexpr std::size_t MR = 4, NR = 4;
+    static constexpr std::size_t MC = 64, KC = 256, NC = 4096;
+};
+
+template <typename T>
+constexpr bool UseAvxKernel = QMX_HAS_AVX2_FMA && (std::is_same_v<T, float> || std::is_same_v<T, double>);
+
+template <typename T>
+struct BlockSizes<T, std::enable_if_t<UseAvxKernel<T>>>
+{
+    // 6 x 2 YMM accumulators + 2 B vectors + 1 broadcast A value
+    static constexpr std::size_t MR = 6, NR = 2 * (32 / sizeof(T));
+    static constexpr std::size_t MC = 72 * (8 / sizeof(T)), KC = 256, NC = 4096;
+};
+
+constexpr std::size_t RoundUp(std::size_t size, std::size_t step) noexcept
+{
+    return (size + step - 1) / step * step;
+}
+
+// Operands are read through (row stride, col stride), so transposed and strided
+// views are packed directly, packing is the only place that touches them
+
+// a: mc x kc -> MR-row slivers, k-major inside a sliver
+template <typename T>
+void PackA(const T* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a, std::size_t mc, std::size_t kc, T* pa) noexcept
+{
+    constexpr std::size_t MR = BlockSizes<T>::MR;
+
+    for (std::size_t ir = 0; ir < mc; ir += MR)
+    {
+        const std::size_t m_rem = std::min(MR, mc - ir);
+        for (std::size_t k = 0; k < kc; ++k)
+        {
+            for (std::size_t i = 0; i < MR; ++i)
+            {
+                *pa++ = i < m_rem ? a[(ir + i) * rs_a + k * cs_a] : T{};
+            }
+        }
+    }
+}
+
+// b: kc x nc -> NR-column slivers, k-major inside a sliver
+template <typename T>
+void PackB(const T* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b, std::size_t kc, std::size_t nc, T* pb) noexcept
+{
+    constexpr std::size_t NR = BlockSizes<T>::NR;
+
+    for (std::size_t jr = 0; jr < nc; jr += NR)
+    {
+        const std::size_t n_rem = std::min(NR, nc - jr);
+        for (std::size_t k = 0; k < kc; ++k)
+        {
+            const T* b_row = b + k * rs_b + jr * cs_b;
+            for (std::size_t j = 0; j < NR; ++j)
+            {
+                *pb++ = j < n_rem ? b_row[j * cs_b] : T{};
+            }
+        }
+    }
+}
+
+// Elementwise epilogue of the expressions in expr.h: the final value of c(i_row, i_col)
+// is replaced by epilogue(i_row, i_col, value) in the write-back of the last KC panel,
+// while the tile is still in L1. NoEpilogue compiles to the plain write-back
+struct NoEpilogue
+{};
+
+template <typename E>
+constexpr bool HasEpilogue = !std::is_same_v<E, NoEpilogue>;
+
+// Tile c[m_rem][n_rem] at (i_row, i_col) of the whole C goes through epilogue
+template <typename T, typename Epilogue>
+void ApplyEpilogue(T* c, std::size_t ldc, std::size_t m_rem, std::size_t n_rem, const Epilogue& epilogue,
+                   std::size_t i_row, std::size_t i_col)
+{
+    for (std::size_t i = 0; i < m_rem; ++i)
+    {
+        for (std::size_t j = 0; j < n_rem; ++j)
+        {
+            c[i * ldc + j] = epilogue(i_row + i, i_col + j, c[i * ldc + j]);
+        }
+    }
+}
+
+// c[MR][NR] = alpha * pa * pb + beta * c, c is not read when beta is zero
+template <typename T, typename Epilogue = NoEpilogue>
+void MicroKernel(std::size_t kc, const T* pa, const T* pb, T* c, std::size_t ldc, T alpha, T beta,
+                 const Epilogue& epilogue = {}, std::size_t i_row = 0, std::size_t i_col = 0)
+{
+    constexpr std::size_t MR = BlockSizes<T>::MR;
+    constexpr std::size_t NR = BlockSizes<T>::NR;
+
+#if QMX_HAS_AVX2_FMA
+    if constexpr (UseAvxKernel<T>)
+    {
+        using Ops = qmx::avx::VecOps<T>;
+        using Vec = typename Ops::Vec;
+        constexpr std::size_t VL = qmx::avx::VecLen<T>;
+        constexpr std::size_t NV = NR / VL;
+
+        Vec acc[MR][NV];
+        for (std::size_t i = 0; i < MR; ++i)
+        {
+            for (std::size_t v = 0; v < NV; ++v)
+            {
+                acc[i][v] = Ops::Zero();
+            }
+        }
+
+        for (std::size_t k = 0; k < kc; ++k, pa += MR, pb += NR)
+        {
+            Vec b[NV];
+            for (std::size_t v = 0; v < NV; ++v)
+            {
+                b[v] = Ops::Load(pb + v * VL);
+            }
+
+            for (std::size_t i = 0; i < MR; ++i)
+            {
+                const Vec a = Ops::Broadcast(pa + i);
+                for (std::size_t v = 0; v < NV; ++v)
+                {
+                    acc[i][v] = Ops::FMAdd(a, b[v], acc[i][v]);
+                }
+            }
+        }
+
+        const Vec alpha_v = Ops::Broadcast(&alpha);
+        const Vec beta_v = Ops::Broadcast(&beta);
+        for (std::size_t i = 0; i < MR; ++i)
+        {
+            for (std::size_t v = 0; v < NV; ++v)
+            {
+                T* c_ptr = c + i * ldc + v * VL;
+                const Vec res = Ops::Mul(alpha_v, acc[i][v]);
+                Ops::Store(c_ptr, beta == T{} ? res : Ops::FMAdd(beta_v, Ops::Load(c_ptr), res));
+            }
+        }
+
+        if constexpr (HasEpilogue<Epilogue>)
+        {
+            ApplyEpilogue(c, ldc, MR, NR, epilogue, i_row, i_col);
+        }
+        return;
+    }
+#endif
+
+    T acc[MR][NR]{};
+    for (std::size_t k = 0; k < kc; ++k, pa += MR, pb += NR)
+    {
+        for (std::size_t i = 0; i < MR; ++i)
+        {
+            for (std::size_t j = 0; j < NR; ++j)
+            {
+                acc[i][j] += pa[i] * pb[j];
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < MR; ++i)
+    {
+        for (std::size_t j = 0; j < NR; ++j)
+        {
+            T& c_value = c[i * ldc + j];
+            c_value = beta == T{} ? alpha * acc[i][j] : alpha * acc[i][j] + beta * c_value;
+            if constexpr (HasEpilogue<Epilogue>)
+            {
+                c_value = epilogue(i_row + i, i_col + j, c_value);
+            }
+        }
+    }
+}
+
+// Partial tile on the right or bottom edge of C
+template <typename T, typename Epilogue = NoEpilogue>
+void MicroKernelEdge(std::size_t kc, const T* pa, const T* pb, T* c, std::size_t ldc, T alpha, T beta,
+                     std::size_t m_rem, std::size_t n_rem, const Epilogue& epilogue = {},
+                     std::size_t i_row = 0, std::size_t i_col = 0)
+{
+    constexpr std::size_t MR = BlockSizes<T>::MR;
+    constexpr std::size_t NR = BlockSizes<T>::NR;
+
+    T tmp[MR * NR];
+    MicroKernel(kc, pa, pb, tmp, NR, alpha, T{0});
+
+    for (std::size_t i = 0; i < m_rem; ++i)
+    {
+        for (std::size_t j = 0; j < n_rem; ++j)
+        {
+            T& c_value = c[i * ldc + j];
+            c_value = beta == T{} ? tmp[i * NR + j] : tmp[i * NR + j] + beta * c_value;
+        }
+    }
+
+    if constexpr (HasEpilogue<Epilogue>)
+    {
+        ApplyEpilogue(c, ldc, m_rem, n_rem, epilogue, i_row, i_col);
+    }
+}
+
+// c is the block at (i_row, i_col) of the whole C
+template <typename T, typename Epilogue = NoEpilogue>
+void MacroKernel(std::size_t mc, std::size_t nc, std::size_t kc,
+                 const T* pa, const T* pb, T* c, std::size_t ldc, T alpha, T beta,
+                 const Epilogue& epilogue = {}, std::size_t i_row = 0, std::size_t i_col = 0)
+{
+    constexpr std::size_t MR = BlockSizes<T>::MR;
+    constexpr std::size_t NR = BlockSizes<T>::NR;
+
+    for (std::size_t jr = 0; jr < nc; jr += NR)
+    {
+        const std::size_t n_rem = std::min(NR, nc - jr);
+        const T* pb_sliver = pb + jr * kc;
+        for (std::size_t ir = 0; ir < mc; ir += MR)
+        {
+            const std::size_t m_rem = std::min(MR, mc - ir);
+            const T* pa_sliver = pa + ir * kc;
+            T* c_tile = c + ir * ldc + jr;
+
+            if (m_rem == MR && n_rem == NR)
+            {
+                MicroKernel(kc, pa_sliver, pb_sliver, c_tile, ldc, alpha, beta, epilogue, i_row + ir, i_col + jr);
+            }
+            else
+            {
+                MicroKernelEdge(kc, pa_sliver, pb_sliver, c_tile, ldc, alpha, beta, m_rem, n_rem,
+                                epilogue, i_row + ir, i_col + jr);
+            }
+        }
+    }
+}
+
+// Gemm on num_tasks tasks of the pool: the tasks pack every KC x NC panel of b together,
+// once for all of them, and then compute their own stripes of MR-aligned rows of c against it.
+// The panel of b lives in the Pack arena of the calling thread, every task packs its blocks
+// of a into the Tmp arena of the thread running it, see scratch.h
+template <typename T, typename Epilogue = NoEpilogue>
+void GemmParallel(unsigned num_tasks, std::size_t m, std::size_t n, std::size_t k, T alpha,
+                  const T* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+                  const T* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+                  T beta, T* c, std::size_t ldc, const Epilogue& epilogue = {})
+{
+    using BS = BlockSizes<T>;
+
+    if (m == 0 || n == 0)
+    {
+        return;
+    }
+
+    // No KC panel applies beta and the epilogue, c = epilogue(beta * c)
+    if (k == 0)
+    {
+        for (std::size_t i = 0; i < m; ++i)
+        {
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                c[i * ldc + j] = beta == T{0} ? T{0} : beta * c[i * ldc + j];
+            }
+        }
+        if constexpr (HasEpilogue<Epilogue>)
+        {
+            ApplyEpilogue(c, ldc, m, n, epilogue, 0, 0);
+        }
+        return;
+    }
+
+    num_tasks = static_cast<unsigned>(std::clamp<std::size_t>(num_tasks, 1, (m + BS::MR - 1) / BS::MR));
+    const std::size_t stripe = RoundUp((m + num_tasks - 1) / num_tasks, BS::MR);
+    const std::size_t pa_size = RoundUp(BS::MC, BS::MR) * BS::KC;
+
+    auto& pack_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Pack);
+    pack_arena.template Reserve<T>(RoundUp(std::min(BS::NC, n), BS::NR) * BS::KC);
+    T* pb = pack_arena.template Get<T>();
+
+    for (std::size_t jc = 0; jc < n; jc += BS::NC)
+    {
+        const std::size_t nc = std::min(BS::NC, n - jc);
+        const std::size_t num_slivers = (nc + BS::NR - 1) / BS::NR;
+        for (std::size_t pc = 0; pc < k; pc += BS::KC)
+        {
+            const std::size_t kc = std::min(BS::KC, k - pc);
+
+            mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+                const std::size_t i_begin = num_slivers * i_task / num_tasks * BS::NR;
+                const std::size_t i_end = std::min(num_slivers * (i_task + 1) / num_tasks * BS::NR, nc);
+                if (i_begin < i_end)
+                {
+                    PackB(b + pc * rs_b + (jc + i_begin) * cs_b, rs_b, cs_b, kc, i_end - i_begin,
+                          pb + i_begin * kc);
+                }
+            });
+
+            // beta is applied by the first KC panel, the following ones accumulate
+            const T beta_pc = pc == 0 ? beta : T{1};
+
+            mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+                auto& tmp_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Tmp);
+                tmp_arena.template Reserve<T>(pa_size);
+                T* pa_task = tmp_arena.template Get<T>();
+                const std::size_t i_row_end = std::min(stripe * (i_task + 1), m);
+                for (std::size_t ic = stripe * i_task; ic < i_row_end; ic += BS::MC)
+                {
+                    const std::size_t mc = std::min(BS::MC, i_row_end - ic);
+                    PackA(a + ic * rs_a + pc * cs_a, rs_a, cs_a, mc, kc, pa_task);
+
+                    T* c_block = c + ic * ldc + jc;
+                    if (pc + kc < k)
+                    {
+                        MacroKernel(mc, nc, kc, pa_task, pb, c_block, ldc, alpha, beta_pc);
+                    }
+                    else
+                    {
+                        MacroKernel(mc, nc, kc, pa_task, pb, c_block, ldc, alpha, beta_pc, epilogue, ic, jc);
+                    }
+                }
+            });
+        }
+    }
+}
+
+// c (m x n) = epilogue(alpha * a (m x k) * b (k x n) + beta * c),
+// a and b with (row, col) strides, c row-major with leading dimension ldc
+template <typename T, typename Epilogue = NoEpilogue>
+void Gemm(std::size_t m, std::size_t n, std::size_t k, T alpha,
+          const T* a, std::ptrdiff_t rs_a, std::ptrdiff_t cs_a,
+          const T* b, std::ptrdiff_t rs_b, std::ptrdiff_t cs_b,
+          T beta, T* c, std::size_t ldc, const Epilogue& epilogue = {})
+{
+    // One task runs inline on the calling thread
+    GemmParallel(1, m, n, k, alpha, a, rs_a, cs_a, b, rs_b, cs_b, beta, c, ldc, epilogue);
+}
+
+} // namespace mxgemm::kernel
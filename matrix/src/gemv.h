@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <thread>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_view.h"
+#include "matrix_cachelike.h"
+#include "thread_pool.h"
+
+namespace mxcmn
+{
+
+// y = alpha * A * x + beta * y, y is not read when beta is zero.
+// GEMV touches every element of A once, so it is bound by memory bandwidth: rows of y
+// are split between the pool workers and A is streamed in the order it is stored.
+// num_threads == 0 - one per hardware thread
+
+// Row-major engines (mxnv, mxtr, mxnvpl, mxgemm) provide GetView(), block ones do not
+template <typename M, typename = void>
+constexpr bool HasView = false;
+
+template <typename M>
+constexpr bool HasView<M, std::void_t<decltype(std::declval<const M&>().GetView())>> = true;
+
+// Number of threads for num_items items of item_size elements of A: at most num_threads and
+// at least GemvMinTaskSize elements per thread, small products stay on one thread
+inline SizeT GetNumGemvTasks(SizeT num_items, std::size_t item_size, unsigned num_threads)
+{
+    constexpr std::size_t GemvMinTaskSize = std::size_t{ 1 } << 15;
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    const auto max_num_tasks = std::max<std::size_t>(1, num_items * item_size / GemvMinTaskSize);
+    return static_cast<SizeT>(std::min<std::size_t>({ num_threads, max_num_tasks, num_items }));
+}
+
+// Calls func(i_begin, i_end) for stripes of [0, num_items), one per GetNumGemvTasks thread
+template <typename F>
+void GemvFor(SizeT num_items, std::size_t item_size, unsigned num_threads, F&& func)
+{
+    const auto num_tasks = GetNumGemvTasks(num_items, item_size, num_threads);
+    const SizeT step = num_items / num_tasks + (num_items % num_tasks != 0);
+    ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+        const PositionT i_begin = i_task * step;
+        func(i_begin, std::min(i_begin + step, num_items));
+    });
+}
+
+// Row-major A: four rows at once share every load of x. A transposed view (rows of A
+// are its columns) is streamed column by column into the stripe of y instead
+template <typename T>
+void Gemv(NonDeducedT<T> alpha, NonDeducedT<MatrixView<const T>> a, const T* x, NonDeducedT<T> beta, T* y,
+          unsigned num_threads = 0)
+{
+    const auto M = a.GetNumRows(), K = a.GetNumCols();
+    if (a.GetRowStride() == 1 && a.GetColStride() != 1)
+    {
+        GemvFor(M, K, num_threads, [&](PositionT i_row_begin, PositionT i_row_end) {
+            for (PositionT i_row = i_row_begin; i_row < i_row_end; ++i_row)
+            {
+                y[i_row] = beta == T{} ? T{} : beta * y[i_row];
+            }
+
+            for (PositionT k = 0; k < K; ++k)
+            {
+                const T x_value = alpha * x[k];
+                const T* col = &a(0, k);
+                for (PositionT i_row = i_row_begin; i_row < i_row_end; ++i_row)
+                {
+                    y[i_row] += x_value * col[i_row];
+                }
+            }
+        });
+        return;
+    }
+
+    GemvFor(M, K, num_threads, [&](PositionT i_row_begin, PositionT i_row_end) {
+        PositionT i_row = i_row_begin;
+        if (a.GetColStride() == 1)
+        {
+            for (; i_row + 4 <= i_row_end; i_row += 4)
+            {
+                const T* row_0 = a.GetRowPtr(i_row);
+                const T* row_1 = a.GetRowPtr(i_row + 1);
+                const T* row_2 = a.GetRowPtr(i_row + 2);
+                const T* row_3 = a.GetRowPtr(i_row + 3);
+
+                T value_0{}, value_1{}, value_2{}, value_3{};
+                for (PositionT k = 0; k < K; ++k)
+                {
+                    const T x_value = x[k];
+                    value_0 += row_0[k] * x_value;
+                    value_1 += row_1[k] * x_value;
+                    value_2 += row_2[k] * x_value;
+                    value_3 += row_3[k] * x_value;
+                }
+
+                StoreScaled(y[i_row], value_0, alpha, beta);
+                StoreScaled(y[i_row + 1], value_1, alpha, beta);
+                StoreScaled(y[i_row + 2], value_2, alpha, beta);
+                StoreScaled(y[i_row + 3], value_3, alpha, beta);
+            }
+        }
+
+        for (; i_row < i_row_end; ++i_row)
+        {
+            T value{};
+            for (PositionT k = 0; k < K; ++k)
+            {
+                value += a(i_row, k) * x[k];
+            }
+            StoreScaled(y[i_row], value, alpha, beta);
+        }
+    });
+}
+
+// Block A: workers take whole block rows, the rows of a block row are summed in a
+// QSize accumulator while its blocks are read one after another
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Gemv(NonDeducedT<T> alpha, const mxcl::Matrix<T, QSize, Layout, Alloc>& a, const T* x, NonDeducedT<T> beta,
+          T* y, unsigned num_threads = 0)
+{
+    const auto M = a.GetNumRows(), K = a.GetNumCols();
+    GemvFor(a.GetNumQRows(), std::size_t{ QSize } * K, num_threads, [&](PositionT i_qrow_begin, PositionT i_qrow_end) {
+        for (PositionT i_qrow = i_qrow_begin; i_qrow < i_qrow_end; ++i_qrow)
+        {
+            const PositionT i_row_begin = i_qrow * QSize;
+            const auto num_rows = std::min<SizeT>(QSize, M - i_row_begin);
+
+            std::array<T, QSize> values{};
+            for (PositionT i_qcol = 0; i_qcol < a.GetNumQCols(); ++i_qcol)
+            {
+                const auto& qm = a.GetQMatrix(i_qrow, i_qcol);
+                const T* x_block = x + i_qcol * QSize;
+                const auto num_cols = std::min<SizeT>(QSize, K - i_qcol * QSize);
+                for (PositionT i_row = 0; i_row < num_rows; ++i_row)
+                {
+                    T value{};
+                    for (PositionT i_col = 0; i_col < num_cols; ++i_col)
+                    {
+                        value += qm.m_buf[i_row][i_col] * x_block[i_col];
+                    }
+                    values[i_row] += value;
+                }
+            }
+
+            for (PositionT i_row = 0; i_row < num_rows; ++i_row)
+            {
+                StoreScaled(y[i_row_begin + i_row], values[i_row], alpha, beta);
+            }
+        }
+    });
+}
+
+template <typename M, typename T, typename AllocX, typename AllocY>
+void Gemv(NonDeducedT<T> alpha, const M& a, const std::vector<T, AllocX>& x, NonDeducedT<T> beta,
+          std::vector<T, AllocY>& y, unsigned num_threads = 0)
+{
+    if (x.size() != a.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (y.size() != a.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    if constexpr (HasView<M>)
+    {
+        Gemv<T>(alpha, a.GetView(), x.data(), beta, y.data(), num_threads);
+    }
+    else
+    {
+        Gemv(alpha, a, x.data(), beta, y.data(), num_threads);
+    }
+}
+
+} // namespace mxcmn
@@ -10,7 +10,8 @@
 */
 
 template <typename ValueT>
-void TimeSizeForNativeAndCacheLike(std::vector<std::pair<unsigned, unsigned>>& test_conf)
+void TimeSizeForNativeAndCacheLike(std::vector<std::pair<unsigned, unsigned>>& test_conf,
+                                   bench::BenchRunner& runner)
 {
     using MatrixNative = mxnv::Matrix<ValueT>;
     using MatrixCacheLike = mxcl::Matrix<ValueT, 64>;
@@ -24,22 +25,25 @@ void TimeSizeForNativeAndCacheLike(std::vector<std::pair<unsigned, unsigned>>& t
     }
 
     PerfTest perf_test{test_conf};
-    perf_test.Run<MatrixNative>(fs_native);
-    perf_test.Run<MatrixCacheLike>(fs_cachelike);
+    perf_test.SetRunner(&runner);
+    perf_test.Run<MatrixNative>(fs_native, "native");
+    perf_test.Run<MatrixCacheLike>(fs_cachelike, "cachelike");
 }
 
 #define TIME_SIZE
 #define TIME_NUM_THREADS
+#define PERF_COUNTERS
 
 template <typename ValueT>
 void TimeNumThreadsForNativeAndCacheLike(int num_threads_min, int num_threads_max,
-                                         unsigned num_cols, unsigned num_repeats)
+                                         unsigned num_cols, unsigned num_repeats,
+                                         bench::BenchRunner& runner, const std::string& suffix = "")
 {
     using MatrixNative = mxnvpl::Matrix<ValueT>;
     using MatrixCacheLike = mxclpl::Matrix<ValueT, 64>;
 
-    std::fstream fs_native{"time_native_parallel", std::ios::out};
-    std::fstream fs_cachelike{"time_cachelike_parallel", std::ios::out};
+    std::fstream fs_native{"time_native_parallel" + suffix, std::ios::out};
+    std::fstream fs_cachelike{"time_cachelike_parallel" + suffix, std::ios::out};
 
     if (fs_native.bad() || fs_cachelike.bad())
     {
@@ -47,12 +51,44 @@ void TimeNumThreadsForNativeAndCacheLike(int num_threads_min, int num_threads_ma
     }
 
     PerfTestMultiThreads perf_test{num_threads_min, num_threads_max, num_cols, num_repeats};
-    perf_test.Run<MatrixNative>(fs_native);
-    perf_test.Run<MatrixCacheLike>(fs_cachelike);
+    perf_test.SetRunner(&runner);
+    perf_test.Run<MatrixNative>(fs_native, "native_parallel" + suffix);
+    perf_test.Run<MatrixCacheLike>(fs_cachelike, "cachelike_parallel" + suffix);
 }
 
-int main()
+// perf.csv and perf.json: time, hardware counters, GFLOP/s and memory bandwidth of every run,
+// scripts/plot.py draws the roofline from perf.csv
+template <typename ValueT>
+void PerfCountersForAll(std::vector<std::pair<unsigned, unsigned>>& test_conf,
+                        int num_threads_min, int num_threads_max, unsigned num_cols, unsigned num_repeats)
+{
+    PerfReport report;
+
+    PerfTest perf_test{test_conf};
+    perf_test.Run<mxnv::Matrix<ValueT>>(report, "native");
+    perf_test.Run<mxcl::Matrix<ValueT, 64>>(report, "cachelike");
+    perf_test.Run<mxgemm::Matrix<ValueT>>(report, "gemm");
+
+    PerfTestMultiThreads perf_test_threads{num_threads_min, num_threads_max, num_cols, num_repeats};
+    perf_test_threads.Run<mxnvpl::Matrix<ValueT>>(report, "native_parallel");
+    perf_test_threads.Run<mxclpl::Matrix<ValueT, 64>>(report, "cachelike_parallel");
+
+    std::fstream fs_csv{"perf.csv", std::ios::out}, fs_json{"perf.json", std::ios::out};
+    if (fs_csv.bad() || fs_json.bad())
+    {
+        throw std::runtime_error("fstream");
+    }
+
+    report.WriteCsv(fs_csv);
+    report.WriteJson(fs_json);
+}
+
+// graphics [--save-baseline <path>] [--baseline <path>]: the medians of TIME_SIZE and TIME_NUM_THREADS
+// are kept or compared with the kept ones, the exit code is non-zero when some of them regressed
+int main(int argc, char* argv[])
 {
+    const auto baseline_args = bench::ParseBaselineArgs(argc, argv);
+    bench::BenchRunner runner;
     using ValueT = double;
 
 #ifdef TIME_SIZE
@@ -74,10 +110,24 @@ int main()
         { 24 * 64, 1 },
         { 25 * 64, 1 }
     };
-    TimeSizeForNativeAndCacheLike<ValueT>(test_conf);
+    TimeSizeForNativeAndCacheLike<ValueT>(test_conf, runner);
 #endif
 
 #ifdef TIME_NUM_THREADS
-    TimeNumThreadsForNativeAndCacheLike<ValueT>(1, 8, 24 * 64, 3);
+    TimeNumThreadsForNativeAndCacheLike<ValueT>(1, 8, 24 * 64, 3, runner);
+    // Small matrices, where starting threads per multiply used to eat the speed-up
+    TimeNumThreadsForNativeAndCacheLike<ValueT>(1, 8, 4 * 64, 50, runner, "_small");
 #endif
+
+#ifdef PERF_COUNTERS
+    std::vector<std::pair<unsigned, unsigned>> perf_conf = {
+        { 4 * 64, 20 },
+        { 8 * 64, 5 },
+        { 16 * 64, 2 },
+        { 24 * 64, 1 }
+    };
+    PerfCountersForAll<ValueT>(perf_conf, 1, 8, 24 * 64, 3);
+#endif
+
+    return baseline_args.Apply(runner) > 0;
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
 #include "matrix.h"
 #include "perf_test.h"
+#include "autotune.h"
 
 template <typename ValueT>
-void VsAll(const std::vector<std::pair<unsigned, unsigned>>& test_conf)
+void VsAll(const std::vector<std::pair<unsigned, unsigned>>& test_conf, bench::BenchRunner& runner)
 {
     // Print test conf
     std::ios_base::sync_with_stdio(false);
@@ -17,26 +18,31 @@ void VsAll(const std::vector<std::pair<unsigned, unsigned>>& test_conf)
 
     // Run tests
     PerfTest perf_test {test_conf};
+    perf_test.SetRunner(&runner);
     std::vector<std::vector<double>> test_times;
 
     std::cout << "native:" << std::endl;
-    test_times.push_back(perf_test.Run<mxnv::Matrix<ValueT>>());
+    test_times.push_back(perf_test.Run<mxnv::Matrix<ValueT>>(std::cout, "native"));
     std::cout << std::endl;
 
     std::cout << "native transpose:" << std::endl;
-    test_times.push_back(perf_test.Run<mxtr::Matrix<ValueT>>());
+    test_times.push_back(perf_test.Run<mxtr::Matrix<ValueT>>(std::cout, "transpose"));
     std::cout << std::endl;
 
     std::cout << "cache like:" << std::endl;
-    test_times.push_back(perf_test.Run<mxcl::Matrix<ValueT, 64>>());
+    test_times.push_back(perf_test.Run<mxcl::Matrix<ValueT, 64>>(std::cout, "cachelike"));
     std::cout << std::endl;
 
     std::cout << "native parallel:" << std::endl;
-    test_times.push_back(perf_test.Run<mxnvpl::Matrix<ValueT>>());
+    test_times.push_back(perf_test.Run<mxnvpl::Matrix<ValueT>>(std::cout, "native_parallel"));
     std::cout << std::endl;
 
     std::cout << "cache like parallel:" << std::endl;
-    test_times.push_back(perf_test.Run<mxclpl::Matrix<ValueT, 64>>());
+    test_times.push_back(perf_test.Run<mxclpl::Matrix<ValueT, 64>>(std::cout, "cachelike_parallel"));
+    std::cout << std::endl;
+
+    std::cout << "packed gemm:" << std::endl;
+    test_times.push_back(perf_test.Run<mxgemm::Matrix<ValueT>>(std::cout, "gemm"));
     std::cout << std::endl;
 
     // Analyze results
@@ -58,8 +64,56 @@ void VsAll(const std::vector<std::pair<unsigned, unsigned>>& test_conf)
     }
 }
 
-int main()
+template <typename ValueT>
+void VsBlockLayouts(const std::vector<std::pair<unsigned, unsigned>>& test_conf)
 {
+    PerfTest perf_test {test_conf};
+
+    std::cout << "cache like, row-major vs morton blocks:" << std::endl;
+    perf_test.RunVs<mxcl::Matrix<ValueT, 64>, mxcl::Matrix<ValueT, 64, mxcl::MortonLayout>>();
+    std::cout << std::endl;
+
+    std::cout << "cache like 32, row-major vs morton blocks:" << std::endl;
+    perf_test.RunVs<mxcl::Matrix<ValueT, 32>, mxcl::Matrix<ValueT, 32, mxcl::MortonLayout>>();
+    std::cout << std::endl;
+}
+
+// Thousands of small independent products: one by one vs mxcmn::BatchMultiply
+template <typename ValueT>
+void VsBatch()
+{
+    const std::size_t num_products = 4096;
+    std::cout << "small products, ms per product: one by one, batch, speed-up" << std::endl;
+    for (unsigned size : {16, 32, 64, 128})
+    {
+        mxcl::Matrix<ValueT, 16> a{ size, size }, b{ size, size };
+        const double time_seq = RunPerfTest(a, b, num_products);
+        const double time_batch = RunBatchPerfTest(a, b, num_products);
+        std::cout << std::setw(5) << size << ' ' << time_seq << ' ' << time_batch << ' '
+                  << time_seq / time_batch << std::endl;
+    }
+}
+
+// Winners of the autotuner for square products: num_cols engine qsize num_threads time
+template <typename ValueT>
+void Autotune(const std::vector<std::pair<unsigned, unsigned>>& test_conf)
+{
+    mxat::Autotuner<ValueT> tuner;
+    for (const auto& [num_cols, num_repeats] : test_conf)
+    {
+        const auto best = tuner.GetBest(num_cols, num_cols, num_cols);
+        std::cout << std::setw(5) << num_cols << ' ' << mxat::GetEngineName(best.config.engine) << ' '
+                  << best.config.qsize << ' ' << best.config.num_threads << ' ' << best.time << std::endl;
+    }
+}
+
+// matrix [--save-baseline <path>] [--baseline <path>]: the medians of VsAll are kept or compared
+// with the kept ones, the exit code is non-zero when some of them regressed
+int main(int argc, char* argv[])
+{
+    const auto baseline_args = bench::ParseBaselineArgs(argc, argv);
+    bench::BenchRunner runner;
+
     // { num_cols, num_test_repeats }
     std::vector<std::pair<unsigned, unsigned>> test_conf = {
         { 20 * 64, 2 },
@@ -71,10 +125,19 @@ int main()
     using ValueT = double;
 
 #if 1
-    VsAll<ValueT>(test_conf);
+    VsAll<ValueT>(test_conf, runner);
+#elif 0
+    VsBlockLayouts<ValueT>(test_conf);
+#elif 0
+    VsBatch<ValueT>();
+#elif 0
+    Autotune<ValueT>(test_conf);
 #else
     PerfTest perf_test {test_conf};
-    auto time = perf_test.Run<mxclpl::Matrix<ValueT, 64>>();
+    perf_test.SetRunner(&runner);
+    auto time = perf_test.Run<mxclpl::Matrix<ValueT, 64>>(std::cout, "cachelike_parallel");
     // auto time = perf_test.Run<mxtr::Matrix<ValueT>>();
 #endif
+
+    return baseline_args.Apply(runner) > 0;
 }
\ No newline at end of file
@@ -0,0 +1,582 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "qmatrix.h"
+#include "matrix_cachelike.h"
+#include "batch.h"
+
+namespace mxcl
+{
+
+// Binary block file of an mxcl grid, mapped into memory with mmap:
+//  [0, DataOffset)  MappedHeader, the rest of the page is zero
+//  [DataOffset, ..) num_qrows x num_qcols QMatrix blocks, row-major grid, edges zero padded
+// The blocks are used in place, so reading a matrix is page faults, not parsing.
+
+struct MappedHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    // sizeof(T) and 'f' / 'i' / 'u', a file of doubles is not opened as int64_t
+    std::uint32_t value_size;
+    std::uint32_t value_kind;
+    std::uint32_t qsize;
+    std::uint64_t num_rows, num_cols;
+};
+
+template <typename T, std::size_t QSize>
+class MappedMatrix
+{
+public:
+    using QMatrix = qmx::QMatrix<T, QSize>;
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+
+    static_assert(std::is_trivially_copyable_v<QMatrix>, "Blocks are stored as raw bytes");
+
+    static constexpr char Magic[8] = { 'M', 'X', 'C', 'L', 'Q', 'G', 'R', 'D' };
+    static constexpr std::uint32_t Version = 1;
+    static constexpr std::size_t DataOffset = 4096;
+
+    class ProxyRow
+    {
+    public:
+        ProxyRow(PositionT i_row, PositionT i_qrow, MappedMatrix* matrix) noexcept;
+        T& operator[](PositionT col) const noexcept;
+
+    private:
+        PositionT m_i_row, m_i_qrow;
+        MappedMatrix* m_matrix;
+    };
+
+    class ProxyRowConst
+    {
+    public:
+        ProxyRowConst(PositionT i_row, PositionT i_qrow, const MappedMatrix* matrix) noexcept;
+        const T& operator[](PositionT col) const noexcept;
+
+    private:
+        PositionT m_i_row, m_i_qrow;
+        const MappedMatrix* m_matrix;
+    };
+
+    // New zero file of num_rows x num_cols, mapped for writing
+    static MappedMatrix Create(const std::string& path, SizeT num_rows, SizeT num_cols);
+    // New file with the values of matrix
+    template <typename Layout, typename Alloc>
+    static MappedMatrix Create(const std::string& path, const Matrix<T, QSize, Layout, Alloc>& matrix);
+    // Blocks of a file opened without writable must not be changed: the non-const
+    // operator[] and GetQMatrix throw std::logic_error for it
+    static MappedMatrix Open(const std::string& path, bool writable = false);
+
+    MappedMatrix(MappedMatrix&& other) noexcept;
+    MappedMatrix& operator=(MappedMatrix&& other) noexcept;
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+    ~MappedMatrix();
+
+    ProxyRow operator[](PositionT row);
+    ProxyRowConst operator[](PositionT row) const noexcept;
+
+    inline bool IsWritable() const noexcept { return m_is_writable; }
+    inline SizeT GetNumCols() const noexcept { return m_num_cols; }
+    inline SizeT GetNumRows() const noexcept { return m_num_rows; }
+    inline SizeT GetNumQCols() const noexcept { return m_num_qcols; }
+    inline SizeT GetNumQRows() const noexcept { return m_num_qrows; }
+    const QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept;
+    QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol);
+
+    template <typename Layout, typename Alloc>
+    void CopyTo(Matrix<T, QSize, Layout, Alloc>& matrix) const;
+
+    // Asynchronous read-ahead of blocks [i_qcol_begin, i_qcol_end) of block rows
+    // [i_qrow_begin, i_qrow_end), returns at once
+    void Prefetch(PositionT i_qrow_begin, PositionT i_qrow_end, PositionT i_qcol_begin, PositionT i_qcol_end) const noexcept;
+    void Prefetch(PositionT i_qrow_begin, PositionT i_qrow_end) const noexcept;
+    // Unmaps pages of block rows [i_qrow_begin, i_qrow_end) from the process, the page
+    // cache keeps or drops them by memory pressure. Written blocks are not lost
+    void Evict(PositionT i_qrow_begin, PositionT i_qrow_end) const noexcept;
+    // Writes changed blocks to the file
+    void Flush();
+
+private:
+    MappedMatrix(int fd, void* map, std::size_t map_size, bool is_writable, SizeT num_rows, SizeT num_cols) noexcept;
+
+    static MappedHeader MakeHeader(SizeT num_rows, SizeT num_cols) noexcept;
+    static SizeT CalcQNumFromNum(SizeT size) noexcept;
+    static std::size_t CalcFileSize(SizeT num_rows, SizeT num_cols) noexcept;
+
+    // madvise on pages of blocks [i_block_begin, i_block_end) in file order
+    void Advise(std::size_t i_block_begin, std::size_t i_block_end, int advice) const noexcept;
+    void Unmap() noexcept;
+    void CheckWritable() const;
+    // GetQMatrix without CheckWritable, for callers that have checked it
+    QMatrix& GetQMatrixUnchecked(PositionT i_qrow, PositionT i_qcol) noexcept;
+
+private:
+    int m_fd;
+    void* m_map;
+    std::size_t m_map_size;
+    bool m_is_writable;
+    SizeT m_num_rows, m_num_cols;
+    SizeT m_num_qrows, m_num_qcols;
+    QMatrix* m_qbuf;
+};
+
+// ProxyRow implementation ------------------------------------------------------------------------
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>::ProxyRow::ProxyRow(PositionT i_row, PositionT i_qrow, MappedMatrix* matrix) noexcept
+    : m_i_row{ i_row }, m_i_qrow{ i_qrow }, m_matrix{ matrix }
+{}
+
+template <typename T, std::size_t QSize>
+T& MappedMatrix<T, QSize>::ProxyRow::operator[](PositionT col) const noexcept
+{
+    return m_matrix->GetQMatrixUnchecked(m_i_qrow, col / QSize).m_buf[m_i_row][col % QSize];
+}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>::ProxyRowConst::ProxyRowConst(PositionT i_row, PositionT i_qrow,
+                                                     const MappedMatrix* matrix) noexcept
+    : m_i_row{ i_row }, m_i_qrow{ i_qrow }, m_matrix{ matrix }
+{}
+
+template <typename T, std::size_t QSize>
+const T& MappedMatrix<T, QSize>::ProxyRowConst::operator[](PositionT col) const noexcept
+{
+    return m_matrix->GetQMatrix(m_i_qrow, col / QSize).m_buf[m_i_row][col % QSize];
+}
+
+// MappedMatrix implementation --------------------------------------------------------------------
+
+template <typename T, std::size_t QSize>
+typename MappedMatrix<T, QSize>::SizeT MappedMatrix<T, QSize>::CalcQNumFromNum(SizeT size) noexcept
+{
+    return size / QSize + (size % QSize != 0);
+}
+
+template <typename T, std::size_t QSize>
+std::size_t MappedMatrix<T, QSize>::CalcFileSize(SizeT num_rows, SizeT num_cols) noexcept
+{
+    return DataOffset + std::size_t{ CalcQNumFromNum(num_rows) } * CalcQNumFromNum(num_cols) * sizeof(QMatrix);
+}
+
+template <typename T, std::size_t QSize>
+MappedHeader MappedMatrix<T, QSize>::MakeHeader(SizeT num_rows, SizeT num_cols) noexcept
+{
+    MappedHeader header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.value_size = sizeof(T);
+    header.value_kind = std::is_floating_point_v<T> ? 'f' : std::is_signed_v<T> ? 'i' : 'u';
+    header.qsize = QSize;
+    header.num_rows = num_rows;
+    header.num_cols = num_cols;
+    return header;
+}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>::MappedMatrix(int fd, void* map, std::size_t map_size, bool is_writable,
+                                     SizeT num_rows, SizeT num_cols) noexcept
+    : m_fd{ fd }
+    , m_map{ map }
+    , m_map_size{ map_size }
+    , m_is_writable{ is_writable }
+    , m_num_rows{ num_rows }
+    , m_num_cols{ num_cols }
+    , m_num_qrows{ CalcQNumFromNum(num_rows) }
+    , m_num_qcols{ CalcQNumFromNum(num_cols) }
+    , m_qbuf{ reinterpret_cast<QMatrix*>(static_cast<char*>(map) + DataOffset) }
+{}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize> MappedMatrix<T, QSize>::Create(const std::string& path, SizeT num_rows, SizeT num_cols)
+{
+    if (!num_rows || !num_cols)
+    {
+        throw std::invalid_argument("num_rows and num_cols must be above zero");
+    }
+
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+
+    // ftruncate makes a sparse zero file, the padding of the edge blocks is zero
+    const auto file_size = CalcFileSize(num_rows, num_cols);
+    const auto header = MakeHeader(num_rows, num_cols);
+    if (::ftruncate(fd, file_size) != 0 || ::pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "write " + path);
+    }
+
+    void* map = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "mmap " + path);
+    }
+
+    return { fd, map, file_size, true, num_rows, num_cols };
+}
+
+template <typename T, std::size_t QSize>
+template <typename Layout, typename Alloc>
+MappedMatrix<T, QSize> MappedMatrix<T, QSize>::Create(const std::string& path,
+                                                      const Matrix<T, QSize, Layout, Alloc>& matrix)
+{
+    auto res = Create(path, matrix.GetNumRows(), matrix.GetNumCols());
+    for (PositionT i_qrow = 0; i_qrow < res.m_num_qrows; ++i_qrow)
+    {
+        for (PositionT i_qcol = 0; i_qcol < res.m_num_qcols; ++i_qcol)
+        {
+            res.GetQMatrixUnchecked(i_qrow, i_qcol) = matrix.GetQMatrix(i_qrow, i_qcol);
+        }
+    }
+
+    return res;
+}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize> MappedMatrix<T, QSize>::Open(const std::string& path, bool writable)
+{
+    const int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+
+    MappedHeader header{};
+    struct stat file_stat{};
+    if (::pread(fd, &header, sizeof(header), 0) != sizeof(header) || ::fstat(fd, &file_stat) != 0)
+    {
+        ::close(fd);
+        throw std::invalid_argument("Invalide file format: " + path);
+    }
+
+    const auto expected = MakeHeader(header.num_rows, header.num_cols);
+    const bool is_valid = std::memcmp(&header, &expected, sizeof(header)) == 0 &&
+                          header.num_rows && header.num_cols &&
+                          header.num_rows <= std::numeric_limits<SizeT>::max() &&
+                          header.num_cols <= std::numeric_limits<SizeT>::max() &&
+                          static_cast<std::size_t>(file_stat.st_size) == CalcFileSize(header.num_rows, header.num_cols);
+    if (!is_valid)
+    {
+        ::close(fd);
+        throw std::invalid_argument("Invalide file format: " + path);
+    }
+
+    const auto file_size = static_cast<std::size_t>(file_stat.st_size);
+    void* map = ::mmap(nullptr, file_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "mmap " + path);
+    }
+
+    return { fd, map, file_size, writable, static_cast<SizeT>(header.num_rows),
+             static_cast<SizeT>(header.num_cols) };
+}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>::MappedMatrix(MappedMatrix&& other) noexcept
+    : m_fd{ std::exchange(other.m_fd, -1) }
+    , m_map{ std::exchange(other.m_map, nullptr) }
+    , m_map_size{ other.m_map_size }
+    , m_is_writable{ other.m_is_writable }
+    , m_num_rows{ other.m_num_rows }
+    , m_num_cols{ other.m_num_cols }
+    , m_num_qrows{ other.m_num_qrows }
+    , m_num_qcols{ other.m_num_qcols }
+    , m_qbuf{ other.m_qbuf }
+{}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>& MappedMatrix<T, QSize>::operator=(MappedMatrix&& other) noexcept
+{
+    if (this != &other)
+    {
+        Unmap();
+        m_fd = std::exchange(other.m_fd, -1);
+        m_map = std::exchange(other.m_map, nullptr);
+        m_map_size = other.m_map_size;
+        m_is_writable = other.m_is_writable;
+        m_num_rows = other.m_num_rows;
+        m_num_cols = other.m_num_cols;
+        m_num_qrows = other.m_num_qrows;
+        m_num_qcols = other.m_num_qcols;
+        m_qbuf = other.m_qbuf;
+    }
+
+    return *this;
+}
+
+template <typename T, std::size_t QSize>
+MappedMatrix<T, QSize>::~MappedMatrix()
+{
+    Unmap();
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Unmap() noexcept
+{
+    if (m_map != nullptr)
+    {
+        ::munmap(m_map, m_map_size);
+        m_map = nullptr;
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::CheckWritable() const
+{
+    if (!m_is_writable)
+    {
+        throw std::logic_error("Matrix is mapped read-only");
+    }
+}
+
+template <typename T, std::size_t QSize>
+typename MappedMatrix<T, QSize>::ProxyRow MappedMatrix<T, QSize>::operator[](PositionT row)
+{
+    CheckWritable();
+
+    PositionT i_row = row % QSize;
+    PositionT i_qrow = row / QSize;
+    return { i_row, i_qrow, this };
+}
+
+template <typename T, std::size_t QSize>
+typename MappedMatrix<T, QSize>::ProxyRowConst MappedMatrix<T, QSize>::operator[](PositionT row) const noexcept
+{
+    PositionT i_row = row % QSize;
+    PositionT i_qrow = row / QSize;
+    return { i_row, i_qrow, this };
+}
+
+template <typename T, std::size_t QSize>
+std::ostream& operator<<(std::ostream& os, const MappedMatrix<T, QSize>& matrix)
+{
+    const std::size_t num_cols = matrix.GetNumCols();
+    const std::size_t num_rows = matrix.GetNumRows();
+
+    for (std::size_t i_row = 0; i_row < num_rows; ++i_row)
+    {
+        const auto& row = matrix[i_row];
+        os << row[0];
+        for (std::size_t i_col = 1; i_col < num_cols; ++i_col)
+        {
+            os << ' ' << row[i_col];
+        }
+        os << '\n';
+    }
+
+    return os;
+}
+
+template <typename T, std::size_t QSize>
+const typename MappedMatrix<T, QSize>::QMatrix&
+MappedMatrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept
+{
+    return m_qbuf[std::size_t{ i_qrow } * m_num_qcols + i_qcol];
+}
+
+template <typename T, std::size_t QSize>
+typename MappedMatrix<T, QSize>::QMatrix&
+MappedMatrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol)
+{
+    CheckWritable();
+    return GetQMatrixUnchecked(i_qrow, i_qcol);
+}
+
+template <typename T, std::size_t QSize>
+typename MappedMatrix<T, QSize>::QMatrix&
+MappedMatrix<T, QSize>::GetQMatrixUnchecked(PositionT i_qrow, PositionT i_qcol) noexcept
+{
+    return m_qbuf[std::size_t{ i_qrow } * m_num_qcols + i_qcol];
+}
+
+template <typename T, std::size_t QSize>
+template <typename Layout, typename Alloc>
+void MappedMatrix<T, QSize>::CopyTo(Matrix<T, QSize, Layout, Alloc>& matrix) const
+{
+    if (matrix.GetNumRows() != m_num_rows || matrix.GetNumCols() != m_num_cols)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    Prefetch(0, m_num_qrows);
+    for (PositionT i_qrow = 0; i_qrow < m_num_qrows; ++i_qrow)
+    {
+        for (PositionT i_qcol = 0; i_qcol < m_num_qcols; ++i_qcol)
+        {
+            matrix.GetQMatrix(i_qrow, i_qcol) = GetQMatrix(i_qrow, i_qcol);
+        }
+    }
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Advise(std::size_t i_block_begin, std::size_t i_block_end, int advice) const noexcept
+{
+    if (i_block_begin >= i_block_end)
+    {
+        return;
+    }
+
+    // madvise takes whole pages
+    static const std::size_t page_size = ::sysconf(_SC_PAGESIZE);
+    const std::size_t begin = (DataOffset + i_block_begin * sizeof(QMatrix)) / page_size * page_size;
+    const std::size_t end = std::min(m_map_size, DataOffset + i_block_end * sizeof(QMatrix));
+    ::madvise(static_cast<char*>(m_map) + begin, end - begin, advice);
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Prefetch(PositionT i_qrow_begin, PositionT i_qrow_end,
+                                      PositionT i_qcol_begin, PositionT i_qcol_end) const noexcept
+{
+    for (PositionT i_qrow = i_qrow_begin; i_qrow < std::min(i_qrow_end, m_num_qrows); ++i_qrow)
+    {
+        const std::size_t i_block = std::size_t{ i_qrow } * m_num_qcols;
+        Advise(i_block + i_qcol_begin, i_block + std::min(i_qcol_end, m_num_qcols), MADV_WILLNEED);
+    }
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Prefetch(PositionT i_qrow_begin, PositionT i_qrow_end) const noexcept
+{
+    i_qrow_end = std::min(i_qrow_end, m_num_qrows);
+    Advise(std::size_t{ i_qrow_begin } * m_num_qcols, std::size_t{ i_qrow_end } * m_num_qcols, MADV_WILLNEED);
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Evict(PositionT i_qrow_begin, PositionT i_qrow_end) const noexcept
+{
+    // Partial pages at the ends may hold blocks of neighbour rows, they stay mapped
+    static const std::size_t page_size = ::sysconf(_SC_PAGESIZE);
+    i_qrow_end = std::min(i_qrow_end, m_num_qrows);
+    if (i_qrow_begin >= i_qrow_end)
+    {
+        return;
+    }
+
+    const std::size_t begin = DataOffset + std::size_t{ i_qrow_begin } * m_num_qcols * sizeof(QMatrix);
+    const std::size_t end = DataOffset + std::size_t{ i_qrow_end } * m_num_qcols * sizeof(QMatrix);
+    const std::size_t begin_aligned = (begin + page_size - 1) / page_size * page_size;
+    const std::size_t end_aligned = end / page_size * page_size;
+    if (begin_aligned < end_aligned)
+    {
+        ::madvise(static_cast<char*>(m_map) + begin_aligned, end_aligned - begin_aligned, MADV_DONTNEED);
+    }
+}
+
+template <typename T, std::size_t QSize>
+void MappedMatrix<T, QSize>::Flush()
+{
+    if (::msync(m_map, m_map_size, MS_SYNC) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "msync");
+    }
+}
+
+// out = lhs * rhs on mapped files, for matrices bigger than memory.
+// rhs is taken in panels of block columns that fit into memory_budget bytes, a panel
+// is read once and kept transposed in memory. Block rows of lhs are streamed through it:
+// while one block row is multiplied the next one is read ahead by the kernel
+// (MADV_WILLNEED), and rows already used are unmapped. lhs is read once per panel.
+// Block products of a row are split between num_threads threads, 0 - one per hardware thread.
+// out must be mapped writable and must not be lhs or rhs: later panels still read lhs
+template <typename T, std::size_t QSize>
+void MultiplyOutOfCore(const MappedMatrix<T, QSize>& lhs, const MappedMatrix<T, QSize>& rhs,
+                       MappedMatrix<T, QSize>& out, std::size_t memory_budget = std::size_t{ 1 } << 30,
+                       unsigned num_threads = 0)
+{
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    if (lhs.GetNumCols() != rhs.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (out.GetNumRows() != lhs.GetNumRows() || out.GetNumCols() != rhs.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+    if (&out == &lhs || &out == &rhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+    if (!out.IsWritable())
+    {
+        throw std::invalid_argument("out is mapped read-only");
+    }
+
+    const auto num_k = rhs.GetNumQRows();
+    const auto panel_num_qcols = static_cast<SizeT>(std::clamp<std::size_t>(
+        memory_budget / (std::size_t{ num_k } * sizeof(QMatrix)), 1, rhs.GetNumQCols()));
+
+    std::vector<QMatrix> rhs_panel(std::size_t{ num_k } * panel_num_qcols);
+    for (PositionT i_qcol_begin = 0; i_qcol_begin < rhs.GetNumQCols(); i_qcol_begin += panel_num_qcols)
+    {
+        const auto i_qcol_end = std::min(i_qcol_begin + panel_num_qcols, rhs.GetNumQCols());
+        const auto num_qcols = i_qcol_end - i_qcol_begin;
+
+        // rhs_panel[j * num_k + k] = rhs(k, i_qcol_begin + j)^T: the blocks of one output
+        // block are next to each other
+        rhs.Prefetch(0, num_k, i_qcol_begin, i_qcol_end);
+        for (PositionT k = 0; k < num_k; ++k)
+        {
+            for (PositionT j = 0; j < num_qcols; ++j)
+            {
+                rhs.GetQMatrix(k, i_qcol_begin + j).Transpose(rhs_panel[std::size_t{ j } * num_k + k]);
+            }
+        }
+
+        lhs.Prefetch(0, 1);
+        for (PositionT i_qrow = 0; i_qrow < lhs.GetNumQRows(); ++i_qrow)
+        {
+            lhs.Prefetch(i_qrow + 1, i_qrow + 2);
+
+            mxcmn::BatchFor(num_qcols, num_threads, [&](std::size_t j) {
+                auto& res_qm = out.GetQMatrix(i_qrow, i_qcol_begin + j);
+                res_qm.Fill(0);
+                for (PositionT k = 0; k < num_k; ++k)
+                {
+                    res_qm.MultAddToTransposed(lhs.GetQMatrix(i_qrow, k), rhs_panel[j * num_k + k]);
+                }
+            });
+
+            lhs.Evict(i_qrow, i_qrow + 1);
+        }
+    }
+}
+
+} // namespace mxcl
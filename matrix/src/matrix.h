@@ -4,13 +4,42 @@ namespace mxcmn
 {
 using PositionT = unsigned;
 using SizeT = unsigned;
+
+// Keeps alpha/beta of Gemm(alpha, a, b, beta, out) out of template argument deduction,
+// so Gemm(2, a, b, 0, out) works for Matrix<double>
+template <typename T>
+struct NonDeduced
+{
+    using type = T;
+};
+
+template <typename T>
+using NonDeducedT = typename NonDeduced<T>::type;
+
+// out = alpha * value + beta * out, out is not read when beta is zero
+template <typename T>
+inline void StoreScaled(T& out, T value, T alpha, T beta) noexcept
+{
+    out = beta == T{} ? alpha * value : alpha * value + beta * out;
+}
 }
 
+#include "matrix_view.h"
 #include "matrix_native.h"
 #include "matrix_native_parallel.h"
 #include "matrix_cachelike.h"
 #include "matrix_tr.h"
 #include "matrix_cachelike_parallel.h"
+#include "matrix_gemm.h"
+#include "matrix_strassen.h"
+#include "batch.h"
+#include "gemv.h"
+#include "chain.h"
+#include "solve.h"
+#include "sparse.h"
+#include "expr.h"
+#include "fixed_matrix.h"
+#include "async.h"
 
 template <typename M>
 std::pair<mxcmn::SizeT, mxcmn::SizeT> GetNumRowsCols(const M& m)
@@ -1,47 +1,57 @@
 #pragma once
 
 #include <stdexcept>
+#include <algorithm>
 #include <vector>
+#include <memory>
 #include <iosfwd>
 #include <iostream>
 
 #include "qmatrix.h"
+#include "block_layout.h"
+#include "allocator.h"
+#include "matrix_view.h"
+#include "scratch.h"
 
 namespace mxcl
 {
 
-template <typename T, std::size_t QSize>
+// Layout is RowMajorLayout or MortonLayout, see block_layout.h.
+// Alloc is an allocator of T, it is rebound to QMatrix for the block storage
+template <typename T, std::size_t QSize, typename Layout = RowMajorLayout, typename Alloc = std::allocator<T>>
 class Matrix
 {
-    using QMatrix = qmx::QMatrix<T, QSize>;
-
 public:
+    using QMatrix = qmx::QMatrix<T, QSize>;
     using PositionT = mxcmn::PositionT;
     using SizeT = mxcmn::SizeT;
 
     static_assert(std::is_unsigned_v<PositionT>, "PositionT must be unsigned");
     static_assert(std::is_unsigned_v<SizeT>, "SizeT must be unsigned");
 
+    // The block row is looked up once per row, an element costs one block index of it
     class ProxyRow
     {
     public:
-        ProxyRow(PositionT i_row, QMatrix* qrow_ptr) noexcept;
+        ProxyRow(PositionT i_row, PositionT i_qrow, Matrix* matrix) noexcept;
         T& operator[](PositionT col) const noexcept;
 
     private:
         PositionT m_i_row;
-        QMatrix* m_qrow_ptr;
+        QMatrix* m_qbuf;
+        typename Layout::RowIndexer m_qindexer;
     };
 
     class ProxyRowConst
     {
     public:
-        ProxyRowConst(PositionT i_row, const QMatrix* qrow_ptr) noexcept;
+        ProxyRowConst(PositionT i_row, PositionT i_qrow, const Matrix* matrix) noexcept;
         const T& operator[](PositionT col) const noexcept;
 
     private:
         PositionT m_i_row;
-        const QMatrix* m_qrow_ptr;
+        const QMatrix* m_qbuf;
+        typename Layout::RowIndexer m_qindexer;
     };
 
     Matrix(SizeT num_rows, SizeT num_cols);
@@ -50,78 +60,114 @@ public:
     ProxyRowConst operator[](PositionT row) const noexcept;
     Matrix& operator*=(const Matrix& rhs);
 
+    // this = alpha * lhs * rhs + beta * this, reuses the storage of this.
+    // lhs and rhs may have a narrower element type U, products are then accumulated
+    // in T: float -> double, int8_t or int16_t -> int32_t have SIMD kernels
+    template <typename U, typename UAlloc>
+    void Gemm(T alpha, const Matrix<U, QSize, Layout, UAlloc>& lhs, const Matrix<U, QSize, Layout, UAlloc>& rhs,
+              T beta);
+
+    // this = alpha * lhs * rhs^T + beta * this. Blocks of rhs are already in the form
+    // MultAddToTransposed takes, so nothing is transposed or copied
+    void GemmRhsTransposed(T alpha, const Matrix& lhs, const Matrix& rhs, T beta);
+
+    // res = this^T, res must be num_cols x num_rows and not this.
+    // Block (i, j) goes to block (j, i) of res transposed, zero padding stays zero
+    void Transpose(Matrix& res) const;
+
     inline SizeT GetNumCols() const noexcept { return m_num_cols; }
     inline SizeT GetNumRows() const noexcept { return m_num_rows; }
 
-private:
+    // Block grid access, blocks on the right and bottom edges are zero padded
     inline SizeT GetNumQCols() const noexcept { return m_num_qcols; }
     inline SizeT GetNumQRows() const noexcept { return m_num_qrows; }
+    const QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept;
+    QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept;
+
+private:
+    template <typename, std::size_t, typename, typename>
+    friend class Matrix;
 
     template <typename U>
-    bool IsCorrectMultSize(const Matrix<U, QSize>& rhs) const noexcept;
+    bool IsCorrectMultSize(const Matrix<U, QSize, Layout, Alloc>& rhs) const noexcept;
 
     template <typename U>
-    void CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const;
+    void CheckCorrectMultSize(const Matrix<U, QSize, Layout, Alloc>& rhs) const;
+
+    // this = beta * this, padding stays zero
+    void ScaleForGemm(T beta) noexcept;
 
 private:
     // size -> qsize
     SizeT CalcQNumFromNum(SizeT size);
-    const QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept;
-    QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept;
+    // Number of used rows (cols) in block i_q of a side of size elements
+    static SizeT CalcQExtent(SizeT size, PositionT i_q) noexcept;
 
 private:
     SizeT m_num_rows, m_num_cols;
     SizeT m_num_qrows, m_num_qcols;
-    std::vector<QMatrix> m_qbuf;
+    Layout m_layout;
+    std::vector<QMatrix, typename std::allocator_traits<Alloc>::template rebind_alloc<QMatrix>> m_qbuf;
 };
 
 // ProxyRow implementation ------------------------------------------------------------------------
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::ProxyRow::ProxyRow(PositionT i_row, QMatrix* qrow_ptr) noexcept
-    : m_i_row{ i_row }, m_qrow_ptr{ qrow_ptr }
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+Matrix<T, QSize, Layout, Alloc>::ProxyRow::ProxyRow(PositionT i_row, PositionT i_qrow, Matrix* matrix) noexcept
+    : m_i_row{ i_row }, m_qbuf{ matrix->m_qbuf.data() }, m_qindexer{ matrix->m_layout.GetRowIndexer(i_qrow) }
 {}
 
-template <typename T, std::size_t QSize>
-T& Matrix<T, QSize>::ProxyRow::operator[](PositionT col) const noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+T& Matrix<T, QSize, Layout, Alloc>::ProxyRow::operator[](PositionT col) const noexcept
 {
-    return m_qrow_ptr[col / QSize].m_buf[m_i_row][col % QSize];
+    return m_qbuf[m_qindexer(col / QSize)].m_buf[m_i_row][col % QSize];
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::ProxyRowConst::ProxyRowConst(PositionT i_row, const QMatrix* qrow_ptr) noexcept
-    : m_i_row{ i_row }, m_qrow_ptr{ qrow_ptr }
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+Matrix<T, QSize, Layout, Alloc>::ProxyRowConst::ProxyRowConst(PositionT i_row, PositionT i_qrow,
+                                                       const Matrix* matrix) noexcept
+    : m_i_row{ i_row }, m_qbuf{ matrix->m_qbuf.data() }, m_qindexer{ matrix->m_layout.GetRowIndexer(i_qrow) }
 {}
 
-template <typename T, std::size_t QSize>
-const T& Matrix<T, QSize>::ProxyRowConst::operator[](PositionT col) const noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+const T& Matrix<T, QSize, Layout, Alloc>::ProxyRowConst::operator[](PositionT col) const noexcept
 {
-    return m_qrow_ptr[col / QSize].m_buf[m_i_row][col % QSize];
+    return m_qbuf[m_qindexer(col / QSize)].m_buf[m_i_row][col % QSize];
 }
 
 // Matrix implementation --------------------------------------------------------------------------
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::SizeT Matrix<T, QSize>::CalcQNumFromNum(SizeT size)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+typename Matrix<T, QSize, Layout, Alloc>::SizeT Matrix<T, QSize, Layout, Alloc>::CalcQNumFromNum(SizeT size)
 {
     return size / QSize + (size % QSize != 0);
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::Matrix(SizeT num_rows, SizeT num_cols)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+typename Matrix<T, QSize, Layout, Alloc>::SizeT
+Matrix<T, QSize, Layout, Alloc>::CalcQExtent(SizeT size, PositionT i_q) noexcept
+{
+    return std::min<SizeT>(QSize, size - i_q * QSize);
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+Matrix<T, QSize, Layout, Alloc>::Matrix(SizeT num_rows, SizeT num_cols)
     : m_num_rows{ num_rows },
       m_num_cols{ num_cols },
       m_num_qrows{ CalcQNumFromNum(num_rows) },
       m_num_qcols{ CalcQNumFromNum(num_cols) },
+      m_layout{ m_num_qrows, m_num_qcols },
       m_qbuf(m_num_qrows * m_num_qcols)
 {
     if (num_rows == 0 || num_cols == 0)
     {
         throw std::invalid_argument("num_rows and num_cols must be above zero");
     }
+
+    mxcmn::InitStorage(m_qbuf, QMatrix{});
 }
-template <typename T, std::size_t QSize>
-void Matrix<T, QSize>::Fill(T value) noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Matrix<T, QSize, Layout, Alloc>::Fill(T value) noexcept
 {
     for (PositionT i_qrow = 0; i_qrow < m_num_qrows; ++i_qrow)
     {
@@ -132,24 +178,26 @@ void Matrix<T, QSize>::Fill(T value) noexcept
     }
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::ProxyRow Matrix<T, QSize>::operator[](PositionT row) noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+typename Matrix<T, QSize, Layout, Alloc>::ProxyRow
+Matrix<T, QSize, Layout, Alloc>::operator[](PositionT row) noexcept
 {
     PositionT i_row = row % QSize;
     PositionT i_qrow = row / QSize;
-    return { i_row, &GetQMatrix(i_qrow, 0) };
+    return { i_row, i_qrow, this };
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::ProxyRowConst Matrix<T, QSize>::operator[](PositionT row) const noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+typename Matrix<T, QSize, Layout, Alloc>::ProxyRowConst
+Matrix<T, QSize, Layout, Alloc>::operator[](PositionT row) const noexcept
 {
     PositionT i_row = row % QSize;
     PositionT i_qrow = row / QSize;
-    return { i_row, &GetQMatrix(i_qrow, 0) };
+    return { i_row, i_qrow, this };
 }
 
-template <typename T, std::size_t QSize>
-std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize>& matrix)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize, Layout, Alloc>& matrix)
 {
     const std::size_t num_cols = matrix.GetNumCols();
     const std::size_t num_rows = matrix.GetNumRows();
@@ -168,16 +216,16 @@ std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize>& matrix)
     return os;
 }
 
-template <typename T, std::size_t QSize>
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
 template <typename U>
-bool Matrix<T, QSize>::IsCorrectMultSize(const Matrix<U, QSize>& rhs) const noexcept
+bool Matrix<T, QSize, Layout, Alloc>::IsCorrectMultSize(const Matrix<U, QSize, Layout, Alloc>& rhs) const noexcept
 {
     return m_num_cols == rhs.m_num_rows;
 }
 
-template <typename T, std::size_t QSize>
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
 template <typename U>
-void Matrix<T, QSize>::CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const
+void Matrix<T, QSize, Layout, Alloc>::CheckCorrectMultSize(const Matrix<U, QSize, Layout, Alloc>& rhs) const
 {
     if (!IsCorrectMultSize(rhs))
     {
@@ -185,47 +233,193 @@ void Matrix<T, QSize>::CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const
     }
 }
 
-template <typename T, std::size_t QSize>
-const typename Matrix<T, QSize>::QMatrix&
-Matrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Matrix<T, QSize, Layout, Alloc>::ScaleForGemm(T beta) noexcept
 {
-    return m_qbuf[m_num_qcols * i_qrow + i_qcol];
+    if (beta == T{})
+    {
+        Fill(0);
+    }
+    else if (beta != T{1})
+    {
+        for (auto& qm : m_qbuf)
+        {
+            qm.Scale(beta);
+        }
+    }
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::QMatrix&
-Matrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+const typename Matrix<T, QSize, Layout, Alloc>::QMatrix&
+Matrix<T, QSize, Layout, Alloc>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept
 {
-    return m_qbuf[m_num_qcols * i_qrow + i_qcol];
+    return m_qbuf[m_layout.GetIndex(i_qrow, i_qcol)];
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>& Matrix<T, QSize>::operator*=(const Matrix& rhs)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+typename Matrix<T, QSize, Layout, Alloc>::QMatrix&
+Matrix<T, QSize, Layout, Alloc>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept
 {
-    CheckCorrectMultSize(rhs);
-    
-    Matrix<T, QSize> res{GetNumRows(), rhs.GetNumCols()};
-    res.Fill(0);
+    return m_qbuf[m_layout.GetIndex(i_qrow, i_qcol)];
+}
 
-    const auto K = m_num_qrows;
-    QMatrix qm_tmp;
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Layout, Alloc>::Gemm(T alpha, const Matrix<U, QSize, Layout, UAlloc>& lhs,
+                                           const Matrix<U, QSize, Layout, UAlloc>& rhs, T beta)
+{
+    mxcmn::CheckCorrectGemmArgs(lhs, rhs, *this);
+    ScaleForGemm(beta);
+
+    // alpha goes to the smaller operand when it has the type of the accumulator,
+    // narrow inputs are multiplied into qm_prod and it is added scaled
+    constexpr bool is_same_type = std::is_same_v<T, U>;
+    const bool use_qm_prod = !is_same_type && alpha != T{1};
+
+    // The temporary blocks live in the scratch arena of the thread instead of the stack,
+    // qm_prod only exists for narrow inputs
+    using RhsQMatrix = qmx::QMatrix<U, QSize>;
+    constexpr std::size_t Alignment = mxcmn::ScratchArena::Alignment;
+    constexpr std::size_t qm_prod_offset = (sizeof(RhsQMatrix) + Alignment - 1) / Alignment * Alignment;
+    auto& tmp_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Tmp);
+    tmp_arena.template Reserve<std::byte>(qm_prod_offset + (is_same_type ? 0 : sizeof(QMatrix)));
+    auto* scratch = tmp_arena.template Get<std::byte>();
+    auto& qm_tmp = *reinterpret_cast<RhsQMatrix*>(scratch);
+    auto* qm_prod = is_same_type ? nullptr : reinterpret_cast<QMatrix*>(scratch + qm_prod_offset);
+
+    // Edge blocks only multiply their used part, the zero padding is skipped
     for (PositionT i_rhs_qrow = 0; i_rhs_qrow < rhs.GetNumQRows(); ++i_rhs_qrow)
     {
+        const auto num_k = CalcQExtent(rhs.GetNumRows(), i_rhs_qrow);
         for (PositionT i_rhs_qcol = 0; i_rhs_qcol < rhs.GetNumQCols(); ++i_rhs_qcol)
         {
+            const auto num_cols = CalcQExtent(rhs.GetNumCols(), i_rhs_qcol);
+
             // Write transposed block from rhs to qm_tmp
             rhs.GetQMatrix(i_rhs_qrow, i_rhs_qcol).Transpose(qm_tmp);
+            if constexpr (is_same_type)
+            {
+                if (alpha != T{1})
+                {
+                    qm_tmp.Scale(alpha);
+                }
+            }
+
+            for (PositionT k_qrow = 0; k_qrow < lhs.GetNumQRows(); ++k_qrow)
+            {
+                const auto num_rows = CalcQExtent(lhs.GetNumRows(), k_qrow);
+                const auto& lqm = lhs.GetQMatrix(k_qrow, i_rhs_qrow);
+                auto& res_qm = GetQMatrix(k_qrow, i_rhs_qcol);
+                if (use_qm_prod)
+                {
+                    qm_prod->Fill(0);
+                    qm_prod->MultAddToTransposed(lqm, qm_tmp, num_rows, num_cols, num_k);
+                    res_qm.AddScaled(*qm_prod, alpha);
+                }
+                else
+                {
+                    res_qm.MultAddToTransposed(lqm, qm_tmp, num_rows, num_cols, num_k);
+                }
+            }
+        }
+    }
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Matrix<T, QSize, Layout, Alloc>::GemmRhsTransposed(T alpha, const Matrix& lhs, const Matrix& rhs, T beta)
+{
+    if (lhs.m_num_cols != rhs.m_num_cols)
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (m_num_rows != lhs.m_num_rows || m_num_cols != rhs.m_num_rows)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+    if (this == &lhs || this == &rhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+
+    ScaleForGemm(beta);
+
+    // The scaled block lives in the scratch arena of the thread, as in Gemm
+    auto& tmp_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Tmp);
+    tmp_arena.template Reserve<QMatrix>(1);
+    auto& qm_tmp = *tmp_arena.template Get<QMatrix>();
+    for (PositionT i_qcol = 0; i_qcol < m_num_qcols; ++i_qcol)
+    {
+        const auto num_cols = CalcQExtent(m_num_cols, i_qcol);
+        for (PositionT k_qcol = 0; k_qcol < lhs.m_num_qcols; ++k_qcol)
+        {
+            const auto num_k = CalcQExtent(lhs.m_num_cols, k_qcol);
 
-            for (PositionT k_qrow = 0; k_qrow < K; ++k_qrow)
+            // Block (k, j) of rhs^T transposed is block (j, k) of rhs
+            const QMatrix* rqm = &rhs.GetQMatrix(i_qcol, k_qcol);
+            if (alpha != T{1})
             {
-                const auto& lqm = GetQMatrix(k_qrow, i_rhs_qrow);
-                res.GetQMatrix(k_qrow, i_rhs_qcol).MultAddToTransposed(lqm, qm_tmp);
+                qm_tmp = *rqm;
+                qm_tmp.Scale(alpha);
+                rqm = &qm_tmp;
+            }
+
+            for (PositionT i_qrow = 0; i_qrow < m_num_qrows; ++i_qrow)
+            {
+                const auto num_rows = CalcQExtent(m_num_rows, i_qrow);
+                GetQMatrix(i_qrow, i_qcol).MultAddToTransposed(lhs.GetQMatrix(i_qrow, k_qcol), *rqm,
+                                                               num_rows, num_cols, num_k);
             }
         }
     }
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Matrix<T, QSize, Layout, Alloc>::Transpose(Matrix& res) const
+{
+    if (this == &res)
+    {
+        throw std::invalid_argument("res must not alias this");
+    }
+    if (res.m_num_rows != m_num_cols || res.m_num_cols != m_num_rows)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    for (PositionT i_qrow = 0; i_qrow < m_num_qrows; ++i_qrow)
+    {
+        for (PositionT i_qcol = 0; i_qcol < m_num_qcols; ++i_qcol)
+        {
+            GetQMatrix(i_qrow, i_qcol).Transpose(res.GetQMatrix(i_qcol, i_qrow));
+        }
+    }
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+Matrix<T, QSize, Layout, Alloc>& Matrix<T, QSize, Layout, Alloc>::operator*=(const Matrix& rhs)
+{
+    CheckCorrectMultSize(rhs);
+    
+    Matrix<T, QSize, Layout, Alloc> res{GetNumRows(), rhs.GetNumCols()};
+    res.Gemm(T{1}, *this, rhs, T{0});
 
     *this = std::move(res);
     return *this;
 }
 
+// U is the element type of lhs and rhs, T of out and of the accumulator
+template <typename T, typename U, std::size_t QSize, typename Layout, typename Alloc, typename UAlloc>
+void Multiply(const Matrix<U, QSize, Layout, UAlloc>& lhs, const Matrix<U, QSize, Layout, UAlloc>& rhs,
+              Matrix<T, QSize, Layout, Alloc>& out)
+{
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename T, typename U, std::size_t QSize, typename Layout, typename Alloc, typename UAlloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const Matrix<U, QSize, Layout, UAlloc>& lhs,
+          const Matrix<U, QSize, Layout, UAlloc>& rhs, mxcmn::NonDeducedT<T> beta,
+          Matrix<T, QSize, Layout, Alloc>& out)
+{
+    out.Gemm(alpha, lhs, rhs, beta);
+}
+
 } // namespace mxcl
@@ -1,17 +1,26 @@
 #pragma once
 
 #include <stdexcept>
+#include <algorithm>
 #include <vector>
+#include <memory>
 #include <thread>
+#include <atomic>
 #include <iostream>
 #include <iosfwd>
 
 #include "qmatrix.h"
+#include "thread_pool.h"
+#include "allocator.h"
+#include "matrix_view.h"
+#include "reduction.h"
+#include "scratch.h"
 
 namespace mxclpl
 {
 
-template <typename T, std::size_t QSize>
+// Alloc is an allocator of T, it is rebound to QMatrix for the block storage
+template <typename T, std::size_t QSize, typename Alloc = std::allocator<T>>
 class Matrix
 {
     using QMatrix = qmx::QMatrix<T, QSize>;
@@ -51,64 +60,138 @@ public:
     ProxyRowConst operator[](PositionT row) const noexcept;
     Matrix& operator*=(const Matrix& rhs);
 
+    // this = alpha * lhs * rhs + beta * this, reuses the storage of this.
+    // Packed rhs and temporary blocks live in the arenas of the threads, see scratch.h.
+    // lhs and rhs may have a narrower element type U, products are then accumulated
+    // in T: float -> double, int8_t or int16_t -> int32_t have SIMD kernels
+    template <typename U, typename UAlloc>
+    void Gemm(T alpha, const Matrix<U, QSize, UAlloc>& lhs, const Matrix<U, QSize, UAlloc>& rhs, T beta);
+
+    // Gemm in two steps: PackRhs keeps the transposed blocks of alpha * rhs in the scratch of this,
+    // GemmPacked then computes this = alpha * lhs * rhs + beta * this and may be repeated.
+    // The async pipeline packs the next product while the current one is computed, see async.h.
+    // The packed rhs is kept until ReleaseScratch, copies of the matrix do not get it
+    // and copy-assignment drops it
+    template <typename UAlloc>
+    void PackRhs(T alpha, const Matrix<T, QSize, UAlloc>& rhs);
+    template <typename UAlloc>
+    void GemmPacked(const Matrix<T, QSize, UAlloc>& lhs, T beta);
+    void ReleaseScratch() noexcept;
+
+    // res = this^T, res must be num_cols x num_rows and not this.
+    // Block (i, j) goes to block (j, i) of res transposed, blocks are shared between workers
+    void Transpose(Matrix& res) const;
+
     inline SizeT GetNumCols() const noexcept { return m_num_cols; }
     inline SizeT GetNumRows() const noexcept { return m_num_rows; }
 
+    // Order of the k sums of Gemm into this, see reduction.h
+    void SetReduction(mxcmn::Reduction reduction) noexcept { m_reduction = reduction; }
+    mxcmn::Reduction GetReduction() const noexcept { return m_reduction; }
+
 private:
+    template <typename, std::size_t, typename>
+    friend class Matrix;
+
     inline SizeT GetNumQCols() const noexcept { return m_num_qcols; }
     inline SizeT GetNumQRows() const noexcept { return m_num_qrows; }
 
     template <typename U>
-    bool IsCorrectMultSize(const Matrix<U, QSize>& rhs) const noexcept;
+    bool IsCorrectMultSize(const Matrix<U, QSize, Alloc>& rhs) const noexcept;
 
     template <typename U>
-    void CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const;
+    void CheckCorrectMultSize(const Matrix<U, QSize, Alloc>& rhs) const;
+
 
 private:
     // size -> qsize
     SizeT CalcQNumFromNum(SizeT size);
+    // Number of used rows (cols) in block i_q of a side of size elements
+    static SizeT CalcQExtent(SizeT size, PositionT i_q) noexcept;
     const QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept;
     QMatrix& GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept;
 
     // Multithreading
     static unsigned CalcNumThreads(int num_threads) noexcept;
-    void MultRow(const Matrix& rhs, Matrix& res, PositionT i_rhs_qcol_begin, PositionT i_rhs_qcol_end) noexcept;
+    // Zeroes storage of a default-init allocator from the pool workers, see allocator.h
+    void FirstTouch();
+    // Runs func(i_item) for i_item in [0, num_items), workers claim items one by one
+    template <typename F>
+    void ParallelForDynamic(SizeT num_items, F&& func) const;
+    // Bodies of PackRhs and GemmPacked, also used by Gemm for any U
+    template <typename U, typename UAlloc>
+    void PackRhsTo(T alpha, const Matrix<U, QSize, UAlloc>& rhs, qmx::QMatrix<U, QSize>* rhs_tr) const;
+    template <typename U, typename UAlloc>
+    void GemmPackedFrom(T alpha, const Matrix<U, QSize, UAlloc>& lhs, const qmx::QMatrix<U, QSize>* rhs_tr, T beta);
+    // Number of QMatrix temporaries a worker of Gemm needs for k of num_k_qcols blocks
+    template <typename U>
+    SizeT CalcNumTmpQMatrices(SizeT num_k_qcols) const noexcept;
+    // rhs_tr holds every block of rhs transposed, in the order of the rhs block grid
+    template <typename U, typename UAlloc>
+    void MultTile(T alpha, const Matrix<U, QSize, UAlloc>& lhs, const qmx::QMatrix<U, QSize>* rhs_tr, T beta,
+                  PositionT i_qrow, PositionT i_rhs_qcol, QMatrix* tmp_qms) noexcept;
+    // MultTile with k cut into chunks of about DeterministicKChunk, see reduction.h
+    template <typename U, typename UAlloc>
+    void MultTileChunked(T alpha, const Matrix<U, QSize, UAlloc>& lhs, const qmx::QMatrix<U, QSize>* rhs_tr,
+                         T beta, PositionT i_qrow, PositionT i_rhs_qcol, QMatrix* tmp_qms) noexcept;
 
 private:
+    // rhs of the last PackRhs. It belongs to one matrix, so copies start without it
+    struct PackedRhs
+    {
+        PackedRhs() = default;
+        PackedRhs(const PackedRhs&) noexcept {}
+        PackedRhs(PackedRhs&&) noexcept = default;
+        // The storage is kept for the next PackRhs, the packed rhs is dropped
+        PackedRhs& operator=(const PackedRhs&) noexcept
+        {
+            num_rows = num_cols = 0;
+            return *this;
+        }
+        PackedRhs& operator=(PackedRhs&&) noexcept = default;
+
+        mxcmn::ScratchArena rhs_tr;
+        SizeT num_rows = 0; // 0 while nothing is packed
+        SizeT num_cols = 0;
+        T alpha{};
+    };
+
     SizeT m_num_rows, m_num_cols;
     SizeT m_num_qrows, m_num_qcols;
-    std::vector<QMatrix> m_qbuf;
+    std::vector<QMatrix, typename std::allocator_traits<Alloc>::template rebind_alloc<QMatrix>> m_qbuf;
     unsigned m_num_threads;
+    mxcmn::Reduction m_reduction = mxcmn::Reduction::Default;
+    PackedRhs m_packed_rhs;
 };
 
 // ProxyRow implementation ------------------------------------------------------------------------
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::ProxyRow::ProxyRow(PositionT i_row, QMatrix* qrow_ptr) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+Matrix<T, QSize, Alloc>::ProxyRow::ProxyRow(PositionT i_row, QMatrix* qrow_ptr) noexcept
     : m_i_row{ i_row }, m_qrow_ptr{ qrow_ptr }
 {}
 
-template <typename T, std::size_t QSize>
-T& Matrix<T, QSize>::ProxyRow::operator[](PositionT col) const noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+T& Matrix<T, QSize, Alloc>::ProxyRow::operator[](PositionT col) const noexcept
 {
     return m_qrow_ptr[col / QSize].m_buf[m_i_row][col % QSize];
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::ProxyRowConst::ProxyRowConst(PositionT i_row, const QMatrix* qrow_ptr) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+Matrix<T, QSize, Alloc>::ProxyRowConst::ProxyRowConst(PositionT i_row, const QMatrix* qrow_ptr) noexcept
     : m_i_row{ i_row }, m_qrow_ptr{ qrow_ptr }
 {}
 
-template <typename T, std::size_t QSize>
-const T& Matrix<T, QSize>::ProxyRowConst::operator[](PositionT col) const noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+const T& Matrix<T, QSize, Alloc>::ProxyRowConst::operator[](PositionT col) const noexcept
 {
     return m_qrow_ptr[col / QSize].m_buf[m_i_row][col % QSize];
 }
 
 // Matrix implementation --------------------------------------------------------------------------
 
-template <typename T, std::size_t QSize>
-unsigned Matrix<T, QSize>::CalcNumThreads(int num_threads) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+unsigned Matrix<T, QSize, Alloc>::CalcNumThreads(int num_threads) noexcept
 {
     unsigned delim = 1;
     #ifdef __amd64__
@@ -125,14 +208,20 @@ auto CalcChunkSize(T size, U step)
     return size / step + (size % step != 0);
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::SizeT Matrix<T, QSize>::CalcQNumFromNum(SizeT size)
+template <typename T, std::size_t QSize, typename Alloc>
+typename Matrix<T, QSize, Alloc>::SizeT Matrix<T, QSize, Alloc>::CalcQNumFromNum(SizeT size)
 {
     return CalcChunkSize(size, QSize);
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
+template <typename T, std::size_t QSize, typename Alloc>
+typename Matrix<T, QSize, Alloc>::SizeT Matrix<T, QSize, Alloc>::CalcQExtent(SizeT size, PositionT i_q) noexcept
+{
+    return std::min<SizeT>(QSize, size - i_q * QSize);
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+Matrix<T, QSize, Alloc>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
     : m_num_rows{ num_rows },
       m_num_cols{ num_cols },
       m_num_qrows{ CalcQNumFromNum(num_rows) },
@@ -144,9 +233,11 @@ Matrix<T, QSize>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
     {
         throw std::invalid_argument("num_rows and num_cols must be above zero");
     }
+
+    FirstTouch();
 }
-template <typename T, std::size_t QSize>
-void Matrix<T, QSize>::Fill(T value) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+void Matrix<T, QSize, Alloc>::Fill(T value) noexcept
 {
     for (PositionT i_qrow = 0; i_qrow < m_num_qrows; ++i_qrow)
     {
@@ -157,24 +248,24 @@ void Matrix<T, QSize>::Fill(T value) noexcept
     }
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::ProxyRow Matrix<T, QSize>::operator[](PositionT row) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+typename Matrix<T, QSize, Alloc>::ProxyRow Matrix<T, QSize, Alloc>::operator[](PositionT row) noexcept
 {
     PositionT i_row = row % QSize;
     PositionT i_qrow = row / QSize;
     return { i_row, &GetQMatrix(i_qrow, 0) };
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::ProxyRowConst Matrix<T, QSize>::operator[](PositionT row) const noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+typename Matrix<T, QSize, Alloc>::ProxyRowConst Matrix<T, QSize, Alloc>::operator[](PositionT row) const noexcept
 {
     PositionT i_row = row % QSize;
     PositionT i_qrow = row / QSize;
     return { i_row, &GetQMatrix(i_qrow, 0) };
 }
 
-template <typename T, std::size_t QSize>
-std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize>& matrix)
+template <typename T, std::size_t QSize, typename Alloc>
+std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize, Alloc>& matrix)
 {
     const std::size_t num_cols = matrix.GetNumCols();
     const std::size_t num_rows = matrix.GetNumRows();
@@ -193,16 +284,16 @@ std::ostream& operator<<(std::ostream& os, const Matrix<T, QSize>& matrix)
     return os;
 }
 
-template <typename T, std::size_t QSize>
+template <typename T, std::size_t QSize, typename Alloc>
 template <typename U>
-bool Matrix<T, QSize>::IsCorrectMultSize(const Matrix<U, QSize>& rhs) const noexcept
+bool Matrix<T, QSize, Alloc>::IsCorrectMultSize(const Matrix<U, QSize, Alloc>& rhs) const noexcept
 {
     return m_num_cols == rhs.m_num_rows;
 }
 
-template <typename T, std::size_t QSize>
+template <typename T, std::size_t QSize, typename Alloc>
 template <typename U>
-void Matrix<T, QSize>::CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const
+void Matrix<T, QSize, Alloc>::CheckCorrectMultSize(const Matrix<U, QSize, Alloc>& rhs) const
 {
     if (!IsCorrectMultSize(rhs))
     {
@@ -210,67 +301,324 @@ void Matrix<T, QSize>::CheckCorrectMultSize(const Matrix<U, QSize>& rhs) const
     }
 }
 
-template <typename T, std::size_t QSize>
-const typename Matrix<T, QSize>::QMatrix&
-Matrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+const typename Matrix<T, QSize, Alloc>::QMatrix&
+Matrix<T, QSize, Alloc>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) const noexcept
 {
     return m_qbuf[m_num_qcols * i_qrow + i_qcol];
 }
 
-template <typename T, std::size_t QSize>
-typename Matrix<T, QSize>::QMatrix&
-Matrix<T, QSize>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+typename Matrix<T, QSize, Alloc>::QMatrix&
+Matrix<T, QSize, Alloc>::GetQMatrix(PositionT i_qrow, PositionT i_qcol) noexcept
 {
     return m_qbuf[m_num_qcols * i_qrow + i_qcol];
 }
 
-template <typename T, std::size_t QSize>
-void Matrix<T, QSize>::MultRow(const Matrix& rhs, Matrix& res,
-                               PositionT i_rhs_qcol_begin, PositionT i_rhs_qcol_end) noexcept
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename F>
+void Matrix<T, QSize, Alloc>::ParallelForDynamic(SizeT num_items, F&& func) const
 {
-    const auto K = m_num_qrows;
-    QMatrix qm_tmp;
-    for (PositionT i_rhs_qcol = i_rhs_qcol_begin; i_rhs_qcol < i_rhs_qcol_end; ++i_rhs_qcol)
+    std::atomic<SizeT> i_next_item{ 0 };
+    const auto num_workers = std::min<SizeT>(m_num_threads, num_items);
+    mxcmn::ThreadPool::Get().Run(num_workers, [&](unsigned) {
+        for (SizeT i_item = i_next_item++; i_item < num_items; i_item = i_next_item++)
+        {
+            func(i_item);
+        }
+    });
+}
+
+// Tiles are claimed in the same order as by Gemm
+template <typename T, std::size_t QSize, typename Alloc>
+void Matrix<T, QSize, Alloc>::FirstTouch()
+{
+    if constexpr (mxcmn::IsDefaultInitAllocator<Alloc>)
     {
-        for (PositionT i_rhs_qrow = 0; i_rhs_qrow < rhs.GetNumQRows(); ++i_rhs_qrow)
+        ParallelForDynamic(m_num_qrows * m_num_qcols, [&](SizeT i_tile) {
+            GetQMatrix(i_tile % m_num_qrows, i_tile / m_num_qrows).Fill(0);
+        });
+    }
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+void Matrix<T, QSize, Alloc>::Transpose(Matrix& res) const
+{
+    if (this == &res)
+    {
+        throw std::invalid_argument("res must not alias this");
+    }
+    if (res.m_num_rows != m_num_cols || res.m_num_cols != m_num_rows)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    ParallelForDynamic(m_num_qrows * m_num_qcols, [&](SizeT i_qm) {
+        const PositionT i_qrow = i_qm / m_num_qcols, i_qcol = i_qm % m_num_qcols;
+        GetQMatrix(i_qrow, i_qcol).Transpose(res.GetQMatrix(i_qcol, i_qrow));
+    });
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U>
+typename Matrix<T, QSize, Alloc>::SizeT Matrix<T, QSize, Alloc>::CalcNumTmpQMatrices(SizeT num_k_qcols) const noexcept
+{
+    switch (m_reduction)
+    {
+    case mxcmn::Reduction::Deterministic:
+    {
+        const SizeT chunk_num_qcols = std::max<SizeT>(mxcmn::DeterministicKChunk / QSize, 1);
+        return mxcmn::PairwiseSum<QMatrix>::CalcNumPartials(CalcChunkSize(num_k_qcols, chunk_num_qcols));
+    }
+    case mxcmn::Reduction::Compensated:
+        return 3; // chunk, sum, comp
+    default:
+        return std::is_same_v<T, U> ? 0 : 1; // qm_prod
+    }
+}
+
+// rhs_tr blocks are already scaled by alpha when U is T
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Alloc>::MultTile(T alpha, const Matrix<U, QSize, UAlloc>& lhs,
+                                       const qmx::QMatrix<U, QSize>* rhs_tr, T beta,
+                                       PositionT i_qrow, PositionT i_rhs_qcol, QMatrix* tmp_qms) noexcept
+{
+    auto& res_qm = GetQMatrix(i_qrow, i_rhs_qcol);
+    if (beta == T{})
+    {
+        res_qm.Fill(0);
+    }
+    else if (beta != T{1})
+    {
+        res_qm.Scale(beta);
+    }
+
+    // Narrow inputs are accumulated into qm_prod, which is added scaled by alpha
+    constexpr bool is_same_type = std::is_same_v<T, U>;
+    const bool use_qm_prod = !is_same_type && alpha != T{1};
+    if (use_qm_prod)
+    {
+        tmp_qms[0].Fill(0);
+    }
+    auto& acc_qm = use_qm_prod ? tmp_qms[0] : res_qm;
+
+    // Edge tiles only multiply their used part, the zero padding is skipped
+    const auto num_rows = CalcQExtent(m_num_rows, i_qrow);
+    const auto num_cols = CalcQExtent(m_num_cols, i_rhs_qcol);
+    for (PositionT k_qcol = 0; k_qcol < lhs.GetNumQCols(); ++k_qcol)
+    {
+        const auto num_k = CalcQExtent(lhs.m_num_cols, k_qcol);
+        acc_qm.MultAddToTransposed(lhs.GetQMatrix(i_qrow, k_qcol), rhs_tr[k_qcol * m_num_qcols + i_rhs_qcol],
+                                   num_rows, num_cols, num_k);
+    }
+
+    if (use_qm_prod)
+    {
+        res_qm.AddScaled(tmp_qms[0], alpha);
+    }
+}
+
+// Chunks are whole blocks, each one is summed into a zeroed block by the usual kernel
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Alloc>::MultTileChunked(T alpha, const Matrix<U, QSize, UAlloc>& lhs,
+                                              const qmx::QMatrix<U, QSize>* rhs_tr, T beta,
+                                              PositionT i_qrow, PositionT i_rhs_qcol, QMatrix* tmp_qms) noexcept
+{
+    const auto num_rows = CalcQExtent(m_num_rows, i_qrow);
+    const auto num_cols = CalcQExtent(m_num_cols, i_rhs_qcol);
+    const auto num_k_qcols = lhs.GetNumQCols();
+    const SizeT chunk_num_qcols = std::max<SizeT>(mxcmn::DeterministicKChunk / QSize, 1);
+
+    const bool is_compensated = m_reduction == mxcmn::Reduction::Compensated;
+    mxcmn::PairwiseSum<QMatrix> pairwise{ tmp_qms };
+    auto& compensated_sum = tmp_qms[1];
+    auto& compensated_comp = tmp_qms[2];
+    if (is_compensated)
+    {
+        compensated_sum.Fill(0);
+        compensated_comp.Fill(0);
+    }
+
+    for (PositionT k_qcol_begin = 0; k_qcol_begin < num_k_qcols; k_qcol_begin += chunk_num_qcols)
+    {
+        auto& chunk_qm = is_compensated ? tmp_qms[0] : pairwise.GetNext();
+        chunk_qm.Fill(0);
+
+        const auto k_qcol_end = std::min(k_qcol_begin + chunk_num_qcols, num_k_qcols);
+        for (PositionT k_qcol = k_qcol_begin; k_qcol < k_qcol_end; ++k_qcol)
         {
-            // Write transposed block from rhs to qm_tmp
-            rhs.GetQMatrix(i_rhs_qrow, i_rhs_qcol).Transpose(qm_tmp);
+            const auto num_k = CalcQExtent(lhs.m_num_cols, k_qcol);
+            chunk_qm.MultAddToTransposed(lhs.GetQMatrix(i_qrow, k_qcol), rhs_tr[k_qcol * m_num_qcols + i_rhs_qcol],
+                                         num_rows, num_cols, num_k);
+        }
 
-            for (PositionT k_qrow = 0; k_qrow < K; ++k_qrow)
-            {
-                const auto& lqm = GetQMatrix(k_qrow, i_rhs_qrow);
-                res.GetQMatrix(k_qrow, i_rhs_qcol).MultAddToTransposed(lqm, qm_tmp);
-            }
+        if (is_compensated)
+        {
+            mxcmn::NeumaierAdd(compensated_sum, compensated_comp, chunk_qm);
+        }
+        else
+        {
+            pairwise.Push();
         }
     }
+
+    if (is_compensated)
+    {
+        mxcmn::AddTo(compensated_sum, compensated_comp);
+    }
+    const QMatrix& sum_qm = is_compensated ? compensated_sum : pairwise.GetSum();
+
+    auto& res_qm = GetQMatrix(i_qrow, i_rhs_qcol);
+    if (beta == T{})
+    {
+        res_qm.Fill(0);
+    }
+    else if (beta != T{1})
+    {
+        res_qm.Scale(beta);
+    }
+    // rhs_tr is scaled by alpha already when U is T
+    res_qm.AddScaled(sum_qm, std::is_same_v<T, U> ? T{1} : alpha);
 }
 
-template <typename T, std::size_t QSize>
-Matrix<T, QSize>& Matrix<T, QSize>::operator*=(const Matrix& rhs)
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename UAlloc>
+void Matrix<T, QSize, Alloc>::PackRhs(T alpha, const Matrix<T, QSize, UAlloc>& rhs)
 {
-    CheckCorrectMultSize(rhs);
-    
-    Matrix<T, QSize> res{GetNumRows(), rhs.GetNumCols()};
-    res.Fill(0);
+    if (rhs.m_num_cols != m_num_cols)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
 
-    std::vector <std::thread> workers;
+    m_packed_rhs.num_rows = 0;
+    m_packed_rhs.rhs_tr.template Reserve<QMatrix>(rhs.GetNumQRows() * rhs.GetNumQCols());
+    PackRhsTo(alpha, rhs, m_packed_rhs.rhs_tr.template Get<QMatrix>());
+    m_packed_rhs.num_rows = rhs.m_num_rows;
+    m_packed_rhs.num_cols = rhs.m_num_cols;
+    m_packed_rhs.alpha = alpha;
+}
 
-    const auto i_rhs_qcol_begin_step = CalcChunkSize(rhs.GetNumQCols(), m_num_threads);
-    for (PositionT i_rhs_qcol_begin = 0; i_rhs_qcol_begin < rhs.GetNumQCols(); i_rhs_qcol_begin += i_rhs_qcol_begin_step)
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename UAlloc>
+void Matrix<T, QSize, Alloc>::GemmPacked(const Matrix<T, QSize, UAlloc>& lhs, T beta)
+{
+    if (m_packed_rhs.num_rows == 0)
     {
-        const auto i_rhs_qcol_end = std::min(i_rhs_qcol_begin + i_rhs_qcol_begin_step, rhs.GetNumQCols());
-        workers.emplace_back(&Matrix<T, QSize>::MultRow, this,
-                             std::cref(rhs), std::ref(res), i_rhs_qcol_begin, i_rhs_qcol_end);
+        throw std::logic_error("rhs is not packed");
     }
-
-    for (auto& worker : workers)
+    if (lhs.m_num_cols != m_packed_rhs.num_rows || lhs.m_num_rows != m_num_rows)
     {
-        worker.join();
+        throw std::invalid_argument("Invalide mult sizes");
     }
+    if (m_packed_rhs.num_cols != m_num_cols)
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+    const void* this_ptr = this;
+    if (this_ptr == &lhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+
+    GemmPackedFrom(m_packed_rhs.alpha, lhs, m_packed_rhs.rhs_tr.template Get<QMatrix>(), beta);
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+void Matrix<T, QSize, Alloc>::ReleaseScratch() noexcept
+{
+    m_packed_rhs.rhs_tr.Release();
+    m_packed_rhs.num_rows = m_packed_rhs.num_cols = 0;
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Alloc>::PackRhsTo(T alpha, const Matrix<U, QSize, UAlloc>& rhs,
+                                        qmx::QMatrix<U, QSize>* rhs_tr) const
+{
+    // Transpose every rhs block once instead of once per output tile
+    const auto rhs_num_qcols = rhs.GetNumQCols();
+    ParallelForDynamic(rhs.GetNumQRows() * rhs_num_qcols, [&](SizeT i_qm) {
+        const PositionT i_qrow = i_qm / rhs_num_qcols, i_qcol = i_qm % rhs_num_qcols;
+        auto& qm_tr = rhs_tr[i_qm];
+        rhs.GetQMatrix(i_qrow, i_qcol).Transpose(qm_tr);
+        if constexpr (std::is_same_v<T, U>)
+        {
+            if (alpha != T{1})
+            {
+                qm_tr.Scale(alpha);
+            }
+        }
+    });
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Alloc>::GemmPackedFrom(T alpha, const Matrix<U, QSize, UAlloc>& lhs,
+                                             const qmx::QMatrix<U, QSize>* rhs_tr, T beta)
+{
+    // Output tiles are claimed in column-major order, so neighbouring claims share
+    // the same column of rhs blocks. Temporary blocks only allocate when a thread
+    // needs more of them than ever before
+    const auto num_tmp_qms = CalcNumTmpQMatrices<U>(lhs.GetNumQCols());
+    ParallelForDynamic(m_num_qrows * m_num_qcols, [&](SizeT i_tile) {
+        auto& tmp_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Tmp);
+        tmp_arena.template Reserve<QMatrix>(num_tmp_qms);
+        auto* tmp_qms = tmp_arena.template Get<QMatrix>();
+        if (m_reduction == mxcmn::Reduction::Default)
+        {
+            MultTile(alpha, lhs, rhs_tr, beta, i_tile % m_num_qrows, i_tile / m_num_qrows, tmp_qms);
+        }
+        else
+        {
+            MultTileChunked(alpha, lhs, rhs_tr, beta, i_tile % m_num_qrows, i_tile / m_num_qrows, tmp_qms);
+        }
+    });
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+template <typename U, typename UAlloc>
+void Matrix<T, QSize, Alloc>::Gemm(T alpha, const Matrix<U, QSize, UAlloc>& lhs,
+                                   const Matrix<U, QSize, UAlloc>& rhs, T beta)
+{
+    mxcmn::CheckCorrectGemmArgs(lhs, rhs, *this);
+
+    using RhsQMatrix = qmx::QMatrix<U, QSize>;
+    auto& pack_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Pack);
+    pack_arena.template Reserve<RhsQMatrix>(rhs.GetNumQRows() * rhs.GetNumQCols());
+    auto* rhs_tr = pack_arena.template Get<RhsQMatrix>();
+
+    PackRhsTo(alpha, rhs, rhs_tr);
+    GemmPackedFrom(alpha, lhs, rhs_tr, beta);
+}
+
+template <typename T, std::size_t QSize, typename Alloc>
+Matrix<T, QSize, Alloc>& Matrix<T, QSize, Alloc>::operator*=(const Matrix& rhs)
+{
+    CheckCorrectMultSize(rhs);
+    
+    Matrix<T, QSize, Alloc> res{GetNumRows(), rhs.GetNumCols(), static_cast<int>(m_num_threads)};
+    res.SetReduction(m_reduction);
+    res.Gemm(T{1}, *this, rhs, T{0});
 
     *this = std::move(res);
     return *this;
 }
 
+// U is the element type of lhs and rhs, T of out and of the accumulator
+template <typename T, typename U, std::size_t QSize, typename Alloc, typename UAlloc>
+void Multiply(const Matrix<U, QSize, UAlloc>& lhs, const Matrix<U, QSize, UAlloc>& rhs,
+              Matrix<T, QSize, Alloc>& out)
+{
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename T, typename U, std::size_t QSize, typename Alloc, typename UAlloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const Matrix<U, QSize, UAlloc>& lhs, const Matrix<U, QSize, UAlloc>& rhs,
+          mxcmn::NonDeducedT<T> beta, Matrix<T, QSize, Alloc>& out)
+{
+    out.Gemm(alpha, lhs, rhs, beta);
+}
+
 } // namespace mxclpl
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+#include <iostream>
+
+#include "allocator.h"
+#include "matrix_view.h"
+#include "gemm_kernel.h"
+
+namespace mxgemm
+{
+
+template <typename T, typename Alloc = std::allocator<T>>
+class Matrix
+{
+public:
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+
+    static_assert(std::is_unsigned_v<PositionT>, "PositionT must be unsigned");
+    static_assert(std::is_unsigned_v<SizeT>, "SizeT must be unsigned");
+
+    class ProxyRow
+    {
+    public:
+        ProxyRow(T* row_ptr) noexcept;
+        T& operator[] (PositionT col) const noexcept;
+
+    private:
+        T* m_row_ptr;
+    };
+
+    class ProxyRowConst
+    {
+    public:
+        ProxyRowConst(const T* row_ptr) noexcept;
+        const T& operator[] (PositionT col) const noexcept;
+
+    private:
+        const T* m_row_ptr;
+    };
+
+    Matrix(SizeT num_rows, SizeT num_cols);
+    ProxyRow operator[](PositionT row) noexcept;
+    ProxyRowConst operator[](PositionT row) const noexcept;
+    Matrix& operator *= (const Matrix& rhs);
+
+    // this = alpha * lhs * rhs + beta * this, reuses the storage of this
+    void Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta);
+    // res = this^T, res must be num_cols x num_rows and not this
+    void Transpose(Matrix& res) const;
+
+    template <typename U>
+    bool operator ==(const Matrix<U, Alloc>& rhs) const noexcept;
+
+    inline SizeT GetNumCols() const noexcept;
+    inline SizeT GetNumRows() const noexcept;
+
+    // Views of the whole matrix, see matrix_view.h
+    mxcmn::MatrixView<T> GetView() noexcept;
+    mxcmn::MatrixView<const T> GetView() const noexcept;
+
+private:
+    template <typename U>
+    bool IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept;
+
+    template <typename U>
+    void CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const;
+
+
+private:
+    PositionT m_num_rows, m_num_cols;
+    std::vector<T, Alloc> m_buf;
+};
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRow::ProxyRow(T* row_ptr) noexcept
+    : m_row_ptr{ row_ptr }
+{}
+
+template <typename T, typename Alloc>
+T& Matrix<T, Alloc>::ProxyRow::operator[](PositionT col) const noexcept
+{
+    return m_row_ptr[col];
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRowConst::ProxyRowConst(const T* row_ptr) noexcept
+    : m_row_ptr{ row_ptr }
+{}
+
+template <typename T, typename Alloc>
+const T& Matrix<T, Alloc>::ProxyRowConst::operator[](PositionT col) const noexcept
+{
+    return m_row_ptr[col];
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(SizeT num_rows, SizeT num_cols)
+    : m_num_rows{ num_rows }
+    , m_num_cols{ num_cols }
+    , m_buf( num_rows * num_cols )
+{
+    if (!num_rows || !num_cols)
+    {
+        throw std::invalid_argument("num_rows and num_cols must be above zero");
+    }
+
+    mxcmn::InitStorage(m_buf, T{});
+}
+
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRow Matrix<T, Alloc>::operator[] (PositionT row) noexcept
+{
+    return { m_buf.data() + row * m_num_cols };
+}
+
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRowConst Matrix<T, Alloc>::operator[] (PositionT row) const noexcept
+{
+    return { m_buf.data() + row * m_num_cols };
+}
+
+template<typename T, typename Alloc>
+template <typename U>
+bool Matrix<T, Alloc>::operator ==(const Matrix<U, Alloc>& rhs) const noexcept
+{
+    return m_buf == rhs.m_buf;
+}
+
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumCols() const noexcept
+{
+    return m_num_cols;
+}
+
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumRows() const noexcept
+{
+    return m_num_rows;
+}
+
+template <typename T, typename Alloc>
+mxcmn::MatrixView<T> Matrix<T, Alloc>::GetView() noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+mxcmn::MatrixView<const T> Matrix<T, Alloc>::GetView() const noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Transpose(Matrix& res) const
+{
+    if (this == &res)
+    {
+        throw std::invalid_argument("res must not alias this");
+    }
+
+    mxcmn::Transpose<T>(GetView(), res.GetView());
+}
+
+template <typename T, typename Alloc>
+std::ostream& operator <<(std::ostream& os, const Matrix<T, Alloc>& matrix)
+{
+    const std::size_t num_cols = matrix.GetNumCols();
+    const std::size_t num_rows = matrix.GetNumRows();
+
+    os << '{';
+    for (std::size_t i_row = 0; i_row < num_rows; ++i_row)
+    {
+        const auto& row = matrix[i_row];
+        os << row[0];
+        for (std::size_t i_col = 1; i_col < num_cols; ++i_col)
+        {
+            os << ',' << row[i_col];
+        }
+        os << ';';
+    }
+
+    return os << '}';
+}
+
+template <typename T, typename Alloc>
+template <typename U>
+bool Matrix<T, Alloc>::IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept
+{
+    return m_num_cols == rhs.m_num_rows;
+}
+
+template <typename T, typename Alloc>
+template <typename U>
+void Matrix<T, Alloc>::CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const
+{
+    if (!IsCorrectMultSize(rhs))
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+}
+
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta)
+{
+    mxcmn::CheckCorrectGemmArgs(lhs, rhs, *this);
+
+    kernel::Gemm<T>(lhs.m_num_rows, rhs.m_num_cols, lhs.m_num_cols, alpha,
+                    lhs.m_buf.data(), lhs.m_num_cols, 1, rhs.m_buf.data(), rhs.m_num_cols, 1,
+                    beta, m_buf.data(), m_num_cols);
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>& Matrix<T, Alloc>::operator *=(const Matrix& rhs)
+{
+    CheckCorrectMultSize(rhs);
+
+    Matrix<T, Alloc> res_matrix{m_num_rows, rhs.m_num_cols};
+    res_matrix.Gemm(T{1}, *this, rhs, T{0});
+
+    *this = std::move(res_matrix);
+
+    return *this;
+}
+
+template <typename T, typename Alloc>
+void Multiply(const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs, Matrix<T, Alloc>& out)
+{
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename T, typename Alloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs,
+          mxcmn::NonDeducedT<T> beta, Matrix<T, Alloc>& out)
+{
+    out.Gemm(alpha, lhs, rhs, beta);
+}
+
+// Packed GEMM on views: any strides of lhs and rhs (transposed, sub-blocks) cost
+// nothing extra since they are packed anyway. out with non-unit column stride goes
+// to mxcmn::Gemm
+template <typename T>
+void Gemm(mxcmn::NonDeducedT<T> alpha, mxcmn::NonDeducedT<mxcmn::MatrixView<const T>> lhs,
+          mxcmn::NonDeducedT<mxcmn::MatrixView<const T>> rhs, mxcmn::NonDeducedT<T> beta,
+          mxcmn::MatrixView<T> out)
+{
+    if (out.GetColStride() != 1)
+    {
+        mxcmn::Gemm<T>(alpha, lhs, rhs, beta, out);
+        return;
+    }
+
+    mxcmn::CheckCorrectGemmArgs<T>(lhs, rhs, out);
+    kernel::Gemm<T>(out.GetNumRows(), out.GetNumCols(), lhs.GetNumCols(), alpha,
+                    lhs.GetData(), lhs.GetRowStride(), lhs.GetColStride(),
+                    rhs.GetData(), rhs.GetRowStride(), rhs.GetColStride(),
+                    beta, out.GetData(), out.GetRowStride());
+}
+
+} // namespace mxgemm
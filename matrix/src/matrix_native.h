@@ -2,13 +2,17 @@
 
 #include <stdexcept>
 #include <vector>
+#include <memory>
 #include <iosfwd>
 #include <iostream>
 
+#include "allocator.h"
+#include "matrix_view.h"
+
 namespace mxnv
 {
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 class Matrix
 {
 public:
@@ -43,48 +47,58 @@ public:
     ProxyRowConst operator[](PositionT row) const noexcept;
     Matrix& operator *= (const Matrix& rhs);
 
+    // this = alpha * lhs * rhs + beta * this, reuses the storage of this
+    void Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta);
+    // res = this^T, res must be num_cols x num_rows and not this
+    void Transpose(Matrix& res) const;
+
     template <typename U>
-    bool operator ==(const Matrix<U>& rhs) const noexcept;
+    bool operator ==(const Matrix<U, Alloc>& rhs) const noexcept;
 
     inline SizeT GetNumCols() const noexcept;
     inline SizeT GetNumRows() const noexcept;
 
+    // Views of the whole matrix, see matrix_view.h
+    mxcmn::MatrixView<T> GetView() noexcept;
+    mxcmn::MatrixView<const T> GetView() const noexcept;
+
 private:
     template <typename U>
-    bool IsCorrectMultSize(const Matrix<U>& rhs) const noexcept;
+    bool IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept;
 
     template <typename U>
-    void CheckCorrectMultSize(const Matrix<U>& rhs) const;
+    void CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const;
+
 
 private:
     PositionT m_num_rows, m_num_cols;
-    std::vector<T> m_buf;
+    std::vector<T, Alloc> m_buf;
 };
 
-template <typename T>
-Matrix<T>::ProxyRow::ProxyRow(T* row_ptr) noexcept
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRow::ProxyRow(T* row_ptr) noexcept
     : m_row_ptr{ row_ptr }
 {}
 
-template <typename T>
-T& Matrix<T>::ProxyRow::operator[](PositionT col) const noexcept
+template <typename T, typename Alloc>
+T& Matrix<T, Alloc>::ProxyRow::operator[](PositionT col) const noexcept
 {
     return m_row_ptr[col];
 }
 
-template <typename T>
-Matrix<T>::ProxyRowConst::ProxyRowConst(const T* row_ptr) noexcept
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRowConst::ProxyRowConst(const T* row_ptr) noexcept
     : m_row_ptr{ row_ptr }
 {}
 
-template <typename T>
-const T& Matrix<T>::ProxyRowConst::operator[](PositionT col) const noexcept
+template <typename T, typename Alloc>
+const T& Matrix<T, Alloc>::ProxyRowConst::operator[](PositionT col) const noexcept
 {
     return m_row_ptr[col];
 }
 
-template <typename T>
-Matrix<T>::Matrix(SizeT num_rows, SizeT num_cols)
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(SizeT num_rows, SizeT num_cols)
     : m_num_rows{ num_rows }
     , m_num_cols{ num_cols }
     , m_buf( num_rows * num_cols )
@@ -93,41 +107,66 @@ Matrix<T>::Matrix(SizeT num_rows, SizeT num_cols)
     {
         throw std::invalid_argument("num_rows and num_cols must be above zero");
     }
+
+    mxcmn::InitStorage(m_buf, T{});
 }
 
-template<typename T>
-typename Matrix<T>::ProxyRow Matrix<T>::operator[] (PositionT row) noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRow Matrix<T, Alloc>::operator[] (PositionT row) noexcept
 {
     return { m_buf.data() + row * m_num_cols };
 }
 
-template<typename T>
-typename Matrix<T>::ProxyRowConst Matrix<T>::operator[] (PositionT row) const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRowConst Matrix<T, Alloc>::operator[] (PositionT row) const noexcept
 {
     return { m_buf.data() + row * m_num_cols };
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template <typename U>
-bool Matrix<T>::operator ==(const Matrix<U>& rhs) const noexcept
+bool Matrix<T, Alloc>::operator ==(const Matrix<U, Alloc>& rhs) const noexcept
 {
     return m_buf == rhs.m_buf;
 }
 
-template<typename T>
-typename Matrix<T>::SizeT Matrix<T>::GetNumCols() const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumCols() const noexcept
 {
     return m_num_cols;
 }
 
-template<typename T>
-typename Matrix<T>::SizeT Matrix<T>::GetNumRows() const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumRows() const noexcept
 {
     return m_num_rows;
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const Matrix<T>& matrix)
+template <typename T, typename Alloc>
+mxcmn::MatrixView<T> Matrix<T, Alloc>::GetView() noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+mxcmn::MatrixView<const T> Matrix<T, Alloc>::GetView() const noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Transpose(Matrix& res) const
+{
+    if (this == &res)
+    {
+        throw std::invalid_argument("res must not alias this");
+    }
+
+    mxcmn::Transpose<T>(GetView(), res.GetView());
+}
+
+template <typename T, typename Alloc>
+std::ostream& operator <<(std::ostream& os, const Matrix<T, Alloc>& matrix)
 {
     const std::size_t num_cols = matrix.GetNumCols();
     const std::size_t num_rows = matrix.GetNumRows();
@@ -147,16 +186,16 @@ std::ostream& operator <<(std::ostream& os, const Matrix<T>& matrix)
     return os << '}';
 }
 
-template <typename T>
+template <typename T, typename Alloc>
 template <typename U>
-bool Matrix<T>::IsCorrectMultSize(const Matrix<U>& rhs) const noexcept
+bool Matrix<T, Alloc>::IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept
 {
     return m_num_cols == rhs.m_num_rows;
 }
 
-template <typename T>
+template <typename T, typename Alloc>
 template <typename U>
-void Matrix<T>::CheckCorrectMultSize(const Matrix<U>& rhs) const
+void Matrix<T, Alloc>::CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const
 {
     if (!IsCorrectMultSize(rhs))
     {
@@ -164,32 +203,52 @@ void Matrix<T>::CheckCorrectMultSize(const Matrix<U>& rhs) const
     }
 }
 
-template <typename T>
-Matrix<T>& Matrix<T>::operator *=(const Matrix& rhs)
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta)
 {
-    CheckCorrectMultSize(rhs);
-
-    Matrix<T> res_matrix{m_num_rows, rhs.m_num_cols};
+    mxcmn::CheckCorrectGemmArgs(lhs, rhs, *this);
 
-    for (PositionT i_left_row = 0; i_left_row < m_num_rows; ++i_left_row)
+    for (PositionT i_left_row = 0; i_left_row < lhs.m_num_rows; ++i_left_row)
     {
-        const auto& row = (*this)[i_left_row];
+        const auto& row = lhs[i_left_row];
         
         for (PositionT i_right_col = 0; i_right_col < rhs.m_num_cols; ++i_right_col)
         {
             T res{};
-            for (PositionT k = 0; k < m_num_cols; ++k)
+            for (PositionT k = 0; k < lhs.m_num_cols; ++k)
             {
                 res += row[k] * rhs[k][i_right_col];
             }
 
-            res_matrix[i_left_row][i_right_col] = res;
+            mxcmn::StoreScaled((*this)[i_left_row][i_right_col], res, alpha, beta);
         }
     }
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>& Matrix<T, Alloc>::operator *=(const Matrix& rhs)
+{
+    CheckCorrectMultSize(rhs);
+
+    Matrix<T, Alloc> res_matrix{m_num_rows, rhs.m_num_cols};
+    res_matrix.Gemm(T{1}, *this, rhs, T{0});
 
     *this = std::move(res_matrix);
 
     return *this;
 }
 
+template <typename T, typename Alloc>
+void Multiply(const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs, Matrix<T, Alloc>& out)
+{
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename T, typename Alloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs,
+          mxcmn::NonDeducedT<T> beta, Matrix<T, Alloc>& out)
+{
+    out.Gemm(alpha, lhs, rhs, beta);
+}
+
 } // namespace mxnv
@@ -2,14 +2,20 @@
 
 #include <stdexcept>
 #include <vector>
+#include <memory>
 #include <thread>
 #include <iosfwd>
 #include <iostream>
 
+#include "allocator.h"
+#include "matrix_view.h"
+#include "thread_pool.h"
+#include "reduction.h"
+
 namespace mxnvpl
 {
 
-template <typename T>
+template <typename T, typename Alloc = std::allocator<T>>
 class Matrix
 {
 public:
@@ -44,56 +50,77 @@ public:
     ProxyRowConst operator[](PositionT row) const noexcept;
     Matrix& operator *= (const Matrix& rhs);
 
+    // this = alpha * lhs * rhs + beta * this, reuses the storage of this
+    void Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta);
+    // res = this^T, res must be num_cols x num_rows and not this
+    void Transpose(Matrix& res) const;
+
     template <typename U>
-    bool operator ==(const Matrix<U>& rhs) const noexcept;
+    bool operator ==(const Matrix<U, Alloc>& rhs) const noexcept;
 
     inline SizeT GetNumCols() const noexcept;
     inline SizeT GetNumRows() const noexcept;
 
+    // Order of the k sums of Gemm into this, see reduction.h
+    void SetReduction(mxcmn::Reduction reduction) noexcept { m_reduction = reduction; }
+    mxcmn::Reduction GetReduction() const noexcept { return m_reduction; }
+
+    // Views of the whole matrix, see matrix_view.h
+    mxcmn::MatrixView<T> GetView() noexcept;
+    mxcmn::MatrixView<const T> GetView() const noexcept;
+
 private:
     template <typename U>
-    bool IsCorrectMultSize(const Matrix<U>& rhs) const noexcept;
+    bool IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept;
 
     template <typename U>
-    void CheckCorrectMultSize(const Matrix<U>& rhs) const;
+    void CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const;
+
 
     // Multithreading
     static unsigned CalcNumThreads(int num_threads) noexcept;
-    void MultRow(const Matrix& rhs, Matrix& res, PositionT i_rhs_col_begin, PositionT i_rhs_col_end) noexcept;
+    // Zeroes storage of a default-init allocator from the pool workers, see allocator.h
+    void FirstTouch();
+    void MultRow(T alpha, const Matrix& lhs, const Matrix& rhs, T beta,
+                 PositionT i_rhs_col_begin, PositionT i_rhs_col_end) noexcept;
+    // MultRow with k cut into chunks of DeterministicKChunk, see reduction.h
+    void MultRowChunked(T alpha, const Matrix& lhs, const Matrix& rhs, T beta,
+                        PositionT i_rhs_col_begin, PositionT i_rhs_col_end);
 
 private:
     PositionT m_num_rows, m_num_cols;
-    std::vector<T> m_buf;
+    std::vector<T, Alloc> m_buf;
     unsigned m_num_threads;
+    mxcmn::Reduction m_reduction = mxcmn::Reduction::Default;
 };
 
 // ProxyRow implementation ------------------------------------------------------------------------
 
-template <typename T>
-Matrix<T>::ProxyRow::ProxyRow(T* row_ptr) noexcept
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRow::ProxyRow(T* row_ptr) noexcept
     : m_row_ptr{ row_ptr }
 {}
 
-template <typename T>
-T& Matrix<T>::ProxyRow::operator[](PositionT col) const noexcept
+template <typename T, typename Alloc>
+T& Matrix<T, Alloc>::ProxyRow::operator[](PositionT col) const noexcept
 {
     return m_row_ptr[col];
 }
 
-template <typename T>
-Matrix<T>::ProxyRowConst::ProxyRowConst(const T* row_ptr) noexcept
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::ProxyRowConst::ProxyRowConst(const T* row_ptr) noexcept
     : m_row_ptr{ row_ptr }
 {}
 
-template <typename T>
-const T& Matrix<T>::ProxyRowConst::operator[](PositionT col) const noexcept
+template <typename T, typename Alloc>
+const T& Matrix<T, Alloc>::ProxyRowConst::operator[](PositionT col) const noexcept
 {
     return m_row_ptr[col];
 }
 
 // Matrix implementation --------------------------------------------------------------------------
-template <typename T>
-unsigned Matrix<T>::CalcNumThreads(int num_threads) noexcept
+template <typename T, typename Alloc>
+unsigned Matrix<T, Alloc>::CalcNumThreads(int num_threads) noexcept
 {
     unsigned delim = 1;
     #ifdef __amd64__
@@ -104,8 +131,8 @@ unsigned Matrix<T>::CalcNumThreads(int num_threads) noexcept
     return num_threads <= 0 ? std::max(std::thread::hardware_concurrency() / delim, 1u) : num_threads;
 }
 
-template <typename T>
-Matrix<T>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
+template <typename T, typename Alloc>
+Matrix<T, Alloc>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
     : m_num_rows{ num_rows }
     , m_num_cols{ num_cols }
     , m_buf( num_rows * num_cols )
@@ -115,41 +142,55 @@ Matrix<T>::Matrix(SizeT num_rows, SizeT num_cols, int num_threads)
     {
         throw std::invalid_argument("num_rows and num_cols must be above zero");
     }
+
+    FirstTouch();
 }
 
-template<typename T>
-typename Matrix<T>::ProxyRow Matrix<T>::operator[] (PositionT row) noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRow Matrix<T, Alloc>::operator[] (PositionT row) noexcept
 {
     return { m_buf.data() + row * m_num_cols };
 }
 
-template<typename T>
-typename Matrix<T>::ProxyRowConst Matrix<T>::operator[] (PositionT row) const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::ProxyRowConst Matrix<T, Alloc>::operator[] (PositionT row) const noexcept
 {
     return { m_buf.data() + row * m_num_cols };
 }
 
-template<typename T>
+template<typename T, typename Alloc>
 template <typename U>
-bool Matrix<T>::operator ==(const Matrix<U>& rhs) const noexcept
+bool Matrix<T, Alloc>::operator ==(const Matrix<U, Alloc>& rhs) const noexcept
 {
     return m_buf == rhs.m_buf;
 }
 
-template<typename T>
-typename Matrix<T>::SizeT Matrix<T>::GetNumCols() const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumCols() const noexcept
 {
     return m_num_cols;
 }
 
-template<typename T>
-typename Matrix<T>::SizeT Matrix<T>::GetNumRows() const noexcept
+template<typename T, typename Alloc>
+typename Matrix<T, Alloc>::SizeT Matrix<T, Alloc>::GetNumRows() const noexcept
 {
     return m_num_rows;
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const Matrix<T>& matrix)
+template <typename T, typename Alloc>
+mxcmn::MatrixView<T> Matrix<T, Alloc>::GetView() noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+mxcmn::MatrixView<const T> Matrix<T, Alloc>::GetView() const noexcept
+{
+    return { m_buf.data(), m_num_rows, m_num_cols, static_cast<std::ptrdiff_t>(m_num_cols) };
+}
+
+template <typename T, typename Alloc>
+std::ostream& operator <<(std::ostream& os, const Matrix<T, Alloc>& matrix)
 {
     const std::size_t num_cols = matrix.GetNumCols();
     const std::size_t num_rows = matrix.GetNumRows();
@@ -169,16 +210,16 @@ std::ostream& operator <<(std::ostream& os, const Matrix<T>& matrix)
     return os << '}';
 }
 
-template <typename T>
+template <typename T, typename Alloc>
 template <typename U>
-bool Matrix<T>::IsCorrectMultSize(const Matrix<U>& rhs) const noexcept
+bool Matrix<T, Alloc>::IsCorrectMultSize(const Matrix<U, Alloc>& rhs) const noexcept
 {
     return m_num_cols == rhs.m_num_rows;
 }
 
-template <typename T>
+template <typename T, typename Alloc>
 template <typename U>
-void Matrix<T>::CheckCorrectMultSize(const Matrix<U>& rhs) const
+void Matrix<T, Alloc>::CheckCorrectMultSize(const Matrix<U, Alloc>& rhs) const
 {
     if (!IsCorrectMultSize(rhs))
     {
@@ -186,13 +227,14 @@ void Matrix<T>::CheckCorrectMultSize(const Matrix<U>& rhs) const
     }
 }
 
-template <typename T>
-void Matrix<T>::MultRow(const Matrix& rhs, Matrix& res, PositionT i_rhs_col_begin, PositionT i_rhs_col_end) noexcept
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::MultRow(T alpha, const Matrix& lhs, const Matrix& rhs, T beta,
+                        PositionT i_rhs_col_begin, PositionT i_rhs_col_end) noexcept
 {
-    const auto K = GetNumCols();
-    for (PositionT i_left_row = 0; i_left_row < GetNumRows(); ++i_left_row)
+    const auto K = lhs.GetNumCols();
+    for (PositionT i_left_row = 0; i_left_row < lhs.GetNumRows(); ++i_left_row)
     {
-        const auto& row = (*this)[i_left_row];
+        const auto& row = lhs[i_left_row];
         
         for (PositionT i_right_col = i_rhs_col_begin; i_right_col < i_rhs_col_end; ++i_right_col)
         {
@@ -202,7 +244,50 @@ void Matrix<T>::MultRow(const Matrix& rhs, Matrix& res, PositionT i_rhs_col_begi
                 value += row[k] * rhs[k][i_right_col];
             }
 
-            res[i_left_row][i_right_col] = value;
+            mxcmn::StoreScaled((*this)[i_left_row][i_right_col], value, alpha, beta);
+        }
+    }
+}
+
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::MultRowChunked(T alpha, const Matrix& lhs, const Matrix& rhs, T beta,
+                                      PositionT i_rhs_col_begin, PositionT i_rhs_col_end)
+{
+    const auto K = lhs.GetNumCols();
+    const bool is_compensated = m_reduction == mxcmn::Reduction::Compensated;
+    mxcmn::PairwiseSum<T> pairwise{ K / mxcmn::DeterministicKChunk + 1 };
+
+    for (PositionT i_left_row = 0; i_left_row < lhs.GetNumRows(); ++i_left_row)
+    {
+        const auto& row = lhs[i_left_row];
+
+        for (PositionT i_right_col = i_rhs_col_begin; i_right_col < i_rhs_col_end; ++i_right_col)
+        {
+            T sum{}, comp{};
+            pairwise.Reset();
+            for (PositionT k_begin = 0; k_begin < K; k_begin += mxcmn::DeterministicKChunk)
+            {
+                const auto k_end = std::min(k_begin + mxcmn::DeterministicKChunk, K);
+
+                T value{};
+                for (PositionT k = k_begin; k < k_end; ++k)
+                {
+                    value += row[k] * rhs[k][i_right_col];
+                }
+
+                if (is_compensated)
+                {
+                    mxcmn::NeumaierAdd(sum, comp, value);
+                }
+                else
+                {
+                    pairwise.GetNext() = value;
+                    pairwise.Push();
+                }
+            }
+
+            const T value = is_compensated ? sum + comp : pairwise.GetSum();
+            mxcmn::StoreScaled((*this)[i_left_row][i_right_col], value, alpha, beta);
         }
     }
 }
@@ -213,30 +298,90 @@ auto CalcChunkSize(T size, U step)
     return size / step + (size % step != 0);
 }
 
-template <typename T>
-Matrix<T>& Matrix<T>::operator *=(const Matrix& rhs)
+// Stripes of rows: the column stripes of MultRow are narrower than a page
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::FirstTouch()
 {
-    CheckCorrectMultSize(rhs);
+    if constexpr (mxcmn::IsDefaultInitAllocator<Alloc>)
+    {
+        const auto i_row_begin_step = CalcChunkSize(m_num_rows, m_num_threads);
+        const auto num_tasks = CalcChunkSize(m_num_rows, i_row_begin_step);
+        mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+            const PositionT i_row_begin = i_task * i_row_begin_step;
+            const auto i_row_end = std::min(i_row_begin + i_row_begin_step, m_num_rows);
+            std::fill(m_buf.begin() + i_row_begin * m_num_cols, m_buf.begin() + i_row_end * m_num_cols, T{});
+        });
+    }
+}
 
-    Matrix<T> res{GetNumRows(), rhs.GetNumCols()};
-    
-    std::vector <std::thread> workers;
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Gemm(T alpha, const Matrix& lhs, const Matrix& rhs, T beta)
+{
+    mxcmn::CheckCorrectGemmArgs(lhs, rhs, *this);
 
     const auto i_rhs_col_begin_step = CalcChunkSize(rhs.GetNumCols(), m_num_threads);
-    for (PositionT i_rhs_col_begin = 0; i_rhs_col_begin < rhs.GetNumCols(); i_rhs_col_begin += i_rhs_col_begin_step)
-    {
+    const auto num_tasks = CalcChunkSize(rhs.GetNumCols(), i_rhs_col_begin_step);
+    mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+        const PositionT i_rhs_col_begin = i_task * i_rhs_col_begin_step;
         const auto i_rhs_col_end = std::min(i_rhs_col_begin + i_rhs_col_begin_step, rhs.GetNumCols());
-        workers.emplace_back(&Matrix<T>::MultRow, this,
-                             std::cref(rhs), std::ref(res), i_rhs_col_begin, i_rhs_col_end);
-    }
+        if (m_reduction == mxcmn::Reduction::Default)
+        {
+            MultRow(alpha, lhs, rhs, beta, i_rhs_col_begin, i_rhs_col_end);
+        }
+        else
+        {
+            MultRowChunked(alpha, lhs, rhs, beta, i_rhs_col_begin, i_rhs_col_end);
+        }
+    });
+}
 
-    for (auto& worker : workers)
+template <typename T, typename Alloc>
+void Matrix<T, Alloc>::Transpose(Matrix& res) const
+{
+    if (this == &res)
+    {
+        throw std::invalid_argument("res must not alias this");
+    }
+    if (res.m_num_rows != m_num_cols || res.m_num_cols != m_num_rows)
     {
-        worker.join();
+        throw std::invalid_argument("Invalide out size");
     }
 
+    // Every task writes its own stripe of rows of res, the same one FirstTouch gave it
+    const auto i_col_begin_step = CalcChunkSize(m_num_cols, res.m_num_threads);
+    const auto num_tasks = CalcChunkSize(m_num_cols, i_col_begin_step);
+    mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+        const PositionT i_col_begin = i_task * i_col_begin_step;
+        const auto i_col_end = std::min(i_col_begin + i_col_begin_step, m_num_cols);
+        mxcmn::Transpose<T>(GetView().Sub(0, i_col_begin, m_num_rows, i_col_end - i_col_begin),
+                            res.GetView().Sub(i_col_begin, 0, i_col_end - i_col_begin, m_num_rows));
+    });
+}
+
+template <typename T, typename Alloc>
+Matrix<T, Alloc>& Matrix<T, Alloc>::operator *=(const Matrix& rhs)
+{
+    CheckCorrectMultSize(rhs);
+
+    Matrix<T, Alloc> res{GetNumRows(), rhs.GetNumCols(), static_cast<int>(m_num_threads)};
+    res.SetReduction(m_reduction);
+    res.Gemm(T{1}, *this, rhs, T{0});
+
     *this = std::move(res);
     return *this;
 }
 
+template <typename T, typename Alloc>
+void Multiply(const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs, Matrix<T, Alloc>& out)
+{
+    out.Gemm(T{1}, lhs, rhs, T{0});
+}
+
+template <typename T, typename Alloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const Matrix<T, Alloc>& lhs, const Matrix<T, Alloc>& rhs,
+          mxcmn::NonDeducedT<T> beta, Matrix<T, Alloc>& out)
+{
+    out.Gemm(alpha, lhs, rhs, beta);
+}
+
 } // namespace mxnv
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "matrix_cachelike.h"
+
+namespace mxcl
+{
+
+// Row-major window of a block grid
+template <typename QMatrix>
+struct QGridView
+{
+    using SizeT = mxcmn::SizeT;
+    using PositionT = mxcmn::PositionT;
+
+    QMatrix& At(PositionT i_qrow, PositionT i_qcol) const noexcept
+    {
+        return m_ptr[i_qrow * m_ld + i_qcol];
+    }
+
+    QGridView Sub(PositionT i_qrow, PositionT i_qcol, SizeT num_qrows, SizeT num_qcols) const noexcept
+    {
+        return { &At(i_qrow, i_qcol), m_ld, num_qrows, num_qcols };
+    }
+
+    operator QGridView<const QMatrix>() const noexcept
+    {
+        return { m_ptr, m_ld, m_num_qrows, m_num_qcols };
+    }
+
+    QMatrix* m_ptr;
+    std::size_t m_ld;
+    SizeT m_num_qrows, m_num_qcols;
+};
+
+// Stack of temporary blocks. Memory is reserved once, then Push/PopTo only move the top
+template <typename QMatrix>
+class QArena
+{
+public:
+    using SizeT = mxcmn::SizeT;
+
+    explicit QArena(std::size_t num_qmatrices = 0);
+
+    // Must be called while the arena is empty, previously pushed views are invalidated
+    void Reserve(std::size_t num_qmatrices);
+    QGridView<QMatrix> Push(SizeT num_qrows, SizeT num_qcols);
+    std::size_t GetTop() const noexcept { return m_top; }
+    void PopTo(std::size_t top) noexcept { m_top = top; }
+
+private:
+    std::vector<QMatrix> m_buf;
+    std::size_t m_top;
+};
+
+template <typename QMatrix>
+QArena<QMatrix>::QArena(std::size_t num_qmatrices)
+    : m_buf(num_qmatrices), m_top{ 0 }
+{}
+
+template <typename QMatrix>
+void QArena<QMatrix>::Reserve(std::size_t num_qmatrices)
+{
+    if (m_top != 0)
+    {
+        throw std::logic_error("QArena::Reserve on non-empty arena");
+    }
+    if (m_buf.size() < num_qmatrices)
+    {
+        m_buf.resize(num_qmatrices);
+    }
+}
+
+template <typename QMatrix>
+QGridView<QMatrix> QArena<QMatrix>::Push(SizeT num_qrows, SizeT num_qcols)
+{
+    const std::size_t num_qmatrices = std::size_t{ num_qrows } * num_qcols;
+    if (m_top + num_qmatrices > m_buf.size())
+    {
+        throw std::length_error("QArena is exhausted");
+    }
+
+    QGridView<QMatrix> view{ m_buf.data() + m_top, num_qcols, num_qrows, num_qcols };
+    m_top += num_qmatrices;
+    return view;
+}
+
+namespace strassen
+{
+
+using SizeT = mxcmn::SizeT;
+using PositionT = mxcmn::PositionT;
+
+// Read-only operand, kept out of template argument deduction so mutable views convert to it
+template <typename QMatrix>
+using ConstView = mxcmn::NonDeducedT<QGridView<const QMatrix>>;
+
+// Products with at most this many blocks along some side use the classic blocked multiply
+constexpr SizeT DefaultCutoff = 8;
+
+// dst = op(lhs, rhs) block by block, dst may alias lhs or rhs
+template <typename QMatrix, typename Op>
+void Combine(QGridView<QMatrix> dst, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs, Op op) noexcept
+{
+    for (PositionT i_qrow = 0; i_qrow < dst.m_num_qrows; ++i_qrow)
+    {
+        for (PositionT i_qcol = 0; i_qcol < dst.m_num_qcols; ++i_qcol)
+        {
+            auto& dst_buf = dst.At(i_qrow, i_qcol).m_buf;
+            const auto& lhs_buf = lhs.At(i_qrow, i_qcol).m_buf;
+            const auto& rhs_buf = rhs.At(i_qrow, i_qcol).m_buf;
+
+            for (std::size_t i_row = 0; i_row < dst_buf.size(); ++i_row)
+            {
+                for (std::size_t i_col = 0; i_col < dst_buf[i_row].size(); ++i_col)
+                {
+                    dst_buf[i_row][i_col] = op(lhs_buf[i_row][i_col], rhs_buf[i_row][i_col]);
+                }
+            }
+        }
+    }
+}
+
+template <typename QMatrix>
+void Add(QGridView<QMatrix> dst, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs) noexcept
+{
+    Combine(dst, lhs, rhs, std::plus<>{});
+}
+
+template <typename QMatrix>
+void Sub(QGridView<QMatrix> dst, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs) noexcept
+{
+    Combine(dst, lhs, rhs, std::minus<>{});
+}
+
+template <typename QMatrix>
+void FillZero(QGridView<QMatrix> dst) noexcept
+{
+    for (PositionT i_qrow = 0; i_qrow < dst.m_num_qrows; ++i_qrow)
+    {
+        for (PositionT i_qcol = 0; i_qcol < dst.m_num_qcols; ++i_qcol)
+        {
+            dst.At(i_qrow, i_qcol).Fill(0);
+        }
+    }
+}
+
+// res += lhs * rhs with the same loop order as mxcl::Matrix::Gemm
+template <typename QMatrix>
+void MultAddClassic(QGridView<QMatrix> res, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs,
+                    QMatrix& qm_tmp) noexcept
+{
+    for (PositionT i_rhs_qrow = 0; i_rhs_qrow < rhs.m_num_qrows; ++i_rhs_qrow)
+    {
+        for (PositionT i_rhs_qcol = 0; i_rhs_qcol < rhs.m_num_qcols; ++i_rhs_qcol)
+        {
+            rhs.At(i_rhs_qrow, i_rhs_qcol).Transpose(qm_tmp);
+            for (PositionT k_qrow = 0; k_qrow < lhs.m_num_qrows; ++k_qrow)
+            {
+                res.At(k_qrow, i_rhs_qcol).MultAddToTransposed(lhs.At(k_qrow, i_rhs_qrow), qm_tmp);
+            }
+        }
+    }
+}
+
+inline bool IsLeaf(SizeT m, SizeT k, SizeT n, SizeT cutoff) noexcept
+{
+    return std::min({ m, k, n }) <= std::max<SizeT>(cutoff, 1);
+}
+
+// Number of blocks the recursion for a m x k x n block product takes from the arena
+inline std::size_t CalcArenaSize(SizeT m, SizeT k, SizeT n, SizeT cutoff) noexcept
+{
+    std::size_t size = 1; // qm_tmp of the classic multiply
+    while (!IsLeaf(m, k, n, cutoff))
+    {
+        m /= 2, k /= 2, n /= 2;
+        size += std::size_t{ m } * k + std::size_t{ k } * n + std::size_t{ m } * n;
+    }
+    return size;
+}
+
+template <typename QMatrix>
+void Multiply(QGridView<QMatrix> res, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs,
+              SizeT cutoff, QArena<QMatrix>& arena, QMatrix& qm_tmp);
+
+// Strassen-Winograd step for even m, k, n with the temporaries schedule of
+// Douglas et al. (DGEFMM): three temporaries per level, C quadrants are reused as workspace
+template <typename QMatrix>
+void MultiplyEven(QGridView<QMatrix> res, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs,
+                  SizeT cutoff, QArena<QMatrix>& arena, QMatrix& qm_tmp)
+{
+    const SizeT m = lhs.m_num_qrows / 2, k = lhs.m_num_qcols / 2, n = rhs.m_num_qcols / 2;
+
+    const auto a11 = lhs.Sub(0, 0, m, k), a12 = lhs.Sub(0, k, m, k);
+    const auto a21 = lhs.Sub(m, 0, m, k), a22 = lhs.Sub(m, k, m, k);
+    const auto b11 = rhs.Sub(0, 0, k, n), b12 = rhs.Sub(0, n, k, n);
+    const auto b21 = rhs.Sub(k, 0, k, n), b22 = rhs.Sub(k, n, k, n);
+    const auto c11 = res.Sub(0, 0, m, n), c12 = res.Sub(0, n, m, n);
+    const auto c21 = res.Sub(m, 0, m, n), c22 = res.Sub(m, n, m, n);
+
+    const auto top = arena.GetTop();
+    const auto x = arena.Push(m, k);
+    const auto y = arena.Push(k, n);
+    const auto z = arena.Push(m, n);
+
+    Sub(x, a11, a21);                                  // S3 = A11 - A21
+    Sub(y, b22, b12);                                  // T3 = B22 - B12
+    Multiply(c21, x, y, cutoff, arena, qm_tmp);        // P7 = S3 * T3
+    Add(x, a21, a22);                                  // S1 = A21 + A22
+    Sub(y, b12, b11);                                  // T1 = B12 - B11
+    Multiply(c22, x, y, cutoff, arena, qm_tmp);        // P5 = S1 * T1
+    Sub(x, x, a11);                                    // S2 = S1 - A11
+    Sub(y, b22, y);                                    // T2 = B22 - T1
+    Multiply(c12, x, y, cutoff, arena, qm_tmp);        // P6 = S2 * T2
+    Sub(x, a12, x);                                    // S4 = A12 - S2
+    Multiply(c11, x, b22, cutoff, arena, qm_tmp);      // P3 = S4 * B22
+    Multiply(z, a11, b11, cutoff, arena, qm_tmp);      // P1 = A11 * B11
+    Add(c12, c12, z);                                  // U2 = P1 + P6
+    Add(c21, c21, c12);                                // U3 = U2 + P7
+    Add(c12, c12, c22);                                // U4 = U2 + P5
+    Add(c22, c22, c21);                                // U7 = U3 + P5 = C22
+    Add(c12, c12, c11);                                // U5 = U4 + P3 = C12
+    Sub(y, y, b21);                                    // T4 = T2 - B21
+    Multiply(c11, a22, y, cutoff, arena, qm_tmp);      // P4 = A22 * T4
+    Sub(c21, c21, c11);                                // U6 = U3 - P4 = C21
+    Multiply(c11, a12, b21, cutoff, arena, qm_tmp);    // P2 = A12 * B21
+    Add(c11, c11, z);                                  // U1 = P1 + P2 = C11
+
+    arena.PopTo(top);
+}
+
+// res = lhs * rhs. Odd block counts are handled by dynamic peeling: the even part goes
+// through Strassen-Winograd, the last block row/column/k-slice through the classic multiply
+template <typename QMatrix>
+void Multiply(QGridView<QMatrix> res, ConstView<QMatrix> lhs, ConstView<QMatrix> rhs,
+              SizeT cutoff, QArena<QMatrix>& arena, QMatrix& qm_tmp)
+{
+    const SizeT m = lhs.m_num_qrows, k = lhs.m_num_qcols, n = rhs.m_num_qcols;
+    if (IsLeaf(m, k, n, cutoff))
+    {
+        FillZero(res);
+        MultAddClassic(res, lhs, rhs, qm_tmp);
+        return;
+    }
+
+    const SizeT m_even = m & ~1u, k_even = k & ~1u, n_even = n & ~1u;
+    const auto res_even = res.Sub(0, 0, m_even, n_even);
+    MultiplyEven(res_even, lhs.Sub(0, 0, m_even, k_even), rhs.Sub(0, 0, k_even, n_even),
+                 cutoff, arena, qm_tmp);
+
+    if (k != k_even)
+    {
+        MultAddClassic(res_even, lhs.Sub(0, k_even, m_even, 1), rhs.Sub(k_even, 0, 1, n_even), qm_tmp);
+    }
+    if (n != n_even)
+    {
+        const auto res_col = res.Sub(0, n_even, m, 1);
+        FillZero(res_col);
+        MultAddClassic(res_col, lhs, rhs.Sub(0, n_even, k, 1), qm_tmp);
+    }
+    if (m != m_even)
+    {
+        const auto res_row = res.Sub(m_even, 0, 1, n_even);
+        FillZero(res_row);
+        MultAddClassic(res_row, lhs.Sub(m_even, 0, 1, k), rhs.Sub(0, 0, k, n_even), qm_tmp);
+    }
+}
+
+// Cancellation in the Strassen sums may leave rounding noise in the zero padding
+template <typename T, std::size_t QSize>
+void ClearPadding(Matrix<T, QSize>& matrix) noexcept
+{
+    const auto num_rows = matrix.GetNumRows(), num_cols = matrix.GetNumCols();
+    const auto num_qrows = matrix.GetNumQRows(), num_qcols = matrix.GetNumQCols();
+
+    if (const auto num_rows_used = num_rows % QSize; num_rows_used != 0)
+    {
+        for (PositionT i_qcol = 0; i_qcol < num_qcols; ++i_qcol)
+        {
+            auto& qm = matrix.GetQMatrix(num_qrows - 1, i_qcol);
+            for (std::size_t i_row = num_rows_used; i_row < QSize; ++i_row)
+            {
+                qm.m_buf[i_row].fill(0);
+            }
+        }
+    }
+
+    if (const auto num_cols_used = num_cols % QSize; num_cols_used != 0)
+    {
+        for (PositionT i_qrow = 0; i_qrow < num_qrows; ++i_qrow)
+        {
+            auto& qm = matrix.GetQMatrix(i_qrow, num_qcols - 1);
+            for (auto& row : qm.m_buf)
+            {
+                std::fill(row.begin() + num_cols_used, row.end(), T{});
+            }
+        }
+    }
+}
+
+template <typename T, std::size_t QSize>
+QGridView<qmx::QMatrix<T, QSize>> MakeView(Matrix<T, QSize>& matrix) noexcept
+{
+    return { &matrix.GetQMatrix(0, 0), matrix.GetNumQCols(), matrix.GetNumQRows(), matrix.GetNumQCols() };
+}
+
+template <typename T, std::size_t QSize>
+QGridView<const qmx::QMatrix<T, QSize>> MakeView(const Matrix<T, QSize>& matrix) noexcept
+{
+    return { &matrix.GetQMatrix(0, 0), matrix.GetNumQCols(), matrix.GetNumQRows(), matrix.GetNumQCols() };
+}
+
+} // namespace strassen
+
+// out = lhs * rhs with Strassen-Winograd recursion on the block grid. Recursion stops
+// when a side has no more than cutoff_qnum blocks. Temporaries come from arena, which
+// can be kept by the caller to avoid reallocation between calls.
+template <typename T, std::size_t QSize>
+void StrassenMultiply(const Matrix<T, QSize>& lhs, const Matrix<T, QSize>& rhs, Matrix<T, QSize>& out,
+                      QArena<qmx::QMatrix<T, QSize>>& arena,
+                      mxcmn::SizeT cutoff_qnum = strassen::DefaultCutoff)
+{
+    if (lhs.GetNumCols() != rhs.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (out.GetNumRows() != lhs.GetNumRows() || out.GetNumCols() != rhs.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+    if (&out == &lhs || &out == &rhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+
+    arena.Reserve(strassen::CalcArenaSize(lhs.GetNumQRows(), lhs.GetNumQCols(), rhs.GetNumQCols(), cutoff_qnum));
+    const auto top = arena.GetTop();
+    auto& qm_tmp = arena.Push(1, 1).At(0, 0);
+
+    strassen::Multiply(strassen::MakeView(out), strassen::MakeView(lhs), strassen::MakeView(rhs),
+                       cutoff_qnum, arena, qm_tmp);
+    strassen::ClearPadding(out);
+
+    arena.PopTo(top);
+}
+
+template <typename T, std::size_t QSize>
+void StrassenMultiply(const Matrix<T, QSize>& lhs, const Matrix<T, QSize>& rhs, Matrix<T, QSize>& out,
+                      mxcmn::SizeT cutoff_qnum = strassen::DefaultCutoff)
+{
+    QArena<qmx::QMatrix<T, QSize>> arena;
+    StrassenMultiply(lhs, rhs, out, arena, cutoff_qnum);
+}
+
+} // namespace mxcl
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+
+#include "qmatrix_avx.h"
+
+namespace mxcmn
+{
+
+// Non-owning strided window of a matrix: element (i_row, i_col) is
+// ptr[i_row * row_stride + i_col * col_stride]. Transposed() and Sub() only make
+// new views of the same storage, so A * B^T, sub-block products and in-place panel
+// updates need no copies. Row-major engines hand out views with GetView()
+template <typename T>
+class MatrixView
+{
+public:
+    using PositionT = mxcmn::PositionT;
+    using SizeT = mxcmn::SizeT;
+    using StrideT = std::ptrdiff_t;
+
+    MatrixView(T* ptr, SizeT num_rows, SizeT num_cols, StrideT row_stride, StrideT col_stride = 1) noexcept
+        : m_ptr{ ptr }, m_num_rows{ num_rows }, m_num_cols{ num_cols },
+          m_row_stride{ row_stride }, m_col_stride{ col_stride }
+    {}
+
+    T& operator()(PositionT i_row, PositionT i_col) const noexcept
+    {
+        return m_ptr[i_row * m_row_stride + i_col * m_col_stride];
+    }
+
+    T* GetRowPtr(PositionT i_row) const noexcept { return m_ptr + i_row * m_row_stride; }
+
+    MatrixView Transposed() const noexcept
+    {
+        return { m_ptr, m_num_cols, m_num_rows, m_col_stride, m_row_stride };
+    }
+
+    MatrixView Sub(PositionT i_row, PositionT i_col, SizeT num_rows, SizeT num_cols) const noexcept
+    {
+        return { &(*this)(i_row, i_col), num_rows, num_cols, m_row_stride, m_col_stride };
+    }
+
+    operator MatrixView<const T>() const noexcept
+    {
+        return { m_ptr, m_num_rows, m_num_cols, m_row_stride, m_col_stride };
+    }
+
+    T* GetData() const noexcept { return m_ptr; }
+    SizeT GetNumRows() const noexcept { return m_num_rows; }
+    SizeT GetNumCols() const noexcept { return m_num_cols; }
+    StrideT GetRowStride() const noexcept { return m_row_stride; }
+    StrideT GetColStride() const noexcept { return m_col_stride; }
+
+private:
+    T* m_ptr;
+    SizeT m_num_rows, m_num_cols;
+    StrideT m_row_stride, m_col_stride;
+};
+
+// out = lhs * rhs of any engines: the sizes agree and out is neither operand
+template <typename L, typename R, typename Out>
+void CheckCorrectGemmArgs(const L& lhs, const R& rhs, const Out& out)
+{
+    if (lhs.GetNumCols() != rhs.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (out.GetNumRows() != lhs.GetNumRows() || out.GetNumCols() != rhs.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    const void* out_ptr = &out;
+    if (out_ptr == &lhs || out_ptr == &rhs)
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+}
+
+// Views alias when they share data
+template <typename T>
+void CheckCorrectGemmArgs(MatrixView<const T> lhs, MatrixView<const T> rhs, MatrixView<T> out)
+{
+    if (lhs.GetNumCols() != rhs.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide mult sizes");
+    }
+    if (out.GetNumRows() != lhs.GetNumRows() || out.GetNumCols() != rhs.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+    if (out.GetData() == lhs.GetData() || out.GetData() == rhs.GetData())
+    {
+        throw std::invalid_argument("out must not alias lhs or rhs");
+    }
+}
+
+// out = alpha * lhs * rhs + beta * out on views, out must not overlap lhs and rhs.
+// The loop order follows the strides:
+//  rhs and out rows contiguous - i-k-j, rows of rhs are streamed into rows of out
+//  lhs rows and rhs columns contiguous (rhs = B^T) - dot products of contiguous vectors
+//  otherwise - dot products with strides
+template <typename T>
+void Gemm(NonDeducedT<T> alpha, NonDeducedT<MatrixView<const T>> lhs, NonDeducedT<MatrixView<const T>> rhs,
+          NonDeducedT<T> beta, MatrixView<T> out)
+{
+    CheckCorrectGemmArgs<T>(lhs, rhs, out);
+
+    const auto M = out.GetNumRows(), N = out.GetNumCols(), K = lhs.GetNumCols();
+    if (rhs.GetColStride() == 1 && out.GetColStride() == 1)
+    {
+        for (PositionT i_row = 0; i_row < M; ++i_row)
+        {
+            T* out_row = out.GetRowPtr(i_row);
+            if (beta == T{})
+            {
+                std::fill(out_row, out_row + N, T{});
+            }
+            else if (beta != T{1})
+            {
+                std::for_each(out_row, out_row + N, [beta](T& value) { value *= beta; });
+            }
+
+            for (PositionT k = 0; k < K; ++k)
+            {
+                const T lhs_value = alpha * lhs(i_row, k);
+                const T* rhs_row = rhs.GetRowPtr(k);
+                for (PositionT i_col = 0; i_col < N; ++i_col)
+                {
+                    out_row[i_col] += lhs_value * rhs_row[i_col];
+                }
+            }
+        }
+        return;
+    }
+
+    const bool is_contiguous = lhs.GetColStride() == 1 && rhs.GetRowStride() == 1;
+    for (PositionT i_row = 0; i_row < M; ++i_row)
+    {
+        for (PositionT i_col = 0; i_col < N; ++i_col)
+        {
+            T value{};
+            if (is_contiguous)
+            {
+                const T* row = lhs.GetRowPtr(i_row);
+                const T* col = &rhs(0, i_col);
+                for (PositionT k = 0; k < K; ++k)
+                {
+                    value += row[k] * col[k];
+                }
+            }
+            else
+            {
+                for (PositionT k = 0; k < K; ++k)
+                {
+                    value += lhs(i_row, k) * rhs(k, i_col);
+                }
+            }
+
+            StoreScaled(out(i_row, i_col), value, alpha, beta);
+        }
+    }
+}
+
+// dst = src^T, dst must not overlap src. Goes over BlockSize x BlockSize blocks, so the
+// columns of dst being written stay in L1; inside a block full tiles are transposed in
+// registers when rows of both views are contiguous
+template <typename T>
+void Transpose(NonDeducedT<MatrixView<const T>> src, MatrixView<T> dst)
+{
+    if (dst.GetNumRows() != src.GetNumCols() || dst.GetNumCols() != src.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide out size");
+    }
+
+    constexpr SizeT BlockSize = 32;
+    const auto M = src.GetNumRows(), N = src.GetNumCols();
+    for (PositionT i_row_block = 0; i_row_block < M; i_row_block += BlockSize)
+    {
+        const auto i_row_end = std::min(M, i_row_block + BlockSize);
+        for (PositionT i_col_block = 0; i_col_block < N; i_col_block += BlockSize)
+        {
+            const auto i_col_end = std::min(N, i_col_block + BlockSize);
+
+            PositionT i_row = i_row_block;
+#if QMX_HAS_AVX2_FMA
+            if constexpr (qmx::avx::TransposeTileSize<T> != 0)
+            {
+                constexpr SizeT TS = qmx::avx::TransposeTileSize<T>;
+                if (src.GetColStride() == 1 && dst.GetColStride() == 1 &&
+                    i_row_end - i_row_block == BlockSize && i_col_end - i_col_block == BlockSize)
+                {
+                    for (; i_row < i_row_end; i_row += TS)
+                    {
+                        for (PositionT i_col = i_col_block; i_col < i_col_end; i_col += TS)
+                        {
+                            qmx::avx::TransposeTile(&src(i_row, i_col), src.GetRowStride(),
+                                                    &dst(i_col, i_row), dst.GetRowStride());
+                        }
+                    }
+                }
+            }
+#endif
+
+            for (; i_row < i_row_end; ++i_row)
+            {
+                for (PositionT i_col = i_col_block; i_col < i_col_end; ++i_col)
+                {
+                    dst(i_col, i_row) = src(i_row, i_col);
+                }
+            }
+        }
+    }
+}
+
+} // namespace mxcmn
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware counters of the whole process around a piece of code, read with perf_event_open.
+// Counters are opened for every thread of the process at Start(), so the pool workers are
+// counted too. Threads created later are counted through inherit. A counter the kernel
+// refuses (no PMU in a VM, perf_event_paranoid) reads as -1, the rest still work.
+
+enum class PerfEvent
+{
+    Cycles,
+    Instructions,
+    L1dMisses,
+    LlcMisses,
+    DtlbMisses,
+    NumEvents
+};
+
+constexpr std::size_t NumPerfEvents = static_cast<std::size_t>(PerfEvent::NumEvents);
+
+inline const char* GetPerfEventName(PerfEvent event) noexcept
+{
+    switch (event)
+    {
+    case PerfEvent::Cycles: return "cycles";
+    case PerfEvent::Instructions: return "instructions";
+    case PerfEvent::L1dMisses: return "l1d_misses";
+    case PerfEvent::LlcMisses: return "llc_misses";
+    case PerfEvent::DtlbMisses: return "dtlb_misses";
+    case PerfEvent::NumEvents: break;
+    }
+    return "";
+}
+
+using PerfCounterValues = std::array<std::int64_t, NumPerfEvents>;
+
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() { Close(); }
+
+    void Start();
+    // Nothing is counted between Pause() and Resume()
+    void Pause() noexcept { SetEnabled(false); }
+    void Resume() noexcept { SetEnabled(true); }
+    // Counts since Start(), -1 for counters that could not be opened
+    PerfCounterValues Stop();
+
+private:
+    void SetEnabled(bool is_enabled) noexcept;
+    void Close() noexcept;
+
+private:
+    // m_fds[i_event] - one counter per thread
+    std::array<std::vector<int>, NumPerfEvents> m_fds;
+};
+
+#ifdef __linux__
+
+inline void PerfCounters::Start()
+{
+    Close();
+
+    const auto make_cache_config = [](std::uint64_t cache, std::uint64_t op, std::uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    };
+    const std::array<std::pair<std::uint32_t, std::uint64_t>, NumPerfEvents> configs = { {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, make_cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                                PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, make_cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                                PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    } };
+
+    std::vector<pid_t> tids;
+    if (DIR* dir = ::opendir("/proc/self/task"))
+    {
+        while (const dirent* entry = ::readdir(dir))
+        {
+            if (entry->d_name[0] != '.')
+            {
+                tids.push_back(static_cast<pid_t>(std::atoi(entry->d_name)));
+            }
+        }
+        ::closedir(dir);
+    }
+    if (tids.empty())
+    {
+        tids.push_back(0);
+    }
+
+    for (std::size_t i_event = 0; i_event < NumPerfEvents; ++i_event)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = configs[i_event].first;
+        attr.config = configs[i_event].second;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // More events than hardware counters are multiplexed, counts are scaled by these
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        for (pid_t tid : tids)
+        {
+            const int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+            if (fd < 0)
+            {
+                // One refused thread spoils the sum, drop the event as a whole
+                for (int opened_fd : m_fds[i_event])
+                {
+                    ::close(opened_fd);
+                }
+                m_fds[i_event].clear();
+                break;
+            }
+            m_fds[i_event].push_back(fd);
+        }
+    }
+
+    for (const auto& fds : m_fds)
+    {
+        for (int fd : fds)
+        {
+            ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        }
+    }
+    SetEnabled(true);
+}
+
+inline void PerfCounters::SetEnabled(bool is_enabled) noexcept
+{
+    for (const auto& fds : m_fds)
+    {
+        for (int fd : fds)
+        {
+            ::ioctl(fd, is_enabled ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+inline PerfCounterValues PerfCounters::Stop()
+{
+    SetEnabled(false);
+
+    PerfCounterValues values;
+    for (std::size_t i_event = 0; i_event < NumPerfEvents; ++i_event)
+    {
+        const auto& fds = m_fds[i_event];
+        values[i_event] = fds.empty() ? -1 : 0;
+        for (int fd : fds)
+        {
+            // { value, time_enabled, time_running }
+            std::uint64_t data[3] = {};
+            if (::read(fd, data, sizeof(data)) != sizeof(data))
+            {
+                values[i_event] = -1;
+                break;
+            }
+            if (data[2] != 0)
+            {
+                values[i_event] += static_cast<std::int64_t>(
+                    static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]));
+            }
+        }
+    }
+
+    Close();
+    return values;
+}
+
+inline void PerfCounters::Close() noexcept
+{
+    for (auto& fds : m_fds)
+    {
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        fds.clear();
+    }
+}
+
+#else
+
+inline void PerfCounters::Start()
+{}
+
+inline void PerfCounters::SetEnabled(bool) noexcept
+{}
+
+inline PerfCounterValues PerfCounters::Stop()
+{
+    PerfCounterValues values;
+    values.fill(-1);
+    return values;
+}
+
+inline void PerfCounters::Close() noexcept
+{}
+
+#endif // __linux__
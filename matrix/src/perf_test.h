@@ -6,25 +6,228 @@
 #include <string>
 #include <iostream>
 #include <iomanip>
+#include <thread>
+#include <algorithm>
 
+#include "batch.h"
+#include "thread_pool.h"
+#include "perf_counters.h"
+#include "../../bench/bench.hpp"
+
+// Products are measured with the calling thread pinned to the core it is running on and
+// the workers of mxcmn::ThreadPool on the next cores, so the threads of a product do not
+// migrate between samples. All of them get their previous affinity back after the measurement
+inline bench::BenchConfig GetPerfConfig(std::size_t num_warmups, std::size_t num_repeats)
+{
+    bench::BenchConfig config;
+    config.num_warmups = num_warmups;
+    config.num_repeats = num_repeats;
+    config.pin_cpu = bench::GetCurrentCpu();
+    config.pin_workers = [](unsigned cpu_begin, bench::ThreadPins& pins) {
+        const unsigned num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+        unsigned cpu = cpu_begin;
+        mxcmn::ThreadPool::Get().ForEachWorker([&](std::thread& worker) { pins.Pin(worker, cpu++ % num_cpus); });
+    };
+    return config;
+}
+
+// Milliseconds per product of num_repeats samples after num_warmups untimed products.
+// Operands of a sample are copied right before it, not all at once
+template <typename M>
+bench::BenchStats MeasurePerfTest(const M& matrix_lhs, const M& matrix_rhs, const std::size_t num_repeats,
+                                  const std::size_t num_warmups = 1)
+{
+    return bench::Measure(
+        GetPerfConfig(num_warmups, num_repeats),
+        [&] { return std::make_pair(matrix_lhs, matrix_rhs); },
+        [](auto& operands) {
+            operands.first *= operands.second;
+
+            const auto& res = operands.first;
+            volatile auto tmp = res[res.GetNumRows() - 1][res.GetNumCols() - 1];
+            (void)tmp;
+        });
+}
+
+// The median of MeasurePerfTest
+template <typename M>
+double RunPerfTest(const M& matrix_lhs, const M& matrix_rhs, const std::size_t num_repeats,
+                   const std::size_t num_warmups = 1)
+{
+    return MeasurePerfTest(matrix_lhs, matrix_rhs, num_repeats, num_warmups).median;
+}
+
+// Same products as RunPerfTest, but the whole batch goes to mxcmn::BatchMultiply
 template <typename M>
-double RunPerfTest(const M& matrix_lhs, const M& matrix_rhs, const std::size_t num_repeats)
+double RunBatchPerfTest(const M& matrix_lhs, const M& matrix_rhs, const std::size_t num_repeats,
+                        unsigned num_threads = 0)
 {
     std::vector<M> ls(num_repeats, matrix_lhs), rs(num_repeats, matrix_rhs);
 
     auto time_begin = std::chrono::high_resolution_clock::now();
-    for (std::size_t i_repeat = 0; i_repeat < num_repeats; ++i_repeat)
+    mxcmn::BatchMultiply(ls, rs, num_threads);
+    auto time_end = std::chrono::high_resolution_clock::now();
+
+    const auto& res = ls.back();
+    volatile auto tmp = res[res.GetNumRows() - 1][res.GetNumCols() - 1];
+    (void)tmp;
+
+    return std::chrono::duration<double, std::milli>(time_end - time_begin).count() / num_repeats;
+}
+
+// One measured product: time and hardware counters per product
+struct PerfSample
+{
+    std::string name;
+    unsigned num_rows, num_k, num_cols;
+    // 0 - the default of the engine
+    unsigned num_threads;
+    // Milliseconds
+    double time;
+    // -1 - the counter is not available
+    PerfCounterValues counters;
+
+    std::int64_t GetCounter(PerfEvent event) const noexcept { return counters[static_cast<std::size_t>(event)]; }
+
+    double GetGFlops() const noexcept { return 2.0 * num_rows * num_k * num_cols / time * 1e-6; }
+
+    double GetIpc() const noexcept
     {
-        ls[i_repeat] *= rs[i_repeat];
+        const auto cycles = GetCounter(PerfEvent::Cycles), instructions = GetCounter(PerfEvent::Instructions);
+        return cycles > 0 && instructions >= 0 ? static_cast<double>(instructions) / cycles : -1;
+    }
 
-        const auto& res = ls[i_repeat];
-        volatile auto tmp = res[res.GetNumRows() - 1][res.GetNumCols() - 1];
+    // Memory traffic in GB/s, every LLC miss brings a 64 byte line
+    double GetBandwidth() const noexcept
+    {
+        const auto llc_misses = GetCounter(PerfEvent::LlcMisses);
+        return llc_misses >= 0 ? llc_misses * 64.0 / time * 1e-6 : -1;
     }
-    auto time_end = std::chrono::high_resolution_clock::now();
 
-    return std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_begin).count() / double(num_repeats);
+    // FLOPs per byte of memory traffic: the x axis of a roofline
+    double GetIntensity() const noexcept
+    {
+        const auto llc_misses = GetCounter(PerfEvent::LlcMisses);
+        return llc_misses > 0 ? 2.0 * num_rows * num_k * num_cols / (llc_misses * 64.0) : -1;
+    }
+};
+
+// Same products as RunPerfTest with the counters of the process around the timed ones
+template <typename M>
+PerfSample RunPerfTestCounters(const M& matrix_lhs, const M& matrix_rhs, const std::size_t num_repeats,
+                               const std::size_t num_warmups = 1)
+{
+    PerfCounters counters;
+    counters.Start();
+    counters.Pause();
+
+    std::size_t i_run = 0;
+    const auto stats = bench::Measure(
+        GetPerfConfig(num_warmups, num_repeats),
+        [&] { return std::make_pair(matrix_lhs, matrix_rhs); },
+        [&](auto& operands) {
+            const bool is_counted = i_run++ >= num_warmups;
+            if (is_counted)
+            {
+                counters.Resume();
+            }
+            operands.first *= operands.second;
+            if (is_counted)
+            {
+                counters.Pause();
+            }
+
+            const auto& res = operands.first;
+            volatile auto tmp = res[res.GetNumRows() - 1][res.GetNumCols() - 1];
+            (void)tmp;
+        });
+    auto values = counters.Stop();
+
+    for (auto& value : values)
+    {
+        value = value < 0 ? value : value / static_cast<std::int64_t>(num_repeats);
+    }
+
+    return { "", matrix_lhs.GetNumRows(), matrix_lhs.GetNumCols(), matrix_rhs.GetNumCols(), 0, stats.median, values };
 }
 
+// Samples of several runs written as CSV or JSON for scripts/plot.py
+class PerfReport
+{
+public:
+    void Add(PerfSample sample) { m_samples.push_back(std::move(sample)); }
+    const std::vector<PerfSample>& GetSamples() const noexcept { return m_samples; }
+
+    void WriteCsv(std::ostream& os) const
+    {
+        os << "name,num_rows,num_k,num_cols,num_threads,time_ms";
+        for (std::size_t i_event = 0; i_event < NumPerfEvents; ++i_event)
+        {
+            os << ',' << GetPerfEventName(static_cast<PerfEvent>(i_event));
+        }
+        os << ",gflops,ipc,bandwidth_gbs,intensity\n";
+
+        for (const auto& sample : m_samples)
+        {
+            os << sample.name << ',' << sample.num_rows << ',' << sample.num_k << ',' << sample.num_cols << ','
+               << sample.num_threads << ',' << sample.time;
+            for (const auto value : sample.counters)
+            {
+                os << ',' << value;
+            }
+            os << ',' << sample.GetGFlops() << ',' << sample.GetIpc() << ',' << sample.GetBandwidth() << ','
+               << sample.GetIntensity() << '\n';
+        }
+    }
+
+    void WriteJson(std::ostream& os) const
+    {
+        os << "[\n";
+        for (std::size_t i_sample = 0; i_sample < m_samples.size(); ++i_sample)
+        {
+            const auto& sample = m_samples[i_sample];
+            os << "  {\"name\": \"" << sample.name << "\", \"num_rows\": " << sample.num_rows
+               << ", \"num_k\": " << sample.num_k << ", \"num_cols\": " << sample.num_cols
+               << ", \"num_threads\": " << sample.num_threads << ", \"time_ms\": " << sample.time;
+            for (std::size_t i_event = 0; i_event < NumPerfEvents; ++i_event)
+            {
+                // Unavailable counters are null
+                os << ", \"" << GetPerfEventName(static_cast<PerfEvent>(i_event)) << "\": ";
+                if (sample.counters[i_event] < 0)
+                {
+                    os << "null";
+                }
+                else
+                {
+                    os << sample.counters[i_event];
+                }
+            }
+            os << ", \"gflops\": " << sample.GetGFlops();
+            // Metrics of unavailable counters are null too
+            const std::pair<const char*, double> derived[] = {
+                { "ipc", sample.GetIpc() }, { "bandwidth_gbs", sample.GetBandwidth() },
+                { "intensity", sample.GetIntensity() } };
+            for (const auto& [name, value] : derived)
+            {
+                os << ", \"" << name << "\": ";
+                if (value < 0)
+                {
+                    os << "null";
+                }
+                else
+                {
+                    os << value;
+                }
+            }
+            os << '}' << (i_sample + 1 < m_samples.size() ? "," : "") << '\n';
+        }
+        os << "]\n";
+    }
+
+private:
+    std::vector<PerfSample> m_samples;
+};
+
 class PerfTest
 {
 public:
@@ -33,26 +236,79 @@ public:
         : m_test_conf(test_conf)
     {}
 
+    // Stats of the products of Run also go to runner as <name>_<num_cols>,
+    // e.g. to be compared with a baseline. nullptr - not recorded
+    void SetRunner(bench::BenchRunner* runner) noexcept { m_runner = runner; }
+
     template <typename M>
-    std::vector<double> Run(std::ostream& os = std::cout)
+    std::vector<double> Run(std::ostream& os = std::cout, const std::string& name = "")
     {
         std::vector<double> res_time;
-        for (const auto [num_cols, num_repeats] : m_test_conf)
+        for (const auto& [num_cols, num_repeats] : m_test_conf)
         {
             os << std::setw(5) << num_cols << ' ';
             std::flush(os);
 
             M a{ num_cols, num_cols }, b{ num_cols, num_cols };
 
-            res_time.push_back(RunPerfTest(a, b, num_repeats));
+            const auto stats = MeasurePerfTest(a, b, num_repeats);
+            if (m_runner)
+            {
+                m_runner->Add(name + '_' + std::to_string(num_cols), stats);
+            }
+            res_time.push_back(stats.median);
             os << *res_time.crbegin() << '\n';
         }
 
         return res_time;
     }
 
+    // Same products with hardware counters, samples go to report under name.
+    // Prints: num_cols time GFLOP/s
+    template <typename M>
+    void Run(PerfReport& report, const std::string& name, std::ostream& os = std::cout)
+    {
+        for (const auto& [num_cols, num_repeats] : m_test_conf)
+        {
+            os << std::setw(5) << num_cols << ' ';
+            std::flush(os);
+
+            M a{ num_cols, num_cols }, b{ num_cols, num_cols };
+
+            auto sample = RunPerfTestCounters(a, b, num_repeats);
+            sample.name = name;
+            os << sample.time << ' ' << sample.GetGFlops() << '\n';
+            report.Add(std::move(sample));
+        }
+    }
+
+    // Prints: num_cols base_time time speedup, where speedup is base_time / time.
+    // Useful for variants of one engine, e.g. block layouts of mxcl::Matrix
+    template <typename MBase, typename M>
+    std::vector<double> RunVs(std::ostream& os = std::cout)
+    {
+        std::vector<double> res_time;
+        for (const auto& [num_cols, num_repeats] : m_test_conf)
+        {
+            os << std::setw(5) << num_cols << ' ';
+            std::flush(os);
+
+            MBase a_base{ num_cols, num_cols }, b_base{ num_cols, num_cols };
+            const double time_base = RunPerfTest(a_base, b_base, num_repeats);
+            os << time_base << ' ';
+            std::flush(os);
+
+            M a{ num_cols, num_cols }, b{ num_cols, num_cols };
+            res_time.push_back(RunPerfTest(a, b, num_repeats));
+            os << *res_time.crbegin() << ' ' << time_base / *res_time.crbegin() << '\n';
+        }
+
+        return res_time;
+    }
+
 private:
     std::vector<std::pair<unsigned, unsigned>> m_test_conf;
+    bench::BenchRunner* m_runner = nullptr;
 };
 
 class PerfTestMultiThreads
@@ -66,8 +322,12 @@ public:
         , m_num_repeats{ num_repeats }
     {}
 
+    // Stats of the products of Run also go to runner as <name>_t<num_threads>. nullptr - not recorded
+    void SetRunner(bench::BenchRunner* runner) noexcept { m_runner = runner; }
+
+    // Prints: num_threads time speedup, where speedup is relative to num_threads_min
     template <typename M>
-    std::vector<std::pair<unsigned, double>> Run(std::ostream& os = std::cout) const
+    std::vector<std::pair<unsigned, double>> Run(std::ostream& os = std::cout, const std::string& name = "") const
     {
         std::vector<std::pair<unsigned, double>> res_time;
 
@@ -78,16 +338,42 @@ public:
 
             M a{ m_num_cols, m_num_cols, num_threads }, b{ m_num_cols, m_num_cols, num_threads };
 
-            double time = RunPerfTest(a, b, m_num_repeats);
+            const auto stats = MeasurePerfTest(a, b, m_num_repeats);
+            if (m_runner)
+            {
+                m_runner->Add(name + "_t" + std::to_string(num_threads), stats);
+            }
+            const double time = stats.median;
             res_time.emplace_back(num_threads, time);
-            os << time << '\n';
+            os << time << ' ' << res_time.front().second / time << '\n';
         }
 
         return res_time;
     }
 
+    // Same products with hardware counters, samples go to report under name.
+    // Prints: num_threads time GFLOP/s
+    template <typename M>
+    void Run(PerfReport& report, const std::string& name, std::ostream& os = std::cout) const
+    {
+        for (auto num_threads = m_num_threads_min; num_threads <= m_num_threads_max; ++num_threads)
+        {
+            os << std::setw(2) << num_threads << ' ';
+            std::flush(os);
+
+            M a{ m_num_cols, m_num_cols, num_threads }, b{ m_num_cols, m_num_cols, num_threads };
+
+            auto sample = RunPerfTestCounters(a, b, m_num_repeats);
+            sample.name = name;
+            sample.num_threads = num_threads;
+            os << sample.time << ' ' << sample.GetGFlops() << '\n';
+            report.Add(std::move(sample));
+        }
+    }
+
 private:
     std::vector<std::pair<unsigned, unsigned>> m_test_conf;
     int m_num_threads_min, m_num_threads_max;
     unsigned m_num_cols, m_num_repeats;
+    bench::BenchRunner* m_runner = nullptr;
 };
\ No newline at end of file
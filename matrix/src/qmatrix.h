@@ -2,6 +2,9 @@
 
 #include <array>
 #include <algorithm>
+#include <type_traits>
+
+#include "qmatrix_avx.h"
 
 namespace qmx
 {
@@ -19,14 +22,36 @@ struct QMatrix
 
     void Transpose(QMatrix<T, N>& res) const noexcept;
     QMatrix& MultAddToTransposed(const QMatrix& lhs, const QMatrix& rhs) noexcept;
+    // Edge block: only [0, num_rows) x [0, num_cols) of this is updated and only
+    // [0, num_k) of the dot products is summed, the rest of lhs and rhs must be zero.
+    // Inputs U may be narrower than T, products are then accumulated in T
+    template <typename U>
+    QMatrix& MultAddToTransposed(const QMatrix<U, N>& lhs, const QMatrix<U, N>& rhs,
+                                 std::size_t num_rows, std::size_t num_cols, std::size_t num_k) noexcept;
     void Fill(T value) noexcept;
+    void Scale(T factor) noexcept;
+    // this += factor * other
+    void AddScaled(const QMatrix& other, T factor) noexcept;
 
     std::array<std::array<T, N>, N> m_buf;
+
+private:
+    template <typename U>
+    void MultAddToTransposedScalar(const QMatrix<U, N>& lhs, const QMatrix<U, N>& rhs,
+                                   std::size_t num_rows, std::size_t num_cols, std::size_t num_k) noexcept;
 };
 
 template <typename T, std::size_t N>
 void QMatrix<T, N>::Transpose(QMatrix<T, N>& res) const noexcept
 {
+#if QMX_HAS_AVX2_FMA
+    if constexpr (avx::HasTransposeKernel<T, N>)
+    {
+        avx::Transpose<N>(&m_buf[0][0], &res.m_buf[0][0]);
+        return;
+    }
+#endif
+
     for (std::size_t i_row = 0; i_row < N; ++i_row)
     {
         for (std::size_t i_col = 0; i_col < N; ++i_col)
@@ -39,30 +64,96 @@ void QMatrix<T, N>::Transpose(QMatrix<T, N>& res) const noexcept
 template <typename T, std::size_t N>
 QMatrix<T, N>& QMatrix<T, N>::MultAddToTransposed(const QMatrix& lhs, const QMatrix& rhs) noexcept
 {
-    for (std::size_t i_row = 0; i_row < N; ++i_row)
+#if QMX_HAS_AVX2_FMA
+    if constexpr (avx::HasMultAddKernel<T, N>)
+    {
+        avx::MultAddToTransposed<N>(&m_buf[0][0], &lhs.m_buf[0][0], &rhs.m_buf[0][0]);
+        return *this;
+    }
+#endif
+
+    MultAddToTransposedScalar(lhs, rhs, N, N, N);
+    return *this;
+}
+
+template <typename T, std::size_t N>
+template <typename U>
+QMatrix<T, N>& QMatrix<T, N>::MultAddToTransposed(const QMatrix<U, N>& lhs, const QMatrix<U, N>& rhs,
+                                                  std::size_t num_rows, std::size_t num_cols,
+                                                  std::size_t num_k) noexcept
+{
+    if constexpr (std::is_same_v<T, U>)
+    {
+        if (num_rows == N && num_cols == N && num_k == N)
+        {
+            return MultAddToTransposed(lhs, rhs);
+        }
+    }
+
+#if QMX_HAS_AVX2_FMA
+    if constexpr (avx::HasMultAddKernel<U, N, T>)
+    {
+        avx::MultAddToTransposed<N>(&m_buf[0][0], &lhs.m_buf[0][0], &rhs.m_buf[0][0],
+                                    num_rows, num_cols, num_k);
+        return *this;
+    }
+#endif
+
+    MultAddToTransposedScalar(lhs, rhs, num_rows, num_cols, num_k);
+    return *this;
+}
+
+template <typename T, std::size_t N>
+template <typename U>
+void QMatrix<T, N>::MultAddToTransposedScalar(const QMatrix<U, N>& lhs, const QMatrix<U, N>& rhs,
+                                              std::size_t num_rows, std::size_t num_cols,
+                                              std::size_t num_k) noexcept
+{
+    for (std::size_t i_row = 0; i_row < num_rows; ++i_row)
     {
         const auto& row = lhs.m_buf[i_row];
-        for (std::size_t i_col = 0; i_col < N; ++i_col)
+        for (std::size_t i_col = 0; i_col < num_cols; ++i_col)
         {
             const auto& col = rhs.m_buf[i_col];
 
             T value{};
-            for (std::size_t k = 0; k < N; ++k)
+            for (std::size_t k = 0; k < num_k; ++k)
             {
-                value += row[k] * col[k];
+                value += static_cast<T>(row[k]) * static_cast<T>(col[k]);
             }
             m_buf[i_row][i_col] += value;
         }
     }
-
-    return *this;
 }
 
-
 template <typename T, std::size_t N>
 void QMatrix<T, N>::Fill(T value) noexcept
 {
     std::for_each(std::begin(m_buf), std::end(m_buf), [=](auto& buf) { buf.fill(value); });
 }
 
+template <typename T, std::size_t N>
+void QMatrix<T, N>::Scale(T factor) noexcept
+{
+    for (auto& row : m_buf)
+    {
+        for (auto& value : row)
+        {
+            value *= factor;
+        }
+    }
+}
+
+template <typename T, std::size_t N>
+void QMatrix<T, N>::AddScaled(const QMatrix& other, T factor) noexcept
+{
+    for (std::size_t i_row = 0; i_row < N; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < N; ++i_col)
+        {
+            m_buf[i_row][i_col] += factor * other.m_buf[i_row][i_col];
+        }
+    }
+}
+
 } // namespcae qmx
\ No newline at end of file
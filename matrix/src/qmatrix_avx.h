@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define QMX_HAS_AVX2_FMA 1
+#else
+#define QMX_HAS_AVX2_FMA 0
+#endif
+
+namespace qmx::avx
+{
+
+// Register-blocked kernels for QMatrix. Each kernel keeps MR x NR output elements
+// in YMM accumulators (one vector per output element, vectorized along k) and
+// reduces them horizontally only once per tile.
+//
+// Inputs T may be narrower than the accumulator TAcc: float -> double, and
+// int8_t/int16_t -> int32_t through vpmaddwd (int8_t is sign-extended to int16_t first,
+// vpmaddubsw multiplies only unsigned by signed bytes and saturates).
+
+constexpr std::size_t MR = 2;
+constexpr std::size_t NR = 4; // VecOps::AddReduced reduces exactly 4 accumulators
+
+template <typename T>
+constexpr std::size_t VecLen = 32 / sizeof(T);
+
+// Elements of k consumed by one vector step, 0 - no kernel for this pair
+template <typename T, typename TAcc>
+constexpr std::size_t KStep = 0;
+template <> constexpr std::size_t KStep<double, double> = 4;
+template <> constexpr std::size_t KStep<float, float> = 8;
+template <> constexpr std::size_t KStep<float, double> = 4;
+template <> constexpr std::size_t KStep<std::int16_t, std::int32_t> = 16;
+template <> constexpr std::size_t KStep<std::int8_t, std::int32_t> = 16;
+
+// In-register transpose: 4 x 4 double, 8 x 8 float tiles
+template <typename T>
+constexpr std::size_t TransposeTileSize = std::is_same_v<T, double> ? 4 : std::is_same_v<T, float> ? 8 : 0;
+
+template <typename T, std::size_t N>
+constexpr bool HasTransposeKernel = QMX_HAS_AVX2_FMA && TransposeTileSize<T> != 0 && N % TransposeTileSize<T> == 0;
+
+template <typename T, std::size_t N, typename TAcc = T>
+constexpr bool HasMultAddKernel = QMX_HAS_AVX2_FMA && KStep<T, TAcc> != 0 &&
+                                  N % KStep<T, TAcc> == 0 && N % MR == 0 && N % NR == 0;
+
+#if QMX_HAS_AVX2_FMA
+
+// {sum(a0), sum(a1), sum(a2), sum(a3)}
+inline __m256d Reduce4(__m256d a0, __m256d a1, __m256d a2, __m256d a3) noexcept
+{
+    const __m256d t0 = _mm256_hadd_pd(a0, a1);
+    const __m256d t1 = _mm256_hadd_pd(a2, a3);
+    const __m256d lo = _mm256_permute2f128_pd(t0, t1, 0x20);
+    const __m256d hi = _mm256_permute2f128_pd(t0, t1, 0x31);
+    return _mm256_add_pd(lo, hi);
+}
+
+inline __m128 Reduce4(__m256 a0, __m256 a1, __m256 a2, __m256 a3) noexcept
+{
+    const __m256 t0 = _mm256_hadd_ps(a0, a1);
+    const __m256 t1 = _mm256_hadd_ps(a2, a3);
+    const __m256 t2 = _mm256_hadd_ps(t0, t1);
+    return _mm_add_ps(_mm256_castps256_ps128(t2), _mm256_extractf128_ps(t2, 1));
+}
+
+// {sum(a0), sum(a1), sum(a2), sum(a3)}
+inline __m128i Reduce4(__m256i a0, __m256i a1, __m256i a2, __m256i a3) noexcept
+{
+    const __m256i t0 = _mm256_hadd_epi32(a0, a1);
+    const __m256i t1 = _mm256_hadd_epi32(a2, a3);
+    const __m256i t2 = _mm256_hadd_epi32(t0, t1);
+    return _mm_add_epi32(_mm256_castsi256_si128(t2), _mm256_extracti128_si256(t2, 1));
+}
+
+// Vec holds accumulators, Load converts KStep inputs to the operand of FMAdd
+template <typename T, typename TAcc = T>
+struct VecOps;
+
+template <>
+struct VecOps<double>
+{
+    using Vec = __m256d;
+    static constexpr std::size_t VL = KStep<double, double>;
+
+    static Vec Zero() noexcept { return _mm256_setzero_pd(); }
+    static Vec Load(const double* ptr) noexcept { return _mm256_loadu_pd(ptr); }
+    static Vec Broadcast(const double* ptr) noexcept { return _mm256_broadcast_sd(ptr); }
+    static void Store(double* ptr, Vec a) noexcept { _mm256_storeu_pd(ptr, a); }
+    static Vec FMAdd(Vec a, Vec b, Vec c) noexcept { return _mm256_fmadd_pd(a, b, c); }
+    static Vec Add(Vec a, Vec b) noexcept { return _mm256_add_pd(a, b); }
+    static Vec Mul(Vec a, Vec b) noexcept { return _mm256_mul_pd(a, b); }
+
+    static void AddReduced(double* res, const Vec (&acc)[NR]) noexcept
+    {
+        const __m256d sum = Reduce4(acc[0], acc[1], acc[2], acc[3]);
+        _mm256_storeu_pd(res, _mm256_add_pd(_mm256_loadu_pd(res), sum));
+    }
+};
+
+template <>
+struct VecOps<float>
+{
+    using Vec = __m256;
+    static constexpr std::size_t VL = KStep<float, float>;
+
+    static Vec Zero() noexcept { return _mm256_setzero_ps(); }
+    static Vec Load(const float* ptr) noexcept { return _mm256_loadu_ps(ptr); }
+    static Vec Broadcast(const float* ptr) noexcept { return _mm256_broadcast_ss(ptr); }
+    static void Store(float* ptr, Vec a) noexcept { _mm256_storeu_ps(ptr, a); }
+    static Vec FMAdd(Vec a, Vec b, Vec c) noexcept { return _mm256_fmadd_ps(a, b, c); }
+    static Vec Add(Vec a, Vec b) noexcept { return _mm256_add_ps(a, b); }
+    static Vec Mul(Vec a, Vec b) noexcept { return _mm256_mul_ps(a, b); }
+
+    static void AddReduced(float* res, const Vec (&acc)[NR]) noexcept
+    {
+        const __m128 sum = Reduce4(acc[0], acc[1], acc[2], acc[3]);
+        _mm_storeu_ps(res, _mm_add_ps(_mm_loadu_ps(res), sum));
+    }
+};
+
+template <>
+struct VecOps<float, double> : VecOps<double>
+{
+    static constexpr std::size_t VL = KStep<float, double>;
+
+    static Vec Load(const float* ptr) noexcept { return _mm256_cvtps_pd(_mm_loadu_ps(ptr)); }
+};
+
+// 16 int16_t products per step, pairs are summed into 8 int32_t lanes
+template <>
+struct VecOps<std::int16_t, std::int32_t>
+{
+    using Vec = __m256i;
+    static constexpr std::size_t VL = KStep<std::int16_t, std::int32_t>;
+
+    static Vec Zero() noexcept { return _mm256_setzero_si256(); }
+    static Vec Load(const std::int16_t* ptr) noexcept
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    }
+    static Vec FMAdd(Vec a, Vec b, Vec c) noexcept { return _mm256_add_epi32(c, _mm256_madd_epi16(a, b)); }
+
+    static void AddReduced(std::int32_t* res, const Vec (&acc)[NR]) noexcept
+    {
+        const __m128i sum = Reduce4(acc[0], acc[1], acc[2], acc[3]);
+        auto* res_ptr = reinterpret_cast<__m128i*>(res);
+        _mm_storeu_si128(res_ptr, _mm_add_epi32(_mm_loadu_si128(res_ptr), sum));
+    }
+};
+
+template <>
+struct VecOps<std::int8_t, std::int32_t> : VecOps<std::int16_t, std::int32_t>
+{
+    static Vec Load(const std::int8_t* ptr) noexcept
+    {
+        return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)));
+    }
+};
+
+constexpr std::size_t RoundUp(std::size_t size, std::size_t step) noexcept
+{
+    return (size + step - 1) / step * step;
+}
+
+// res[i][j] += sum_k lhs[i][k] * rhs[j][k] for i < num_rows, j < num_cols, k < num_k,
+// all operands are N x N row-major. Bounds are rounded up to the register tile and the
+// vector length, so the elements past them must be zero (QMatrix padding is)
+template <std::size_t N, typename TAcc, typename T>
+void MultAddToTransposed(TAcc* res, const T* lhs, const T* rhs,
+                         std::size_t num_rows = N, std::size_t num_cols = N, std::size_t num_k = N) noexcept
+{
+    static_assert(HasMultAddKernel<T, N, TAcc>, "No AVX kernel for this type and size");
+
+    using Ops = VecOps<T, TAcc>;
+    using Vec = typename Ops::Vec;
+    constexpr std::size_t VL = Ops::VL;
+
+    const std::size_t i_end = RoundUp(num_rows, MR);
+    const std::size_t j_end = RoundUp(num_cols, NR);
+    const std::size_t k_end = RoundUp(num_k, VL);
+
+    // NR rows of rhs stay in L1 while the whole lhs streams through
+    for (std::size_t j = 0; j < j_end; j += NR)
+    {
+        const T* rhs_tile = rhs + j * N;
+        for (std::size_t i = 0; i < i_end; i += MR)
+        {
+            const T* lhs_tile = lhs + i * N;
+
+            Vec acc[MR][NR];
+            for (std::size_t ii = 0; ii < MR; ++ii)
+            {
+                for (std::size_t jj = 0; jj < NR; ++jj)
+                {
+                    acc[ii][jj] = Ops::Zero();
+                }
+            }
+
+            for (std::size_t k = 0; k < k_end; k += VL)
+            {
+                Vec b[NR];
+                for (std::size_t jj = 0; jj < NR; ++jj)
+                {
+                    b[jj] = Ops::Load(rhs_tile + jj * N + k);
+                }
+
+                for (std::size_t ii = 0; ii < MR; ++ii)
+                {
+                    const Vec a = Ops::Load(lhs_tile + ii * N + k);
+                    for (std::size_t jj = 0; jj < NR; ++jj)
+                    {
+                        acc[ii][jj] = Ops::FMAdd(a, b[jj], acc[ii][jj]);
+                    }
+                }
+            }
+
+            for (std::size_t ii = 0; ii < MR; ++ii)
+            {
+                Ops::AddReduced(res + (i + ii) * N + j, acc[ii]);
+            }
+        }
+    }
+}
+
+// dst[j][i] = src[i][j] for one tile, lds and ldd are row strides in elements
+inline void TransposeTile(const double* src, std::size_t lds, double* dst, std::size_t ldd) noexcept
+{
+    const __m256d r0 = _mm256_loadu_pd(src);
+    const __m256d r1 = _mm256_loadu_pd(src + lds);
+    const __m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+    const __m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+
+    // {r0[0], r1[0], r0[2], r1[2]}, {r0[1], r1[1], r0[3], r1[3]}, ...
+    const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+inline void TransposeTile(const float* src, std::size_t lds, float* dst, std::size_t ldd) noexcept
+{
+    __m256 r[8], t[8];
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+        r[i] = _mm256_loadu_ps(src + i * lds);
+    }
+
+    // Pairs of rows interleaved, then 2 x 2 blocks of them, then 128-bit halves swapped
+    for (std::size_t i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (std::size_t i = 0; i < 8; i += 4)
+    {
+        r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        _mm256_storeu_ps(dst + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(dst + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+
+// dst = src^T, both N x N row-major
+template <std::size_t N, typename T>
+void Transpose(const T* src, T* dst) noexcept
+{
+    static_assert(HasTransposeKernel<T, N>, "No AVX transpose for this type and size");
+    constexpr std::size_t TS = TransposeTileSize<T>;
+
+    for (std::size_t i = 0; i < N; i += TS)
+    {
+        for (std::size_t j = 0; j < N; j += TS)
+        {
+            TransposeTile(src + i * N + j, N, dst + j * N + i, N);
+        }
+    }
+}
+
+#endif // QMX_HAS_AVX2_FMA
+
+} // namespace qmx::avx
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <limits>
+#include <type_traits>
+
+#include "qmatrix.h"
+
+namespace mxcmn
+{
+
+// Order of the k sums in the parallel engines (mxnvpl, mxclpl), set on the output matrix.
+//
+// Default:       every output element (block for mxclpl) is summed over the whole of k by one
+//                task, so the result does not depend on the number of threads already.
+// Deterministic: k is cut into chunks of DeterministicKChunk elements, the cut depends only on k,
+//                and the chunk sums are added by a fixed pairwise tree. The order is a part of
+//                the contract, the rounding error grows with log of the number of chunks.
+// Compensated:   the chunk sums are added in k order with Neumaier summation, the error of
+//                adding them does not grow with their number.
+enum class Reduction
+{
+    Default,
+    Deterministic,
+    Compensated
+};
+
+constexpr SizeT DeterministicKChunk = 256;
+
+template <typename T>
+inline void AddTo(T& dst, const T& src) noexcept
+{
+    dst += src;
+}
+
+template <typename T, std::size_t N>
+inline void AddTo(qmx::QMatrix<T, N>& dst, const qmx::QMatrix<T, N>& src) noexcept
+{
+    dst.AddScaled(src, T{ 1 });
+}
+
+// -Ofast reassociates (sum - new_sum) + value into (sum + value) - new_sum, which is zero.
+// The barrier hides where a value came from, so it is kept as rounded
+template <typename T>
+inline T HideValue(T value) noexcept
+{
+#if defined(__GNUC__)
+    asm volatile("" : "+m"(value));
+#endif
+    return value;
+}
+
+// sum + comp += value, comp collects the low bits lost by sum
+template <typename T>
+inline void NeumaierAdd(T& sum, T& comp, T value) noexcept
+{
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        const T new_sum = HideValue(sum + value);
+        comp += std::abs(sum) >= std::abs(value) ? HideValue(sum - new_sum) + value
+                                                 : HideValue(value - new_sum) + sum;
+        sum = new_sum;
+    }
+    else
+    {
+        sum += value;
+    }
+}
+
+template <typename T, std::size_t N>
+inline void NeumaierAdd(qmx::QMatrix<T, N>& sum, qmx::QMatrix<T, N>& comp, const qmx::QMatrix<T, N>& value) noexcept
+{
+    for (std::size_t i_row = 0; i_row < N; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < N; ++i_col)
+        {
+            NeumaierAdd(sum.m_buf[i_row][i_col], comp.m_buf[i_row][i_col], value.m_buf[i_row][i_col]);
+        }
+    }
+}
+
+// Values are added one by one like bits of a binary counter: a new partial sum is merged
+// with the previous one while both hold the same number of values. The tree depends only
+// on the number of values, at most CalcNumPartials(max_num_values) partials are kept
+template <typename T>
+class PairwiseSum
+{
+public:
+    explicit PairwiseSum(std::size_t max_num_values)
+        : m_own_partials(CalcNumPartials(max_num_values)), m_partials{ m_own_partials.data() }
+    {}
+
+    // Partials are kept in external storage of CalcNumPartials(max_num_values) values
+    explicit PairwiseSum(T* partials) noexcept
+        : m_partials{ partials }
+    {}
+
+    PairwiseSum(const PairwiseSum&) = delete;
+    PairwiseSum& operator=(const PairwiseSum&) = delete;
+
+    static std::size_t CalcNumPartials(std::size_t max_num_values) noexcept
+    {
+        std::size_t max_depth = 1;
+        for (; max_num_values > 1; max_num_values /= 2)
+        {
+            ++max_depth;
+        }
+        return max_depth + 1;
+    }
+
+    void Reset() noexcept { m_num_partials = 0; }
+
+    // The next value is written here and added by Push()
+    T& GetNext() noexcept { return m_partials[m_num_partials]; }
+
+    void Push() noexcept
+    {
+        m_sizes[m_num_partials++] = 1;
+        while (m_num_partials > 1 && m_sizes[m_num_partials - 1] == m_sizes[m_num_partials - 2])
+        {
+            AddTo(m_partials[m_num_partials - 2], m_partials[m_num_partials - 1]);
+            m_sizes[m_num_partials - 2] *= 2;
+            --m_num_partials;
+        }
+    }
+
+    // Adds the rest from the smallest partial, at least one value must be pushed
+    const T& GetSum() noexcept
+    {
+        for (; m_num_partials > 1; --m_num_partials)
+        {
+            AddTo(m_partials[m_num_partials - 2], m_partials[m_num_partials - 1]);
+        }
+        return m_partials[0];
+    }
+
+private:
+    std::vector<T> m_own_partials;
+    T* m_partials;
+    // Enough for any std::size_t number of values
+    std::array<std::size_t, std::numeric_limits<std::size_t>::digits + 2> m_sizes;
+    std::size_t m_num_partials = 0;
+};
+
+} // namespace mxcmn
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+#include "allocator.h"
+
+namespace mxcmn
+{
+
+// Cache line aligned buffer for temporaries of trivial types, kept between calls.
+// The buffer only grows, so repeated multiplies of the same shapes do not allocate at all.
+// Its pages are not touched on allocation, the thread using the arena touches them first.
+class ScratchArena
+{
+public:
+    static constexpr std::size_t Alignment = 64;
+
+    template <typename T>
+    void Reserve(std::size_t num)
+    {
+        static_assert(std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>,
+                      "Scratch objects are never constructed or destroyed");
+        static_assert(alignof(T) <= Alignment, "Scratch objects are at most cache line aligned");
+
+        const std::size_t size = num * sizeof(T);
+        if (size > m_buf.size())
+        {
+            // The old contents are not needed, so they are not copied
+            Buffer{}.swap(m_buf);
+            m_buf.resize(size);
+        }
+    }
+
+    // Storage of the last Reserve, the contents are left from the previous user
+    template <typename T>
+    T* Get() noexcept
+    {
+        return reinterpret_cast<T*>(m_buf.data());
+    }
+
+    std::size_t GetCapacity() const noexcept { return m_buf.size(); }
+
+    void Release() noexcept { Buffer{}.swap(m_buf); }
+
+private:
+    using Buffer = std::vector<std::byte, AlignedAllocator<std::byte, Alignment>>;
+    Buffer m_buf;
+};
+
+// Arenas of the calling thread shared by all matrices, so the scratch memory of the process
+// is bounded by the number of threads. A thread uses Pack for the operand packed by the call
+// it runs and Tmp for the temporaries of one task or of a single-threaded product.
+// ThreadPool::Run never runs other calls inside, so neither is overwritten while in use
+enum class ThreadScratch
+{
+    Pack,
+    Tmp
+};
+
+inline ScratchArena& GetThreadScratch(ThreadScratch use) noexcept
+{
+    thread_local ScratchArena arenas[2];
+    return arenas[static_cast<int>(use)];
+}
+
+} // namespace mxcmn
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_cachelike.h"
+#include "batch.h"
+
+namespace mxcl
+{
+
+// Linear systems on the block grid of mxcl::Matrix, without a copy to another library.
+// Factorizations are right-looking: only the panel of one block column is handled element
+// by element, the trailing update is block products on QMatrix::MultAddToTransposed, the
+// kernel of Gemm, so for large matrices the solve runs close to multiply speed.
+// Block columns are split between num_threads threads of the pool, 0 - one per hardware thread
+
+enum class Uplo
+{
+    Lower,
+    Upper
+};
+
+enum class TrOp
+{
+    NoTrans,
+    Trans
+};
+
+enum class Diag
+{
+    NonUnit,
+    Unit
+};
+
+// Number of used rows (cols) in block i_q of a side of size elements
+template <std::size_t QSize>
+mxcmn::SizeT CalcBlockExtent(mxcmn::SizeT size, mxcmn::PositionT i_q) noexcept
+{
+    return std::min<mxcmn::SizeT>(QSize, size - i_q * QSize);
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void CheckSquare(const Matrix<T, QSize, Layout, Alloc>& a)
+{
+    if (a.GetNumRows() != a.GetNumCols())
+    {
+        throw std::invalid_argument("Invalide matrix size: must be square");
+    }
+}
+
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void SwapRows(Matrix<T, QSize, Layout, Alloc>& matrix, mxcmn::PositionT i_row_lhs,
+              mxcmn::PositionT i_row_rhs) noexcept
+{
+    if (i_row_lhs == i_row_rhs)
+    {
+        return;
+    }
+
+    for (mxcmn::PositionT i_qcol = 0; i_qcol < matrix.GetNumQCols(); ++i_qcol)
+    {
+        std::swap(matrix.GetQMatrix(i_row_lhs / QSize, i_qcol).m_buf[i_row_lhs % QSize],
+                  matrix.GetQMatrix(i_row_rhs / QSize, i_qcol).m_buf[i_row_rhs % QSize]);
+    }
+}
+
+// a = P^T L U in place: L is unit lower under the diagonal of a, U is upper on and above it.
+// Returns the row swaps as in LAPACK getrf: row i was swapped with row pivots[i] >= i
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+std::vector<mxcmn::PositionT> LuFactorize(Matrix<T, QSize, Layout, Alloc>& a, unsigned num_threads = 0)
+{
+    static_assert(std::is_floating_point_v<T>, "LU needs a floating point type");
+    using PositionT = mxcmn::PositionT;
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    CheckSquare(a);
+    const auto size = a.GetNumRows();
+    const auto num_q = a.GetNumQRows();
+
+    std::vector<PositionT> pivots(size);
+    for (PositionT kq = 0; kq < num_q; ++kq)
+    {
+        const auto num_k = CalcBlockExtent<QSize>(size, kq);
+        auto& diag_qm = a.GetQMatrix(kq, kq);
+
+        // Panel: block column kq from the diagonal down, swaps are applied to whole rows
+        for (PositionT i_col = 0; i_col < num_k; ++i_col)
+        {
+            const auto i_diag = kq * QSize + i_col;
+
+            PositionT i_pivot = i_diag;
+            T pivot_abs = std::abs(diag_qm.m_buf[i_col][i_col]);
+            for (PositionT iq = kq; iq < num_q; ++iq)
+            {
+                const auto& qm = a.GetQMatrix(iq, kq);
+                const auto num_rows = CalcBlockExtent<QSize>(size, iq);
+                for (PositionT i_row = iq == kq ? i_col + 1 : 0; i_row < num_rows; ++i_row)
+                {
+                    if (std::abs(qm.m_buf[i_row][i_col]) > pivot_abs)
+                    {
+                        pivot_abs = std::abs(qm.m_buf[i_row][i_col]);
+                        i_pivot = iq * QSize + i_row;
+                    }
+                }
+            }
+            if (pivot_abs == T{})
+            {
+                throw std::runtime_error("Matrix is singular");
+            }
+
+            pivots[i_diag] = i_pivot;
+            SwapRows(a, i_diag, i_pivot);
+
+            const auto& diag_row = diag_qm.m_buf[i_col];
+            const T inv_pivot = T{1} / diag_row[i_col];
+            for (PositionT iq = kq; iq < num_q; ++iq)
+            {
+                auto& qm = a.GetQMatrix(iq, kq);
+                const auto num_rows = CalcBlockExtent<QSize>(size, iq);
+                for (PositionT i_row = iq == kq ? i_col + 1 : 0; i_row < num_rows; ++i_row)
+                {
+                    auto& row = qm.m_buf[i_row];
+                    row[i_col] *= inv_pivot;
+                    for (PositionT i_rest = i_col + 1; i_rest < num_k; ++i_rest)
+                    {
+                        row[i_rest] -= row[i_col] * diag_row[i_rest];
+                    }
+                }
+            }
+        }
+
+        // Every block column on the right: U12 = L11^-1 A12, then A22 -= L21 U12.
+        // Blocks on the right of the last panel are full, so the padding stays zero
+        mxcmn::BatchFor(num_q - kq - 1, num_threads, [&](std::size_t i_item) {
+            const auto jq = static_cast<PositionT>(kq + 1 + i_item);
+            auto& u_qm = a.GetQMatrix(kq, jq);
+            for (PositionT i_row = 1; i_row < num_k; ++i_row)
+            {
+                for (PositionT k = 0; k < i_row; ++k)
+                {
+                    const T l = diag_qm.m_buf[i_row][k];
+                    for (PositionT i_col = 0; i_col < QSize; ++i_col)
+                    {
+                        u_qm.m_buf[i_row][i_col] -= l * u_qm.m_buf[k][i_col];
+                    }
+                }
+            }
+
+            QMatrix neg_u_tr;
+            u_qm.Transpose(neg_u_tr);
+            neg_u_tr.Scale(T{-1});
+            for (PositionT iq = kq + 1; iq < num_q; ++iq)
+            {
+                a.GetQMatrix(iq, jq).MultAddToTransposed(a.GetQMatrix(iq, kq), neg_u_tr);
+            }
+        });
+    }
+
+    return pivots;
+}
+
+// a = L L^T in place for a symmetric positive definite a: only the lower triangle of a
+// is read, a is left with L and zeros above the diagonal
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void CholeskyFactorize(Matrix<T, QSize, Layout, Alloc>& a, unsigned num_threads = 0)
+{
+    static_assert(std::is_floating_point_v<T>, "Cholesky needs a floating point type");
+    using PositionT = mxcmn::PositionT;
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    CheckSquare(a);
+    const auto size = a.GetNumRows();
+    const auto num_q = a.GetNumQRows();
+
+    // neg_l[iq] = -L(iq, kq) of the current block column
+    std::vector<QMatrix> neg_l(num_q);
+    for (PositionT kq = 0; kq < num_q; ++kq)
+    {
+        const auto num_k = CalcBlockExtent<QSize>(size, kq);
+        auto& diag_qm = a.GetQMatrix(kq, kq);
+
+        for (PositionT jq = kq + 1; jq < num_q; ++jq)
+        {
+            a.GetQMatrix(kq, jq).Fill(0);
+        }
+
+        // A11 = L11 L11^T
+        for (PositionT j = 0; j < num_k; ++j)
+        {
+            auto& row_j = diag_qm.m_buf[j];
+            T value = row_j[j];
+            for (PositionT k = 0; k < j; ++k)
+            {
+                value -= row_j[k] * row_j[k];
+            }
+            if (!(value > T{}))
+            {
+                throw std::runtime_error("Matrix is not positive definite");
+            }
+            row_j[j] = std::sqrt(value);
+
+            for (PositionT i = j + 1; i < num_k; ++i)
+            {
+                auto& row_i = diag_qm.m_buf[i];
+                value = row_i[j];
+                for (PositionT k = 0; k < j; ++k)
+                {
+                    value -= row_i[k] * row_j[k];
+                }
+                row_i[j] = value / row_j[j];
+            }
+            std::fill(row_j.begin() + j + 1, row_j.end(), T{});
+        }
+
+        // L21 = A21 L11^-T: forward substitution along every row
+        mxcmn::BatchFor(num_q - kq - 1, num_threads, [&](std::size_t i_item) {
+            const auto iq = static_cast<PositionT>(kq + 1 + i_item);
+            auto& qm = a.GetQMatrix(iq, kq);
+            const auto num_rows = CalcBlockExtent<QSize>(size, iq);
+            for (PositionT i_row = 0; i_row < num_rows; ++i_row)
+            {
+                auto& row = qm.m_buf[i_row];
+                for (PositionT j = 0; j < num_k; ++j)
+                {
+                    T value = row[j];
+                    for (PositionT k = 0; k < j; ++k)
+                    {
+                        value -= row[k] * diag_qm.m_buf[j][k];
+                    }
+                    row[j] = value / diag_qm.m_buf[j][j];
+                }
+            }
+
+            neg_l[iq] = qm;
+            neg_l[iq].Scale(T{-1});
+        });
+
+        // A22 -= L21 L21^T, lower blocks only. A block row of L is already in the form
+        // MultAddToTransposed takes its rhs
+        mxcmn::BatchFor(num_q - kq - 1, num_threads, [&](std::size_t i_item) {
+            const auto iq = static_cast<PositionT>(kq + 1 + i_item);
+            for (PositionT jq = kq + 1; jq <= iq; ++jq)
+            {
+                a.GetQMatrix(iq, jq).MultAddToTransposed(a.GetQMatrix(iq, kq), neg_l[jq]);
+            }
+        });
+    }
+}
+
+// Solves op(a) x = b in place of b, a is square and triangular: only the uplo triangle of a
+// is read, with Diag::Unit its diagonal is taken as ones. Block columns of b are independent
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Trsm(Uplo uplo, TrOp op, Diag diag, const Matrix<T, QSize, Layout, Alloc>& a,
+          Matrix<T, QSize, Layout, Alloc>& b, unsigned num_threads = 0)
+{
+    static_assert(std::is_floating_point_v<T>, "Trsm needs a floating point type");
+    using PositionT = mxcmn::PositionT;
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    CheckSquare(a);
+    if (b.GetNumRows() != a.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide rhs size");
+    }
+    if (&a == &b)
+    {
+        throw std::invalid_argument("b must not alias a");
+    }
+
+    const auto size = a.GetNumRows();
+    const auto num_q = a.GetNumQRows();
+    const bool is_trans = op == TrOp::Trans;
+    // op(a) is lower: forward substitution, else backward
+    const bool is_lower = (uplo == Uplo::Lower) != is_trans;
+
+    mxcmn::BatchFor(b.GetNumQCols(), num_threads, [&](std::size_t i_item) {
+        const auto jq = static_cast<PositionT>(i_item);
+        QMatrix neg_x_tr, a_tr;
+        for (PositionT i_step = 0; i_step < num_q; ++i_step)
+        {
+            const PositionT kq = is_lower ? i_step : num_q - 1 - i_step;
+            const auto num_k = CalcBlockExtent<QSize>(size, kq);
+            const auto& diag_qm = a.GetQMatrix(kq, kq);
+            const auto get_diag = [&diag_qm, is_trans](PositionT i, PositionT j) {
+                return is_trans ? diag_qm.m_buf[j][i] : diag_qm.m_buf[i][j];
+            };
+
+            auto& x_qm = b.GetQMatrix(kq, jq);
+            for (PositionT i_pos = 0; i_pos < num_k; ++i_pos)
+            {
+                const PositionT i_row = is_lower ? i_pos : num_k - 1 - i_pos;
+                auto& row = x_qm.m_buf[i_row];
+
+                const PositionT k_begin = is_lower ? 0 : i_row + 1;
+                const PositionT k_end = is_lower ? i_row : num_k;
+                for (PositionT k = k_begin; k < k_end; ++k)
+                {
+                    const T l = get_diag(i_row, k);
+                    for (PositionT i_col = 0; i_col < QSize; ++i_col)
+                    {
+                        row[i_col] -= l * x_qm.m_buf[k][i_col];
+                    }
+                }
+
+                if (diag == Diag::NonUnit)
+                {
+                    const T inv_diag = T{1} / get_diag(i_row, i_row);
+                    for (PositionT i_col = 0; i_col < QSize; ++i_col)
+                    {
+                        row[i_col] *= inv_diag;
+                    }
+                }
+            }
+
+            // b(iq) -= op(a)(iq, kq) x(kq) for the block rows not solved yet
+            x_qm.Transpose(neg_x_tr);
+            neg_x_tr.Scale(T{-1});
+            const PositionT iq_begin = is_lower ? kq + 1 : 0;
+            const PositionT iq_end = is_lower ? num_q : kq;
+            for (PositionT iq = iq_begin; iq < iq_end; ++iq)
+            {
+                const QMatrix* a_qm = &a.GetQMatrix(iq, kq);
+                if (is_trans)
+                {
+                    a.GetQMatrix(kq, iq).Transpose(a_tr);
+                    a_qm = &a_tr;
+                }
+                b.GetQMatrix(iq, jq).MultAddToTransposed(*a_qm, neg_x_tr);
+            }
+        }
+    });
+}
+
+// Solves a x = b in place of b, lu and pivots are the result of LuFactorize(a)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void LuSolve(const Matrix<T, QSize, Layout, Alloc>& lu, const std::vector<mxcmn::PositionT>& pivots,
+             Matrix<T, QSize, Layout, Alloc>& b, unsigned num_threads = 0)
+{
+    if (pivots.size() != lu.GetNumRows() || b.GetNumRows() != lu.GetNumRows())
+    {
+        throw std::invalid_argument("Invalide rhs size");
+    }
+
+    for (mxcmn::PositionT i_row = 0; i_row < pivots.size(); ++i_row)
+    {
+        SwapRows(b, i_row, pivots[i_row]);
+    }
+    Trsm(Uplo::Lower, TrOp::NoTrans, Diag::Unit, lu, b, num_threads);
+    Trsm(Uplo::Upper, TrOp::NoTrans, Diag::NonUnit, lu, b, num_threads);
+}
+
+// Solves a x = b in place of b, l is the result of CholeskyFactorize(a)
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void CholeskySolve(const Matrix<T, QSize, Layout, Alloc>& l, Matrix<T, QSize, Layout, Alloc>& b,
+                   unsigned num_threads = 0)
+{
+    Trsm(Uplo::Lower, TrOp::NoTrans, Diag::NonUnit, l, b, num_threads);
+    Trsm(Uplo::Lower, TrOp::Trans, Diag::NonUnit, l, b, num_threads);
+}
+
+} // namespace mxcl
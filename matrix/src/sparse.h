@@ -0,0 +1,548 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <thread>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_view.h"
+#include "matrix_cachelike.h"
+#include "thread_pool.h"
+#include "batch.h"
+#include "gemv.h"
+
+namespace mxsp
+{
+
+// Sparse left operands: only the non-zeros are stored and multiplied.
+//  CsrMatrix - compressed rows of single elements, for scattered non-zeros
+//  BsrMatrix - compressed rows of QSize x QSize blocks, every stored block goes
+//              through the dense QMatrix kernel
+// Gemv and Gemm mirror the dense ones: y = alpha * A * x + beta * y and
+// out = alpha * A * B + beta * out with a dense B of a row-major engine (GetView())
+// or of mxcl. out (y) is not read when beta is zero.
+// Rows are split between num_threads threads of the pool by the number of non-zeros,
+// num_threads == 0 - one per hardware thread
+
+using PositionT = mxcmn::PositionT;
+using SizeT = mxcmn::SizeT;
+
+// Calls func(i_begin, i_end) for stripes of the rows of row_ptr with about the same
+// number of non-zeros. Stripes get at least SparseMinTaskSize of work, nnz_cost is the
+// work per non-zero
+template <typename F>
+void SparseFor(const std::vector<std::size_t>& row_ptr, std::size_t nnz_cost, unsigned num_threads, F&& func)
+{
+    constexpr std::size_t SparseMinTaskSize = std::size_t{ 1 } << 15;
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    const auto num_rows = static_cast<SizeT>(row_ptr.size() - 1);
+    const auto num_nnz = row_ptr.back();
+    const auto max_num_tasks = std::max<std::size_t>(1, num_nnz * nnz_cost / SparseMinTaskSize);
+    const auto num_tasks = static_cast<unsigned>(std::min<std::size_t>({ num_threads, max_num_tasks, num_rows }));
+
+    const auto find_row = [&](unsigned i_task) {
+        if (i_task == num_tasks)
+        {
+            return num_rows;
+        }
+        const auto nnz_begin = num_nnz * i_task / num_tasks;
+        const auto it = std::lower_bound(row_ptr.begin(), row_ptr.end(), nnz_begin);
+        return static_cast<PositionT>(it - row_ptr.begin());
+    };
+
+    mxcmn::ThreadPool::Get().Run(num_tasks, [&](unsigned i_task) {
+        const auto i_begin = find_row(i_task), i_end = find_row(i_task + 1);
+        if (i_begin < i_end)
+        {
+            func(i_begin, i_end);
+        }
+    });
+}
+
+// out = beta * out for a row of count elements, out is not read when beta is zero
+template <typename T>
+void ScaleRow(T* out, SizeT count, T beta) noexcept
+{
+    if (beta == T{})
+    {
+        std::fill(out, out + count, T{});
+    }
+    else if (beta != T{1})
+    {
+        for (PositionT i = 0; i < count; ++i)
+        {
+            out[i] *= beta;
+        }
+    }
+}
+
+// CsrMatrix ----------------------------------------------------------------------------------------
+
+// Row i has the non-zeros values[p] in columns col_idx[p] for p in [row_ptr[i], row_ptr[i + 1])
+template <typename T>
+class CsrMatrix
+{
+public:
+    CsrMatrix(SizeT num_rows, SizeT num_cols, std::vector<std::size_t> row_ptr,
+              std::vector<PositionT> col_idx, std::vector<T> values);
+
+    // Keeps the elements of dense that are not zero, M is any engine with operator[]
+    template <typename M>
+    static CsrMatrix FromDense(const M& dense);
+    template <typename M>
+    M ToDense() const;
+
+    inline SizeT GetNumRows() const noexcept { return m_num_rows; }
+    inline SizeT GetNumCols() const noexcept { return m_num_cols; }
+    inline std::size_t GetNumNonZeros() const noexcept { return m_values.size(); }
+
+    inline const std::vector<std::size_t>& GetRowPtr() const noexcept { return m_row_ptr; }
+    inline const std::vector<PositionT>& GetColIdx() const noexcept { return m_col_idx; }
+    inline const std::vector<T>& GetValues() const noexcept { return m_values; }
+
+private:
+    SizeT m_num_rows, m_num_cols;
+    std::vector<std::size_t> m_row_ptr;
+    std::vector<PositionT> m_col_idx;
+    std::vector<T> m_values;
+};
+
+template <typename T>
+CsrMatrix<T>::CsrMatrix(SizeT num_rows, SizeT num_cols, std::vector<std::size_t> row_ptr,
+                        std::vector<PositionT> col_idx, std::vector<T> values)
+    : m_num_rows{ num_rows },
+      m_num_cols{ num_cols },
+      m_row_ptr(std::move(row_ptr)),
+      m_col_idx(std::move(col_idx)),
+      m_values(std::move(values))
+{
+    if (num_rows == 0 || num_cols == 0)
+    {
+        throw std::invalid_argument("num_rows and num_cols must be above zero");
+    }
+
+    const bool is_correct = m_row_ptr.size() == std::size_t{ num_rows } + 1 && m_row_ptr.front() == 0 &&
+                            m_row_ptr.back() == m_col_idx.size() && m_col_idx.size() == m_values.size() &&
+                            std::is_sorted(m_row_ptr.begin(), m_row_ptr.end()) &&
+                            std::all_of(m_col_idx.begin(), m_col_idx.end(),
+                                        [num_cols](PositionT i_col) { return i_col < num_cols; });
+    if (!is_correct)
+    {
+        throw std::invalid_argument("Invalide CSR arrays");
+    }
+}
+
+template <typename T>
+template <typename M>
+CsrMatrix<T> CsrMatrix<T>::FromDense(const M& dense)
+{
+    const auto num_rows = dense.GetNumRows(), num_cols = dense.GetNumCols();
+
+    std::vector<std::size_t> row_ptr(std::size_t{ num_rows } + 1);
+    std::vector<PositionT> col_idx;
+    std::vector<T> values;
+    for (PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        const auto& row = dense[i_row];
+        for (PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            if (row[i_col] != T{})
+            {
+                col_idx.push_back(i_col);
+                values.push_back(row[i_col]);
+            }
+        }
+        row_ptr[i_row + 1] = values.size();
+    }
+
+    return { num_rows, num_cols, std::move(row_ptr), std::move(col_idx), std::move(values) };
+}
+
+template <typename T>
+template <typename M>
+M CsrMatrix<T>::ToDense() const
+{
+    M dense{ m_num_rows, m_num_cols };
+    for (PositionT i_row = 0; i_row < m_num_rows; ++i_row)
+    {
+        for (auto p = m_row_ptr[i_row]; p < m_row_ptr[i_row + 1]; ++p)
+        {
+            dense[i_row][m_col_idx[p]] = m_values[p];
+        }
+    }
+
+    return dense;
+}
+
+template <typename T>
+void Gemv(mxcmn::NonDeducedT<T> alpha, const CsrMatrix<T>& a, const T* x, mxcmn::NonDeducedT<T> beta, T* y,
+          unsigned num_threads = 0)
+{
+    const auto& row_ptr = a.GetRowPtr();
+    const auto& col_idx = a.GetColIdx();
+    const auto& values = a.GetValues();
+
+    SparseFor(row_ptr, 1, num_threads, [&](PositionT i_row_begin, PositionT i_row_end) {
+        for (PositionT i_row = i_row_begin; i_row < i_row_end; ++i_row)
+        {
+            T value{};
+            for (auto p = row_ptr[i_row]; p < row_ptr[i_row + 1]; ++p)
+            {
+                value += values[p] * x[col_idx[p]];
+            }
+            mxcmn::StoreScaled(y[i_row], value, alpha, beta);
+        }
+    });
+}
+
+// Row i of out is a sum of the rows of b picked by the non-zeros of row i of a
+template <typename T, typename M>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const CsrMatrix<T>& a, const M& b, mxcmn::NonDeducedT<T> beta, M& out,
+          unsigned num_threads = 0)
+{
+    static_assert(mxcmn::HasView<M>, "Dense operand must be row-major or mxcl");
+    mxcmn::CheckCorrectGemmArgs(a, b, out);
+
+    const auto& row_ptr = a.GetRowPtr();
+    const auto& col_idx = a.GetColIdx();
+    const auto& values = a.GetValues();
+    const auto num_cols = b.GetNumCols();
+    const auto b_view = b.GetView();
+    const auto out_view = out.GetView();
+
+    SparseFor(row_ptr, num_cols, num_threads, [&](PositionT i_row_begin, PositionT i_row_end) {
+        for (PositionT i_row = i_row_begin; i_row < i_row_end; ++i_row)
+        {
+            T* out_row = out_view.GetRowPtr(i_row);
+            ScaleRow(out_row, num_cols, beta);
+            for (auto p = row_ptr[i_row]; p < row_ptr[i_row + 1]; ++p)
+            {
+                const T value = alpha * values[p];
+                const T* b_row = b_view.GetRowPtr(col_idx[p]);
+                for (PositionT i_col = 0; i_col < num_cols; ++i_col)
+                {
+                    out_row[i_col] += value * b_row[i_col];
+                }
+            }
+        }
+    });
+}
+
+// mxcl: a row of b or out is a row of every block of its block row. Workers take block rows
+// of out, so every block of out is written by one thread
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const CsrMatrix<T>& a, const mxcl::Matrix<T, QSize, Layout, Alloc>& b,
+          mxcmn::NonDeducedT<T> beta, mxcl::Matrix<T, QSize, Layout, Alloc>& out, unsigned num_threads = 0)
+{
+    mxcmn::CheckCorrectGemmArgs(a, b, out);
+
+    const auto& row_ptr = a.GetRowPtr();
+    const auto& col_idx = a.GetColIdx();
+    const auto& values = a.GetValues();
+
+    mxcmn::BatchFor(out.GetNumQRows(), num_threads, [&](std::size_t i_qrow) {
+        const auto i_row_begin = static_cast<PositionT>(i_qrow * QSize);
+        const auto i_row_end = std::min<PositionT>(i_row_begin + QSize, out.GetNumRows());
+        for (PositionT i_qcol = 0; i_qcol < out.GetNumQCols(); ++i_qcol)
+        {
+            auto& out_qm = out.GetQMatrix(i_qrow, i_qcol);
+            for (PositionT i_row = i_row_begin; i_row < i_row_end; ++i_row)
+            {
+                auto& out_row = out_qm.m_buf[i_row - i_row_begin];
+                ScaleRow(out_row.data(), QSize, beta);
+                for (auto p = row_ptr[i_row]; p < row_ptr[i_row + 1]; ++p)
+                {
+                    const T value = alpha * values[p];
+                    const auto& b_row = b.GetQMatrix(col_idx[p] / QSize, i_qcol).m_buf[col_idx[p] % QSize];
+                    for (PositionT i_col = 0; i_col < QSize; ++i_col)
+                    {
+                        out_row[i_col] += value * b_row[i_col];
+                    }
+                }
+            }
+        }
+    });
+}
+
+// BsrMatrix ----------------------------------------------------------------------------------------
+
+// Block row iq has the non-zero blocks GetQMatrix(p) in block columns qcol_idx[p] for
+// p in [qrow_ptr[iq], qrow_ptr[iq + 1]). Blocks on the right and bottom edges are zero padded
+template <typename T, std::size_t QSize>
+class BsrMatrix
+{
+public:
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    BsrMatrix(SizeT num_rows, SizeT num_cols, std::vector<std::size_t> qrow_ptr,
+              std::vector<PositionT> qcol_idx, std::vector<QMatrix> qbuf);
+
+    // Keeps the blocks of dense that have a non-zero, M is any engine with operator[]
+    template <typename M>
+    static BsrMatrix FromDense(const M& dense);
+    template <typename M>
+    M ToDense() const;
+
+    inline SizeT GetNumRows() const noexcept { return m_num_rows; }
+    inline SizeT GetNumCols() const noexcept { return m_num_cols; }
+    inline SizeT GetNumQRows() const noexcept { return CalcQNumFromNum(m_num_rows); }
+    inline SizeT GetNumQCols() const noexcept { return CalcQNumFromNum(m_num_cols); }
+    inline std::size_t GetNumNonZeroBlocks() const noexcept { return m_qbuf.size(); }
+
+    inline const std::vector<std::size_t>& GetQRowPtr() const noexcept { return m_qrow_ptr; }
+    inline const std::vector<PositionT>& GetQColIdx() const noexcept { return m_qcol_idx; }
+    inline const QMatrix& GetQMatrix(std::size_t i_block) const noexcept { return m_qbuf[i_block]; }
+
+    // Number of used rows (cols) in block i_q of a side of size elements
+    static SizeT CalcQExtent(SizeT size, PositionT i_q) noexcept
+    {
+        return std::min<SizeT>(QSize, size - i_q * QSize);
+    }
+
+private:
+    static SizeT CalcQNumFromNum(SizeT size) noexcept
+    {
+        return size / QSize + (size % QSize != 0);
+    }
+
+private:
+    SizeT m_num_rows, m_num_cols;
+    std::vector<std::size_t> m_qrow_ptr;
+    std::vector<PositionT> m_qcol_idx;
+    std::vector<QMatrix> m_qbuf;
+};
+
+template <typename T, std::size_t QSize>
+BsrMatrix<T, QSize>::BsrMatrix(SizeT num_rows, SizeT num_cols, std::vector<std::size_t> qrow_ptr,
+                               std::vector<PositionT> qcol_idx, std::vector<QMatrix> qbuf)
+    : m_num_rows{ num_rows },
+      m_num_cols{ num_cols },
+      m_qrow_ptr(std::move(qrow_ptr)),
+      m_qcol_idx(std::move(qcol_idx)),
+      m_qbuf(std::move(qbuf))
+{
+    if (num_rows == 0 || num_cols == 0)
+    {
+        throw std::invalid_argument("num_rows and num_cols must be above zero");
+    }
+
+    const auto num_qcols = GetNumQCols();
+    const bool is_correct = m_qrow_ptr.size() == std::size_t{ GetNumQRows() } + 1 && m_qrow_ptr.front() == 0 &&
+                            m_qrow_ptr.back() == m_qcol_idx.size() && m_qcol_idx.size() == m_qbuf.size() &&
+                            std::is_sorted(m_qrow_ptr.begin(), m_qrow_ptr.end()) &&
+                            std::all_of(m_qcol_idx.begin(), m_qcol_idx.end(),
+                                        [num_qcols](PositionT i_qcol) { return i_qcol < num_qcols; });
+    if (!is_correct)
+    {
+        throw std::invalid_argument("Invalide BSR arrays");
+    }
+}
+
+template <typename T, std::size_t QSize>
+template <typename M>
+BsrMatrix<T, QSize> BsrMatrix<T, QSize>::FromDense(const M& dense)
+{
+    const auto num_rows = dense.GetNumRows(), num_cols = dense.GetNumCols();
+    const auto num_qrows = CalcQNumFromNum(num_rows), num_qcols = CalcQNumFromNum(num_cols);
+
+    std::vector<std::size_t> qrow_ptr(std::size_t{ num_qrows } + 1);
+    std::vector<PositionT> qcol_idx;
+    std::vector<QMatrix> qbuf;
+    for (PositionT i_qrow = 0; i_qrow < num_qrows; ++i_qrow)
+    {
+        const auto num_block_rows = CalcQExtent(num_rows, i_qrow);
+        for (PositionT i_qcol = 0; i_qcol < num_qcols; ++i_qcol)
+        {
+            const auto num_block_cols = CalcQExtent(num_cols, i_qcol);
+
+            QMatrix qm{};
+            bool is_zero = true;
+            for (PositionT i_row = 0; i_row < num_block_rows; ++i_row)
+            {
+                const auto& row = dense[i_qrow * QSize + i_row];
+                for (PositionT i_col = 0; i_col < num_block_cols; ++i_col)
+                {
+                    qm.m_buf[i_row][i_col] = row[i_qcol * QSize + i_col];
+                    is_zero = is_zero && qm.m_buf[i_row][i_col] == T{};
+                }
+            }
+
+            if (!is_zero)
+            {
+                qcol_idx.push_back(i_qcol);
+                qbuf.push_back(qm);
+            }
+        }
+        qrow_ptr[i_qrow + 1] = qbuf.size();
+    }
+
+    return { num_rows, num_cols, std::move(qrow_ptr), std::move(qcol_idx), std::move(qbuf) };
+}
+
+template <typename T, std::size_t QSize>
+template <typename M>
+M BsrMatrix<T, QSize>::ToDense() const
+{
+    M dense{ m_num_rows, m_num_cols };
+    for (PositionT i_qrow = 0; i_qrow < GetNumQRows(); ++i_qrow)
+    {
+        const auto num_block_rows = CalcQExtent(m_num_rows, i_qrow);
+        for (auto p = m_qrow_ptr[i_qrow]; p < m_qrow_ptr[i_qrow + 1]; ++p)
+        {
+            const auto i_qcol = m_qcol_idx[p];
+            const auto num_block_cols = CalcQExtent(m_num_cols, i_qcol);
+            for (PositionT i_row = 0; i_row < num_block_rows; ++i_row)
+            {
+                for (PositionT i_col = 0; i_col < num_block_cols; ++i_col)
+                {
+                    dense[i_qrow * QSize + i_row][i_qcol * QSize + i_col] = m_qbuf[p].m_buf[i_row][i_col];
+                }
+            }
+        }
+    }
+
+    return dense;
+}
+
+template <typename T, std::size_t QSize>
+void Gemv(mxcmn::NonDeducedT<T> alpha, const BsrMatrix<T, QSize>& a, const T* x, mxcmn::NonDeducedT<T> beta,
+          T* y, unsigned num_threads = 0)
+{
+    const auto& qrow_ptr = a.GetQRowPtr();
+    const auto& qcol_idx = a.GetQColIdx();
+    const auto num_rows = a.GetNumRows(), num_cols = a.GetNumCols();
+
+    SparseFor(qrow_ptr, QSize * QSize, num_threads, [&](PositionT i_qrow_begin, PositionT i_qrow_end) {
+        for (PositionT i_qrow = i_qrow_begin; i_qrow < i_qrow_end; ++i_qrow)
+        {
+            const auto num_block_rows = a.CalcQExtent(num_rows, i_qrow);
+
+            std::array<T, QSize> values{};
+            for (auto p = qrow_ptr[i_qrow]; p < qrow_ptr[i_qrow + 1]; ++p)
+            {
+                const auto& qm = a.GetQMatrix(p);
+                const T* x_block = x + qcol_idx[p] * QSize;
+                const auto num_block_cols = a.CalcQExtent(num_cols, qcol_idx[p]);
+                for (PositionT i_row = 0; i_row < num_block_rows; ++i_row)
+                {
+                    T value{};
+                    for (PositionT i_col = 0; i_col < num_block_cols; ++i_col)
+                    {
+                        value += qm.m_buf[i_row][i_col] * x_block[i_col];
+                    }
+                    values[i_row] += value;
+                }
+            }
+
+            for (PositionT i_row = 0; i_row < num_block_rows; ++i_row)
+            {
+                mxcmn::StoreScaled(y[i_qrow * QSize + i_row], values[i_row], alpha, beta);
+            }
+        }
+    });
+}
+
+// Row-major b: rows of the out block row are sums of rows of b, as for CSR
+template <typename T, std::size_t QSize, typename M>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const BsrMatrix<T, QSize>& a, const M& b, mxcmn::NonDeducedT<T> beta,
+          M& out, unsigned num_threads = 0)
+{
+    static_assert(mxcmn::HasView<M>, "Dense operand must be row-major or mxcl with the QSize of the blocks");
+    mxcmn::CheckCorrectGemmArgs(a, b, out);
+
+    const auto& qrow_ptr = a.GetQRowPtr();
+    const auto& qcol_idx = a.GetQColIdx();
+    const auto num_rows = a.GetNumRows(), num_k = a.GetNumCols(), num_cols = b.GetNumCols();
+    const auto b_view = b.GetView();
+    const auto out_view = out.GetView();
+
+    SparseFor(qrow_ptr, std::size_t{ QSize } * QSize * num_cols, num_threads,
+              [&](PositionT i_qrow_begin, PositionT i_qrow_end) {
+        for (PositionT i_row = i_qrow_begin * QSize; i_row < std::min<SizeT>(i_qrow_end * QSize, num_rows); ++i_row)
+        {
+            const auto i_qrow = i_row / QSize;
+            T* out_row = out_view.GetRowPtr(i_row);
+            ScaleRow(out_row, num_cols, beta);
+            for (auto p = qrow_ptr[i_qrow]; p < qrow_ptr[i_qrow + 1]; ++p)
+            {
+                const auto& block_row = a.GetQMatrix(p).m_buf[i_row % QSize];
+                const auto num_block_cols = a.CalcQExtent(num_k, qcol_idx[p]);
+                for (PositionT i_k = 0; i_k < num_block_cols; ++i_k)
+                {
+                    if (block_row[i_k] == T{})
+                    {
+                        continue;
+                    }
+
+                    const T value = alpha * block_row[i_k];
+                    const T* b_row = b_view.GetRowPtr(qcol_idx[p] * QSize + i_k);
+                    for (PositionT i_col = 0; i_col < num_cols; ++i_col)
+                    {
+                        out_row[i_col] += value * b_row[i_col];
+                    }
+                }
+            }
+        }
+    });
+}
+
+// mxcl b with the same QSize: out(iq, jq) += A(iq, kq) * b(kq, jq) for the stored blocks
+// of a on the QMatrix kernel. Blocks of b are transposed (and scaled by alpha) once
+template <typename T, std::size_t QSize, typename Layout, typename Alloc>
+void Gemm(mxcmn::NonDeducedT<T> alpha, const BsrMatrix<T, QSize>& a, const mxcl::Matrix<T, QSize, Layout, Alloc>& b,
+          mxcmn::NonDeducedT<T> beta, mxcl::Matrix<T, QSize, Layout, Alloc>& out, unsigned num_threads = 0)
+{
+    using QMatrix = qmx::QMatrix<T, QSize>;
+
+    mxcmn::CheckCorrectGemmArgs(a, b, out);
+
+    const auto num_qcols = b.GetNumQCols();
+    std::vector<QMatrix> b_tr(std::size_t{ b.GetNumQRows() } * num_qcols);
+    mxcmn::BatchFor(b.GetNumQRows(), num_threads, [&](std::size_t i_qrow) {
+        for (PositionT i_qcol = 0; i_qcol < num_qcols; ++i_qcol)
+        {
+            auto& qm_tr = b_tr[i_qrow * num_qcols + i_qcol];
+            b.GetQMatrix(i_qrow, i_qcol).Transpose(qm_tr);
+            if (alpha != T{1})
+            {
+                qm_tr.Scale(alpha);
+            }
+        }
+    });
+
+    const auto& qrow_ptr = a.GetQRowPtr();
+    const auto& qcol_idx = a.GetQColIdx();
+    SparseFor(qrow_ptr, std::size_t{ QSize } * QSize * QSize * num_qcols, num_threads,
+              [&](PositionT i_qrow_begin, PositionT i_qrow_end) {
+        for (PositionT i_qrow = i_qrow_begin; i_qrow < i_qrow_end; ++i_qrow)
+        {
+            for (PositionT i_qcol = 0; i_qcol < num_qcols; ++i_qcol)
+            {
+                auto& out_qm = out.GetQMatrix(i_qrow, i_qcol);
+                if (beta == T{})
+                {
+                    out_qm.Fill(0);
+                }
+                else if (beta != T{1})
+                {
+                    out_qm.Scale(beta);
+                }
+
+                for (auto p = qrow_ptr[i_qrow]; p < qrow_ptr[i_qrow + 1]; ++p)
+                {
+                    out_qm.MultAddToTransposed(a.GetQMatrix(p), b_tr[qcol_idx[p] * num_qcols + i_qcol]);
+                }
+            }
+        }
+    });
+}
+
+} // namespace mxsp
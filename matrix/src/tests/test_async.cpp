@@ -0,0 +1,187 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// MultiplyAsync and MultiplyPipeline against the same products one by one
+
+template <typename M>
+void PipelineTest(std::size_t num_items)
+{
+    std::vector<M> lhs, rhs, res_ref;
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        const mxcmn::SizeT size = 20 + 7 * (i_item % 4);
+        lhs.push_back(GetRandomMatrix<M>(size, size + i_item % 3, -8, 8));
+        rhs.push_back(GetRandomMatrix<M>(size + i_item % 3, size + 1, -8, 8));
+        res_ref.push_back(lhs.back());
+        res_ref.back() *= rhs.back();
+    }
+
+    mxcmn::MultiplyPipeline<M> pipeline{ 3 };
+    std::vector<std::future<M>> res;
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        res.push_back(pipeline.Submit(lhs[i_item], rhs[i_item]));
+    }
+
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        const auto out = res[i_item].get();
+        MATRIX_IS_EQ(out, res_ref[i_item]);
+    }
+}
+
+TEST(MultiplyAsync, Future)
+{
+    using M = mxclpl::Matrix<long, 16>;
+    const auto a = GetRandomMatrix<M>(40, 33, -8, 8);
+    const auto b = GetRandomMatrix<M>(33, 21, -8, 8);
+    auto res_ref = a;
+    res_ref *= b;
+
+    M out{40, 21};
+    auto future = mxcmn::MultiplyAsync(a, b, out);
+    future.get();
+    MATRIX_IS_EQ(out, res_ref);
+
+    M bad_out{40, 22};
+    EXPECT_THROW(mxcmn::MultiplyAsync(a, b, bad_out).get(), std::invalid_argument);
+}
+
+TEST(MultiplyAsync, Pipeline)
+{
+    PipelineTest<mxclpl::Matrix<long, 16>>(20);
+    PipelineTest<mxnvpl::Matrix<long>>(20);
+    PipelineTest<mxcl::Matrix<double, 16>>(10);
+    PipelineTest<mxgemm::Matrix<float>>(10);
+}
+
+// A failed product does not stop the next ones
+TEST(MultiplyAsync, PipelineError)
+{
+    using M = mxclpl::Matrix<long, 16>;
+    const auto a = GetRandomMatrix<M>(30, 30, -8, 8);
+    auto res_ref = a;
+    res_ref *= a;
+
+    mxcmn::MultiplyPipeline<M> pipeline;
+    auto bad = pipeline.Submit(a, M{ 31, 30 });
+    auto good = pipeline.Submit(a, a);
+    EXPECT_THROW(bad.get(), std::invalid_argument);
+    const auto out = good.get();
+    MATRIX_IS_EQ(out, res_ref);
+}
+
+TEST(MultiplyAsync, PackRhs)
+{
+    using M = mxclpl::Matrix<long, 16>;
+    const auto a = GetRandomMatrix<M>(20, 30, -8, 8);
+    const auto b = GetRandomMatrix<M>(30, 10, -8, 8);
+    const auto c = GetRandomMatrix<M>(20, 30, -8, 8);
+
+    M out{20, 10};
+    EXPECT_THROW(out.GemmPacked(a, 0), std::logic_error);
+
+    // One packed rhs serves several lhs
+    out.PackRhs(2, b);
+    for (const auto* lhs : { &a, &c })
+    {
+        M out_ref{20, 10};
+        out_ref.Gemm(2, *lhs, b, 0);
+        out.GemmPacked(*lhs, 0);
+        MATRIX_IS_EQ(out, out_ref);
+    }
+    out.ReleaseScratch();
+    EXPECT_THROW(out.GemmPacked(a, 0), std::logic_error);
+
+    // Copy-assignment drops the packed rhs, which was packed for another number of columns
+    const M wide{20, 64};
+    out.PackRhs(2, b);
+    out = wide;
+    EXPECT_THROW(out.GemmPacked(a, 0), std::logic_error);
+}
+
+// Submitted tasks wait for the existing workers instead of starting new ones
+TEST(MultiplyAsync, WorkersBounded)
+{
+    using M = mxclpl::Matrix<long, 16>;
+    auto& pool = mxcmn::ThreadPool::Get();
+    const unsigned num_workers = std::max(pool.GetNumWorkers(), 1u);
+
+    const auto a = GetRandomMatrix<M>(20, 20, -8, 8);
+    auto res_ref = a;
+    res_ref *= a;
+
+    const std::size_t num_items = 200;
+    std::vector<M> outs(num_items, M{ 20, 20, 2 });
+    std::vector<std::future<void>> futures;
+    for (auto& out : outs)
+    {
+        futures.push_back(mxcmn::MultiplyAsync(a, a, out));
+    }
+
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        futures[i_item].get();
+        MATRIX_IS_EQ(outs[i_item], res_ref);
+    }
+    EXPECT_LE(pool.GetNumWorkers(), num_workers);
+}
+
+// Run grows the pool up to a worker per hardware thread and rethrows the exception of a task
+// after the other tasks are finished, tasks of the calling thread included
+TEST(ThreadPool, RunBoundedAndRethrows)
+{
+    auto& pool = mxcmn::ThreadPool::Get();
+    const unsigned max_workers = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::atomic<unsigned> num_runs{ 0 };
+    pool.Run(4 * max_workers + 1, [&](unsigned) { ++num_runs; });
+    EXPECT_EQ(num_runs, 4 * max_workers + 1);
+    EXPECT_LE(pool.GetNumWorkers(), max_workers);
+
+    for (unsigned i_throwing : {0u, 5u})
+    {
+        std::atomic<unsigned> num_running{ 0 };
+        EXPECT_THROW(pool.Run(16, [&](unsigned i_task) {
+                         ++num_running;
+                         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                         --num_running;
+                         if (i_task == i_throwing)
+                         {
+                             throw std::runtime_error("Task failed");
+                         }
+                     }),
+                     std::runtime_error);
+        EXPECT_EQ(num_running, 0);
+    }
+
+    num_runs = 0;
+    pool.Run(8, [&](unsigned) { ++num_runs; });
+    EXPECT_EQ(num_runs, 8);
+}
+
+// Only prepare_depth products wait prepared behind the computed one
+TEST(MultiplyAsync, PipelinePrepareDepth)
+{
+    using M = mxclpl::Matrix<long, 16>;
+    const auto a = GetRandomMatrix<M>(40, 40, -8, 8);
+
+    for (std::size_t prepare_depth : { 1u, 2u })
+    {
+        mxcmn::MultiplyPipeline<M> pipeline{ 2, prepare_depth };
+        std::vector<std::future<M>> res;
+        for (std::size_t i_item = 0; i_item < 30; ++i_item)
+        {
+            res.push_back(pipeline.Submit(a, a));
+        }
+        for (auto& future : res)
+        {
+            future.get();
+        }
+
+        EXPECT_GE(pipeline.GetMaxNumAhead(), 1u);
+        EXPECT_LE(pipeline.GetMaxNumAhead(), prepare_depth);
+    }
+}
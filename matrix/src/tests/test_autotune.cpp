@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+
+#include "test_common.h"
+#include "../autotune.h"
+
+// Autotuner products against mxnv operator*=, winners survive a reload of the tune file
+
+TEST(Autotune, Multiply)
+{
+    const std::string tune_path = "test_autotune.txt";
+    std::remove(tune_path.c_str());
+
+    const std::vector<mxat::TuneConfig> candidates = {
+        { mxat::Engine::NativeTr, 0, 1 },
+        { mxat::Engine::CacheLike, 16, 1 },
+        { mxat::Engine::CacheLike, 32, 1 },
+        { mxat::Engine::CacheLikeParallel, 16, 2 },
+        { mxat::Engine::PackedGemm, 0, 1 }
+    };
+
+    using M = mxnv::Matrix<double>;
+    const auto a = GetRandomMatrix<M>(37, 20, -8, 8), b = GetRandomMatrix<M>(20, 45, -8, 8);
+    auto ab = a;
+    ab *= b;
+
+    mxat::TuneResult best{};
+    {
+        mxat::Autotuner<double> tuner{ tune_path, candidates };
+        M c{37, 45};
+        tuner.Multiply(a.GetView(), b.GetView(), c.GetView());
+        MATRIX_IS_EQ(c, ab);
+
+        best = tuner.GetBest(37, 20, 45);
+        ASSERT_EQ(tuner.Benchmark(37, 20, 45).size(), candidates.size());
+    }
+
+    // Other types keep their own winners in the same file
+    mxat::Autotuner<float> tuner_float{ tune_path, candidates };
+    tuner_float.GetBest(8, 8, 8);
+
+    mxat::Autotuner<double> tuner{ tune_path, candidates };
+    const auto loaded = tuner.GetBest(37, 20, 45);
+    ASSERT_EQ(loaded.config.engine, best.config.engine);
+    ASSERT_EQ(loaded.config.qsize, best.config.qsize);
+    ASSERT_EQ(loaded.config.num_threads, best.config.num_threads);
+    ASSERT_DOUBLE_EQ(loaded.time, best.time);
+
+    M c{37, 45};
+    tuner.Multiply(a.GetView(), b.GetView(), c.GetView());
+    MATRIX_IS_EQ(c, ab);
+
+    std::remove(tune_path.c_str());
+}
+
+// Saves of two types one after another leave one line per winner
+TEST(Autotune, TwoTypesRoundTrip)
+{
+    const std::string tune_path = "test_autotune_types.txt";
+    std::remove(tune_path.c_str());
+
+    const std::vector<mxat::TuneConfig> candidates = { { mxat::Engine::NativeTr, 0, 1 } };
+    for (int i_session = 0; i_session < 3; ++i_session)
+    {
+        mxat::Autotuner<double> tuner_double{ tune_path, candidates };
+        mxat::Autotuner<float> tuner_float{ tune_path, candidates };
+        tuner_double.GetBest(4, 5, 6 + i_session);
+        tuner_float.GetBest(8, 8, 8);
+        tuner_double.GetBest(4, 5, 6);
+    }
+
+    std::vector<std::string> lines;
+    {
+        std::ifstream file{ tune_path };
+        for (std::string line; std::getline(file, line);)
+        {
+            lines.push_back(line.substr(0, line.find(' ', line.find(' ') + 1)));
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+    const std::vector<std::string> expected = { "f4 8x8x8", "f8 4x5x6", "f8 4x5x7", "f8 4x5x8" };
+    EXPECT_EQ(lines, expected);
+
+    std::remove(tune_path.c_str());
+}
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// BatchMultiply against the same products one by one
+
+template <typename M>
+void BatchTest(mxcmn::SizeT size, std::size_t num_items, unsigned num_threads)
+{
+    std::vector<M> lhs, rhs;
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        lhs.push_back(GetRandomMatrix<M>(size, size + i_item % 3, -8, 8));
+        rhs.push_back(GetRandomMatrix<M>(size + i_item % 3, size, -8, 8));
+    }
+
+    auto res_ref = lhs;
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        res_ref[i_item] *= rhs[i_item];
+    }
+
+    mxcmn::BatchMultiply(lhs, rhs, num_threads);
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        MATRIX_IS_EQ(lhs[i_item], res_ref[i_item]);
+    }
+}
+
+TEST(BatchMultiply, Engines)
+{
+    for (unsigned num_threads : {0u, 1u, 3u})
+    {
+        BatchTest<mxnv::Matrix<long>>(17, 100, num_threads);
+        BatchTest<mxcl::Matrix<double, 16>>(30, 257, num_threads);
+        BatchTest<mxgemm::Matrix<float>>(5, 3, num_threads);
+    }
+
+    std::vector<mxnv::Matrix<long>> lhs(2, {2, 2}), rhs(3, {2, 2});
+    EXPECT_THROW(mxcmn::BatchMultiply(lhs, rhs), std::invalid_argument);
+}
+
+TEST(BatchMultiply, MismatchedPair)
+{
+    using M = mxcl::Matrix<double, 16>;
+
+    std::vector<M> lhs, rhs;
+    for (std::size_t i_item = 0; i_item < 64; ++i_item)
+    {
+        lhs.push_back(GetRandomMatrix<M>(8, 8, -8, 8));
+        rhs.push_back(GetRandomMatrix<M>(i_item == 40 ? 9 : 8, 8, -8, 8));
+    }
+    const auto lhs_ref = lhs;
+
+    for (unsigned num_threads : {1u, 4u})
+    {
+        ASSERT_THROW(mxcmn::BatchMultiply(lhs, rhs, num_threads), std::invalid_argument);
+        for (std::size_t i_item = 0; i_item < lhs.size(); ++i_item)
+        {
+            MATRIX_IS_EQ(lhs[i_item], lhs_ref[i_item]);
+        }
+    }
+
+    // Exceptions of the items reach the caller
+    ASSERT_THROW(mxcmn::BatchFor(1000, 4, [](std::size_t i_item) {
+                     if (i_item == 500)
+                     {
+                         throw std::runtime_error("Item failed");
+                     }
+                 }),
+                 std::runtime_error);
+}
+
+TEST(BatchMultiply, QMatrix)
+{
+    constexpr std::size_t N = 16;
+    using QM = qmx::QMatrix<double, N>;
+    using RefM = mxtr::Matrix<double>;
+
+    const std::size_t num_items = 500;
+    std::vector<QM> lhs(num_items), rhs(num_items);
+    std::vector<RefM> res_ref;
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        auto a = GetRandomMatrix<RefM>(N, N, -8, 8);
+        auto b = GetRandomMatrix<RefM>(N, N, -8, 8);
+        for (std::size_t i_row = 0; i_row < N; ++i_row)
+        {
+            for (std::size_t i_col = 0; i_col < N; ++i_col)
+            {
+                lhs[i_item].m_buf[i_row][i_col] = a[i_row][i_col];
+                rhs[i_item].m_buf[i_row][i_col] = b[i_row][i_col];
+            }
+        }
+
+        a *= b;
+        res_ref.push_back(std::move(a));
+    }
+
+    mxcmn::BatchMultiply(lhs, rhs);
+    for (std::size_t i_item = 0; i_item < num_items; ++i_item)
+    {
+        for (std::size_t i_row = 0; i_row < N; ++i_row)
+        {
+            for (std::size_t i_col = 0; i_col < N; ++i_col)
+            {
+                ASSERT_EQ(lhs[i_item].m_buf[i_row][i_col], res_ref[i_item][i_row][i_col]);
+            }
+        }
+    }
+}
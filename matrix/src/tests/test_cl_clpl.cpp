@@ -95,9 +95,149 @@ TEST(MatrixCacheLike, RandomTest)
     RandomTest <mxcl::Matrix<long, 128>>();
 }
 
+TEST(MatrixCacheLike, RandomTestMorton)
+{
+    RandomTest <mxcl::Matrix<long,  32, mxcl::MortonLayout>>();
+    RandomTest <mxcl::Matrix<long,  64, mxcl::MortonLayout>>();
+}
+
+TEST(MatrixCacheLike, MortonLayoutIsBijection)
+{
+    for (mxcmn::SizeT num_qrows : {1u, 2u, 3u, 5u, 8u})
+    {
+        for (mxcmn::SizeT num_qcols : {1u, 4u, 7u, 16u})
+        {
+            mxcl::MortonLayout layout{num_qrows, num_qcols};
+            std::vector<bool> used(num_qrows * num_qcols);
+            for (mxcmn::PositionT i_qrow = 0; i_qrow < num_qrows; ++i_qrow)
+            {
+                for (mxcmn::PositionT i_qcol = 0; i_qcol < num_qcols; ++i_qcol)
+                {
+                    const auto index = layout.GetIndex(i_qrow, i_qcol);
+                    ASSERT_LT(index, used.size());
+                    EXPECT_FALSE(used[index]);
+                    used[index] = true;
+                }
+            }
+        }
+    }
+
+    // 2 x 2 quadrants of a 4 x 4 grid are contiguous
+    mxcl::MortonLayout layout{4, 4};
+    EXPECT_EQ(layout.GetIndex(1, 1), 3);
+    EXPECT_EQ(layout.GetIndex(2, 0), 8);
+    EXPECT_EQ(layout.GetIndex(3, 3), 15);
+}
+
 TEST(MatrixCacheLikeParallel, RandomTest)
 {
     RandomTest <mxclpl::Matrix<long,  32>>();
     RandomTest <mxclpl::Matrix<long,  64>>();
     RandomTest <mxclpl::Matrix<long, 128>>();
 }
+
+// Values are small integers, so float and double products are exact regardless of summation order
+template <typename M>
+void RandomSingleMultTest()
+{
+    const mxcmn::SizeT num_row_min = QMatrixSize;
+    const std::size_t num_step = 3;
+
+    for (std::size_t i_step = 1; i_step <= num_step; ++i_step)
+    {
+        const auto num_row = i_step * num_row_min;
+        auto a = GetRandomMatrix<M>(num_row, num_row, -16, 16);
+        auto b = GetRandomMatrix<M>(num_row, num_row, -16, 16);
+
+        auto a_ref = CreateRefMatrix(a);
+        auto b_ref = CreateRefMatrix(b);
+
+        a *= b;
+        a_ref *= b_ref;
+        MATRIX_IS_EQ(a, a_ref);
+    }
+
+    // Sizes that are not multiples of QSize run the edge blocks
+    auto a = GetRandomMatrix<M>(37, 45, -16, 16);
+    const auto b = GetRandomMatrix<M>(45, 29, -16, 16);
+    auto a_ref = CreateRefMatrix(a);
+    const auto b_ref = CreateRefMatrix(b);
+
+    a *= b;
+    a_ref *= b_ref;
+    MATRIX_IS_EQ(a, a_ref);
+}
+
+TEST(MatrixCacheLike, RandomSingleMult)
+{
+    RandomSingleMultTest <mxcl::Matrix<float,   32>>();
+    RandomSingleMultTest <mxcl::Matrix<float,   64>>();
+    RandomSingleMultTest <mxcl::Matrix<double,  32>>();
+    RandomSingleMultTest <mxcl::Matrix<double,  64>>();
+    RandomSingleMultTest <mxcl::Matrix<double, 128>>();
+    RandomSingleMultTest <mxcl::Matrix<double,  32, mxcl::MortonLayout>>();
+}
+
+TEST(MatrixCacheLikeParallel, RandomSingleMult)
+{
+    RandomSingleMultTest <mxclpl::Matrix<float,  64>>();
+    RandomSingleMultTest <mxclpl::Matrix<double, 64>>();
+}
+
+// Packed rhs and temporary blocks stay in the arenas of the threads, repeated
+// multiplies of the same shapes do not grow them
+TEST(MatrixCacheLikeParallel, RepeatedMultReusesScratch)
+{
+    using M = mxclpl::Matrix<double, 64>;
+    const mxcmn::SizeT size = 150;
+    auto a = GetRandomMatrix<M>(size, size, -1, 1);
+    const auto b = GetRandomMatrix<M>(size, size, -1, 1);
+    auto a_ref = CreateRefMatrix(a);
+    const auto b_ref = CreateRefMatrix(b);
+
+    const auto& pack_arena = mxcmn::GetThreadScratch(mxcmn::ThreadScratch::Pack);
+    std::size_t pack_capacity = 0;
+    for (int i_mult = 0; i_mult < 4; ++i_mult)
+    {
+        a *= b;
+        a_ref *= b_ref;
+        MATRIX_IS_EQ(a, a_ref);
+
+        if (i_mult == 0)
+        {
+            pack_capacity = pack_arena.GetCapacity();
+            EXPECT_GE(pack_capacity, sizeof(qmx::QMatrix<double, 64>) * 9);
+        }
+        EXPECT_EQ(pack_arena.GetCapacity(), pack_capacity);
+    }
+}
+
+template <typename M>
+void RandomRectThreadsTest()
+{
+    const std::vector<std::array<mxcmn::SizeT, 3>> sizes = {
+        { 1, 1, 1 }, { 100, 70, 300 }, { 300, 200, 65 }, { 64, 640, 64 }
+    };
+
+    for (int num_threads = 1; num_threads <= 8; ++num_threads)
+    {
+        for (const auto& [m, k, n] : sizes)
+        {
+            auto a = GetRandomMatrix<M>(m, k, -16, 16, num_threads);
+            auto b = GetRandomMatrix<M>(k, n, -16, 16, num_threads);
+
+            auto a_ref = CreateRefMatrix(a);
+            auto b_ref = CreateRefMatrix(b);
+
+            a *= b;
+            a_ref *= b_ref;
+            MATRIX_IS_EQ(a, a_ref);
+        }
+    }
+}
+
+TEST(MatrixCacheLikeParallel, RandomRectThreads)
+{
+    RandomRectThreadsTest <mxclpl::Matrix<long,   32>>();
+    RandomRectThreadsTest <mxclpl::Matrix<double, 64>>();
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../matrix.h"
+#include "../other_func.hpp"
+
 #define MATRIX_IS_EQ(lhs, rhs)                                                                         \
     do                                                                                                 \
     {                                                                                                  \
@@ -39,3 +42,72 @@
             }                                                                                          \
         }                                                                                              \
     } while (0)
+
+// Integer values in [min, max], args go to the constructor after the sizes
+template <typename M, typename... Args>
+auto GetRandomMatrix(mxcmn::SizeT num_rows, mxcmn::SizeT num_cols, long min, long max, Args... args)
+{
+    M m{num_rows, num_cols, args...};
+
+    seclib::RandomGenerator rand;
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            m[i_row][i_col] = rand.get_rand_val<long>(min, max);
+        }
+    }
+
+    return m;
+}
+
+template <typename M, typename RefM>
+auto CopyMatrix(const RefM& ref)
+{
+    const auto [num_rows, num_cols] = GetNumRowsCols(ref);
+
+    M m{num_rows, num_cols};
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            m[i_row][i_col] = ref[i_row][i_col];
+        }
+    }
+
+    return m;
+}
+
+// Random operands of one product, the reference ones are mxtr matrices of the element type of MOut
+template <typename MIn, typename MOut = MIn>
+struct RandomGemmCase
+{
+    using RefM = mxtr::Matrix<mxcmn::MatrixValueT<MOut>>;
+
+    RefM a_ref, b_ref, c_ref;
+    // a_ref * b_ref
+    RefM ab_ref;
+    MIn a, b;
+    MOut c;
+};
+
+// Calls func(test_case) for a random product of every { m, k, n } of sizes, values are in [min, max]
+template <typename MIn, typename MOut = MIn, typename F>
+void ForEachRandomGemm(const std::vector<std::array<mxcmn::SizeT, 3>>& sizes, long min, long max, F&& func)
+{
+    using Case = RandomGemmCase<MIn, MOut>;
+    using RefM = typename Case::RefM;
+
+    for (const auto& [m, k, n] : sizes)
+    {
+        auto a_ref = GetRandomMatrix<RefM>(m, k, min, max);
+        auto b_ref = GetRandomMatrix<RefM>(k, n, min, max);
+        auto c_ref = GetRandomMatrix<RefM>(m, n, min, max);
+        auto ab_ref = a_ref;
+        ab_ref *= b_ref;
+
+        Case test_case{ a_ref, b_ref, c_ref, ab_ref, CopyMatrix<MIn>(a_ref), CopyMatrix<MIn>(b_ref),
+                        CopyMatrix<MOut>(c_ref) };
+        func(test_case);
+    }
+}
@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Expressions against the same arithmetic done step by step on mxnv.
+// Values are small integers in double, the sums are exact
+
+using RefM = mxnv::Matrix<double>;
+
+template <typename F>
+RefM Elementwise(const RefM& src, F func)
+{
+    RefM res{ src.GetNumRows(), src.GetNumCols() };
+    for (mxcmn::PositionT i_row = 0; i_row < src.GetNumRows(); ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < src.GetNumCols(); ++i_col)
+        {
+            res[i_row][i_col] = func(i_row, i_col, src[i_row][i_col]);
+        }
+    }
+    return res;
+}
+
+template <typename M>
+void ExprTest(mxcmn::SizeT num_rows, mxcmn::SizeT num_k, mxcmn::SizeT num_cols, unsigned num_threads)
+{
+    const auto a_ref = GetRandomMatrix<RefM>(num_rows, num_k, -8, 8);
+    const auto b_ref = GetRandomMatrix<RefM>(num_k, num_cols, -8, 8);
+    const auto c_ref = GetRandomMatrix<RefM>(num_rows, num_cols, -8, 8);
+    const auto a = CopyMatrix<M>(a_ref), b = CopyMatrix<M>(b_ref), c = CopyMatrix<M>(c_ref);
+
+    auto ab_ref = a_ref;
+    ab_ref *= b_ref;
+
+    std::vector<mxcmn::MatrixValueT<M>> bias(num_cols);
+    for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+    {
+        bias[i_col] = static_cast<double>(i_col % 7) - 3;
+    }
+
+    // d = A * B + C
+    auto d = CopyMatrix<M>(c_ref);
+    mxex::Assign(d, mxex::Lazy(a) * b + c, num_threads);
+    const auto sum_ref = Elementwise(ab_ref, [&](auto i, auto j, double v) { return v + c_ref[i][j]; });
+    MATRIX_IS_EQ(d, sum_ref);
+
+    // d = relu(2 * A * B - C + bias) * 3 + 1
+    const auto expr = mxex::Relu(mxex::AddBias(2 * mxex::Lazy(a) * b - c, bias)) * 3 + 1;
+    mxex::Assign(d, expr, num_threads);
+    const auto relu_ref = Elementwise(ab_ref, [&](auto i, auto j, double v) {
+        return std::max(2 * v - c_ref[i][j] + bias[j], 0.0) * 3 + 1;
+    });
+    MATRIX_IS_EQ(d, relu_ref);
+
+    // d = A * B + 2 * d is beta of Gemm
+    d = CopyMatrix<M>(c_ref);
+    mxex::Assign(d, mxex::Lazy(a) * b + 2 * mxex::Lazy(d), num_threads);
+    const auto beta_ref = Elementwise(ab_ref, [&](auto i, auto j, double v) { return v + 2 * c_ref[i][j]; });
+    MATRIX_IS_EQ(d, beta_ref);
+
+    // No product: d = (C - d) * 0.5
+    mxex::Assign(d, (mxex::Lazy(c) - d) * 0.5, num_threads);
+    const auto diff_ref = Elementwise(ab_ref, [&](auto i, auto j, double v) {
+        return (c_ref[i][j] - v - 2 * c_ref[i][j]) * 0.5;
+    });
+    MATRIX_IS_EQ(d, diff_ref);
+
+    const auto e = mxex::Eval<M>(mxex::Map(mxex::Lazy(a) * b, [](double v) { return v * v; }), num_threads);
+    const auto square_ref = Elementwise(ab_ref, [](auto, auto, double v) { return v * v; });
+    MATRIX_IS_EQ(e, square_ref);
+
+    // d = A * B + C * F: one product per expression, the second one comes as beta
+    const auto f_ref = GetRandomMatrix<RefM>(num_cols, num_cols, -8, 8);
+    const auto f = CopyMatrix<M>(f_ref);
+    mxex::Assign(d, mxex::Lazy(c) * f, num_threads);
+    mxex::Assign(d, mxex::Lazy(a) * b + d, num_threads);
+    auto cf_ref = c_ref;
+    cf_ref *= f_ref;
+    const auto two_ref = Elementwise(ab_ref, [&](auto i, auto j, double v) { return v + cf_ref[i][j]; });
+    MATRIX_IS_EQ(d, two_ref);
+
+    // out is read after the product has overwritten it
+    ASSERT_THROW(mxex::Assign(d, mxex::Relu(mxex::Lazy(a) * b) + d), std::invalid_argument);
+    auto a_copy = a;
+    if (num_rows == num_k && num_k == num_cols)
+    {
+        ASSERT_THROW(mxex::Assign(a_copy, mxex::Lazy(a_copy) * b), std::invalid_argument);
+    }
+    else
+    {
+        ASSERT_THROW(mxex::Lazy(b) * a, std::invalid_argument);
+    }
+}
+
+TEST(Expr, Engines)
+{
+    for (const unsigned num_threads : { 1u, 0u })
+    {
+        ExprTest<mxnv::Matrix<double>>(70, 90, 33, num_threads);
+        ExprTest<mxtr::Matrix<double>>(1, 5, 3, num_threads);
+        ExprTest<mxgemm::Matrix<double>>(300, 300, 300, num_threads);
+        ExprTest<mxgemm::Matrix<float>>(67, 301, 45, num_threads);
+        ExprTest<mxnvpl::Matrix<double>>(130, 20, 260, num_threads);
+        ExprTest<mxcl::Matrix<double, 16>>(70, 90, 33, num_threads);
+        ExprTest<mxclpl::Matrix<double, 16>>(64, 64, 64, num_threads);
+    }
+}
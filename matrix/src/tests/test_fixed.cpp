@@ -0,0 +1,164 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Fixed-size products against plain loops, values are small integers, sums are exact
+
+namespace
+{
+
+constexpr auto Id4 = mxfx::FixedMatrix<double, 4, 4>::Identity();
+constexpr auto Threes4 = mxfx::FixedMatrix<double, 4, 4>::Filled(3);
+constexpr mxfx::FixedMatrix<int, 2, 3> Mat23 = { { { { 1, 2, 3 }, { 4, 5, 6 } } } };
+
+// The whole interface is evaluated at compile time
+static_assert(Id4 * Threes4 == Threes4);
+static_assert((Threes4 * Threes4)(1, 2) == 36);
+static_assert((Id4 + Id4 - Id4) * 2.0 == 2.0 * Id4);
+static_assert(Mat23.Transpose()(2, 1) == 6 && Mat23.Transpose().GetNumRows() == 3);
+static_assert((Mat23 * Mat23.Transpose())(1, 1) == 77);
+
+template <typename T, std::size_t R, std::size_t C>
+mxfx::FixedMatrix<T, R, C> GetRandomFixed(long min, long max)
+{
+    seclib::RandomGenerator rand;
+    mxfx::FixedMatrix<T, R, C> res{};
+    for (std::size_t i_row = 0; i_row < R; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < C; ++i_col)
+        {
+            res(i_row, i_col) = static_cast<T>(rand.get_rand_val<long>(min, max));
+        }
+    }
+    return res;
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+mxfx::FixedMatrix<T, R, C> MultiplyRef(const mxfx::FixedMatrix<T, R, K>& lhs, const mxfx::FixedMatrix<T, K, C>& rhs)
+{
+    mxfx::FixedMatrix<T, R, C> res{};
+    for (std::size_t i_row = 0; i_row < R; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < C; ++i_col)
+        {
+            for (std::size_t k = 0; k < K; ++k)
+            {
+                res(i_row, i_col) += lhs(i_row, k) * rhs(k, i_col);
+            }
+        }
+    }
+    return res;
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+void FixedMultiplyTest()
+{
+    for (int i_repeat = 0; i_repeat < 8; ++i_repeat)
+    {
+        const auto a = GetRandomFixed<T, R, K>(-8, 8);
+        const auto b = GetRandomFixed<T, K, C>(-8, 8);
+        const auto c = GetRandomFixed<T, R, C>(-8, 8);
+
+        const auto ab_ref = MultiplyRef(a, b);
+        const auto ab = a * b;
+        MATRIX_IS_EQ(ab, ab_ref);
+
+        auto d = c;
+        mxfx::MultAdd(d, a, b);
+        const auto d_ref = c + ab_ref;
+        MATRIX_IS_EQ(d, d_ref);
+
+        const auto a_tr = a.Transpose();
+        for (std::size_t i_row = 0; i_row < R; ++i_row)
+        {
+            for (std::size_t k = 0; k < K; ++k)
+            {
+                ASSERT_EQ(a_tr(k, i_row), a(i_row, k));
+            }
+        }
+    }
+}
+
+} // namespace
+
+TEST(FixedMatrix, Multiply)
+{
+    FixedMultiplyTest<double, 4, 4, 4>();
+    FixedMultiplyTest<float, 8, 8, 8>();
+    FixedMultiplyTest<double, 8, 8, 8>();
+    FixedMultiplyTest<float, 4, 4, 4>();
+    FixedMultiplyTest<int, 4, 4, 4>();
+    FixedMultiplyTest<double, 3, 5, 2>();
+    FixedMultiplyTest<float, 5, 3, 16>();
+    FixedMultiplyTest<double, 16, 16, 16>();
+
+    // rhs of double 8 x 8 alone takes all 16 YMM registers
+    static_assert(!mxfx::avx::HasMultAddKernel<double, 8, 8>);
+    static_assert(mxfx::avx::HasMultAddKernel<double, 4, 4> == QMX_HAS_AVX2_FMA);
+    static_assert(mxfx::avx::HasMultAddKernel<float, 8, 8> == QMX_HAS_AVX2_FMA);
+}
+
+TEST(FixedMatrix, Aliasing)
+{
+    const auto a = GetRandomFixed<double, 4, 4>(-8, 8);
+    const auto b = GetRandomFixed<double, 4, 4>(-8, 8);
+
+    // res is lhs
+    auto d = a;
+    mxfx::MultAdd(d, d, b);
+    const auto lhs_ref = a + MultiplyRef(a, b);
+    MATRIX_IS_EQ(d, lhs_ref);
+
+    // res is rhs
+    d = b;
+    mxfx::MultAdd(d, a, d);
+    const auto rhs_ref = b + MultiplyRef(a, b);
+    MATRIX_IS_EQ(d, rhs_ref);
+
+    auto e = GetRandomFixed<int, 4, 4>(-8, 8);
+    const auto e_ref = MultiplyRef(e, e) + e;
+    mxfx::MultAdd(e, e, e);
+    MATRIX_IS_EQ(e, e_ref);
+}
+
+// C = A * B over the blocks of mxcl matrices
+template <typename T, std::size_t QSize>
+void BlockMultiplyTest(mxcmn::SizeT num_rows, mxcmn::SizeT num_k, mxcmn::SizeT num_cols)
+{
+    using M = mxcl::Matrix<T, QSize>;
+    const auto a = GetRandomMatrix<M>(num_rows, num_k, -8, 8);
+    const auto b = GetRandomMatrix<M>(num_k, num_cols, -8, 8);
+
+    M c{ num_rows, num_cols };
+    for (mxcmn::PositionT i_qrow = 0; i_qrow < c.GetNumQRows(); ++i_qrow)
+    {
+        for (mxcmn::PositionT i_qcol = 0; i_qcol < c.GetNumQCols(); ++i_qcol)
+        {
+            mxfx::FixedMatrix<T, QSize, QSize> block{};
+            for (mxcmn::PositionT k_q = 0; k_q < a.GetNumQCols(); ++k_q)
+            {
+                mxfx::MultAdd(block, mxfx::LoadQBlock(a, i_qrow, k_q), mxfx::LoadQBlock(b, k_q, i_qcol));
+            }
+            mxfx::StoreQBlock(c, i_qrow, i_qcol, block);
+        }
+    }
+
+    M c_ref{ num_rows, num_cols };
+    mxcl::Multiply(a, b, c_ref);
+    MATRIX_IS_EQ(c, c_ref);
+
+    const auto qmatrix = mxfx::ToQMatrix(mxfx::LoadQBlock(c, 0, 0));
+    ASSERT_EQ(mxfx::FromQMatrix(qmatrix), mxfx::LoadQBlock(c, 0, 0));
+
+    ASSERT_THROW(mxfx::LoadQBlock(a, a.GetNumQRows(), 0), std::invalid_argument);
+    ASSERT_THROW(mxfx::StoreQBlock(c, 0, c.GetNumQCols(), mxfx::FixedMatrix<T, QSize, QSize>{}),
+                 std::invalid_argument);
+}
+
+TEST(FixedMatrix, MxclBlocks)
+{
+    BlockMultiplyTest<double, 4>(10, 7, 13);
+    BlockMultiplyTest<float, 8>(17, 24, 9);
+    BlockMultiplyTest<double, 8>(8, 8, 8);
+}
@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Sizes are chosen to hit partial MR x NR tiles and several MC/KC panels
+
+template <typename T>
+void RandomRectTest()
+{
+    const std::vector<std::array<mxcmn::SizeT, 3>> sizes = {
+        { 1, 1, 1 }, { 7, 13, 5 }, { 6, 256, 16 }, { 150, 513, 97 }, { 73, 300, 145 }
+    };
+
+    ForEachRandomGemm<mxgemm::Matrix<T>>(sizes, -16, 16, [](auto& test_case) {
+        auto& [a_ref, b_ref, c_ref, ab_ref, a, b, c] = test_case;
+        a *= b;
+        MATRIX_IS_EQ(a, ab_ref);
+    });
+}
+
+TEST(MatrixGemm, RandomRect)
+{
+    RandomRectTest<long>();
+    RandomRectTest<float>();
+    RandomRectTest<double>();
+}
+
+// Without a KC panel c is only scaled by beta, c is not read when beta is zero
+TEST(MatrixGemm, EmptyK)
+{
+    const std::size_t m = 7, n = 13, ldc = 16;
+    std::vector<double> c(m * ldc, 3);
+    mxgemm::kernel::GemmParallel<double>(2, m, n, 0, 1, nullptr, 0, 1, nullptr, n, 1, 2, c.data(), ldc);
+    for (std::size_t i = 0; i < m; ++i)
+    {
+        for (std::size_t j = 0; j < ldc; ++j)
+        {
+            ASSERT_EQ(c[i * ldc + j], j < n ? 6 : 3);
+        }
+    }
+
+    std::fill(c.begin(), c.end(), std::numeric_limits<double>::quiet_NaN());
+    mxgemm::kernel::Gemm<double>(m, n, 0, 1, nullptr, 0, 1, nullptr, n, 1, 0, c.data(), ldc);
+    for (std::size_t i = 0; i < m; ++i)
+    {
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            ASSERT_EQ(c[i * ldc + j], 0);
+        }
+    }
+}
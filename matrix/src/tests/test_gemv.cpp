@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Gemv and MultiplyChain against mxnv operator*= on the same values
+
+using RefM = mxnv::Matrix<long>;
+
+template <typename M>
+void GemvTest()
+{
+    using T = mxcmn::MatrixValueT<M>;
+
+    const std::vector<std::pair<mxcmn::SizeT, mxcmn::SizeT>> sizes = {
+        { 1, 1 }, { 7, 5 }, { 70, 130 }, { 1030, 260 }
+    };
+
+    for (const auto& [num_rows, num_cols] : sizes)
+    {
+        const auto a_ref = GetRandomMatrix<RefM>(num_rows, num_cols, -8, 8);
+        auto x_ref = GetRandomMatrix<RefM>(num_cols, 1, -8, 8);
+        const auto y_ref = GetRandomMatrix<RefM>(num_rows, 1, -8, 8);
+
+        std::vector<T> x(num_cols), y(num_rows);
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            x[i_col] = x_ref[i_col][0];
+        }
+        for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+        {
+            y[i_row] = y_ref[i_row][0];
+        }
+
+        const auto a = CopyMatrix<M>(a_ref);
+        mxcmn::Gemv(2, a, x, 3, y);
+
+        auto ax_ref = a_ref;
+        ax_ref *= x_ref;
+        for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+        {
+            ASSERT_EQ(y[i_row], 2 * ax_ref[i_row][0] + 3 * y_ref[i_row][0]) << num_rows << 'x' << num_cols;
+        }
+    }
+
+    M a{3, 4};
+    std::vector<T> x(3), y(3);
+    ASSERT_THROW(mxcmn::Gemv(1, a, x, 0, y), std::invalid_argument);
+}
+
+TEST(Gemv, Engines)
+{
+    GemvTest<mxnv::Matrix<long>>();
+    GemvTest<mxtr::Matrix<double>>();
+    GemvTest<mxnvpl::Matrix<long>>();
+    GemvTest<mxcl::Matrix<long, 32>>();
+    GemvTest<mxcl::Matrix<double, 8, mxcl::MortonLayout>>();
+}
+
+TEST(Gemv, TransposedView)
+{
+    const auto a = GetRandomMatrix<RefM>(130, 70, -8, 8);
+    const auto x_ref = GetRandomMatrix<RefM>(1, 130, -8, 8);
+    std::vector<long> y(70);
+    mxcmn::Gemv<long>(1, a.GetView().Transposed(), x_ref.GetView().GetData(), 0, y.data());
+
+    auto xa_ref = x_ref;
+    xa_ref *= a;
+    for (mxcmn::PositionT i_col = 0; i_col < 70; ++i_col)
+    {
+        ASSERT_EQ(y[i_col], xa_ref[0][i_col]);
+    }
+}
+
+TEST(MultiplyChain, Order)
+{
+    // 30x35 * 35x15 * 15x5 * 5x10 * 10x20 * 20x25: ((A1 (A2 A3)) ((A4 A5) A6))
+    const auto order = mxcmn::CalcChainOrder({ { 30, 35 }, { 35, 15 }, { 15, 5 }, { 5, 10 }, { 10, 20 }, { 20, 25 } });
+    ASSERT_EQ(order.num_fmas, 15125);
+    ASSERT_EQ(order.splits[0][5], 2);
+    ASSERT_EQ(order.splits[0][2], 0);
+    ASSERT_EQ(order.splits[3][5], 4);
+
+    ASSERT_THROW(mxcmn::CalcChainOrder({ { 3, 4 }, { 5, 6 } }), std::invalid_argument);
+}
+
+template <typename M>
+void MultiplyChainTest()
+{
+    // Matrix-vector and vector-matrix steps are in the best order
+    const std::vector<std::vector<std::pair<mxcmn::SizeT, mxcmn::SizeT>>> chains = {
+        { { 13, 17 } },
+        { { 40, 3 }, { 3, 50 }, { 50, 1 } },
+        { { 1, 30 }, { 30, 70 }, { 70, 20 }, { 20, 45 } },
+        { { 30, 35 }, { 35, 15 }, { 15, 5 }, { 5, 10 }, { 10, 20 }, { 20, 25 } }
+    };
+
+    for (const auto& sizes : chains)
+    {
+        std::vector<RefM> refs;
+        std::vector<M> items;
+        for (const auto& [num_rows, num_cols] : sizes)
+        {
+            refs.push_back(GetRandomMatrix<RefM>(num_rows, num_cols, -4, 4));
+            items.push_back(CopyMatrix<M>(refs.back()));
+        }
+
+        std::vector<const M*> chain;
+        for (const auto& item : items)
+        {
+            chain.push_back(&item);
+        }
+        const auto res = mxcmn::MultiplyChain(chain);
+
+        auto res_ref = refs.front();
+        for (std::size_t i_item = 1; i_item < refs.size(); ++i_item)
+        {
+            res_ref *= refs[i_item];
+        }
+        MATRIX_IS_EQ(res, res_ref);
+    }
+
+    const auto a = GetRandomMatrix<M>(4, 6, -4, 4), b = GetRandomMatrix<M>(6, 1, -4, 4);
+    const auto c = GetRandomMatrix<M>(1, 5, -4, 4);
+    auto abc = a;
+    abc *= b;
+    abc *= c;
+    const auto res = mxcmn::MultiplyChain(a, b, c);
+    MATRIX_IS_EQ(res, abc);
+}
+
+TEST(MultiplyChain, Engines)
+{
+    MultiplyChainTest<mxnv::Matrix<long>>();
+    MultiplyChainTest<mxtr::Matrix<long>>();
+    MultiplyChainTest<mxnvpl::Matrix<long>>();
+    MultiplyChainTest<mxcl::Matrix<long, 16>>();
+    MultiplyChainTest<mxclpl::Matrix<long, 8>>();
+    MultiplyChainTest<mxgemm::Matrix<double>>();
+}
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "test_common.h"
+#include "../mapped_matrix.h"
+
+// Block files round trip and out-of-core products against mxcl in memory
+
+TEST(MappedMatrix, RoundTrip)
+{
+    const std::string path = "test_mapped_round_trip.bin";
+    using M = mxcl::Matrix<double, 16>;
+    using MM = mxcl::MappedMatrix<double, 16>;
+
+    const auto m = GetRandomMatrix<M>(70, 130, -100, 100);
+    {
+        auto mm = MM::Create(path, m);
+        mm[69][129] = 5;
+        mm.Flush();
+    }
+
+    const auto mm = MM::Open(path);
+    ASSERT_EQ(mm.GetNumRows(), 70);
+    ASSERT_EQ(mm.GetNumCols(), 130);
+    ASSERT_EQ(mm[69][129], 5);
+
+    M m_copy{70, 130};
+    mm.CopyTo(m_copy);
+    m_copy[69][129] = m[69][129];
+    MATRIX_IS_EQ(m_copy, m);
+
+    // Another value type or block size is not the same file format
+    ASSERT_THROW((mxcl::MappedMatrix<float, 16>::Open(path)), std::invalid_argument);
+    ASSERT_THROW((mxcl::MappedMatrix<double, 32>::Open(path)), std::invalid_argument);
+    std::ofstream{ path, std::ios::app } << "tail";
+    ASSERT_THROW(MM::Open(path), std::invalid_argument);
+
+    std::remove(path.c_str());
+}
+
+TEST(MappedMatrix, MultiplyOutOfCore)
+{
+    using M = mxcl::Matrix<long, 8>;
+    using MM = mxcl::MappedMatrix<long, 8>;
+
+    const auto a = GetRandomMatrix<M>(70, 45, -8, 8), b = GetRandomMatrix<M>(45, 130, -8, 8);
+    auto ab = a;
+    ab *= b;
+
+    const auto a_mm = MM::Create("test_mapped_a.bin", a), b_mm = MM::Create("test_mapped_b.bin", b);
+    // Budget of 3 block columns of b: panels of 3, 3, ... and the edge panel
+    for (std::size_t memory_budget : { std::size_t{ 1 }, 3 * 6 * sizeof(qmx::QMatrix<long, 8>), std::size_t{ 1 } << 30 })
+    {
+        auto c_mm = MM::Create("test_mapped_c.bin", 70, 130);
+        mxcl::MultiplyOutOfCore(a_mm, b_mm, c_mm, memory_budget);
+        MATRIX_IS_EQ(c_mm, ab);
+    }
+
+    auto c_mm = MM::Create("test_mapped_c.bin", 45, 45);
+    ASSERT_THROW(mxcl::MultiplyOutOfCore(a_mm, b_mm, c_mm), std::invalid_argument);
+
+    // out is not written through a read-only map or while it is still read as an operand
+    auto c_read_only = MM::Open("test_mapped_c.bin");
+    ASSERT_THROW(c_read_only[0][0] = 1, std::logic_error);
+    ASSERT_THROW(c_read_only.GetQMatrix(0, 0), std::logic_error);
+    auto sq_mm = MM::Create("test_mapped_sq.bin", 45, 45);
+    ASSERT_THROW(mxcl::MultiplyOutOfCore(c_mm, c_mm, c_read_only), std::invalid_argument);
+    ASSERT_THROW(mxcl::MultiplyOutOfCore(sq_mm, c_mm, sq_mm), std::invalid_argument);
+    ASSERT_THROW(mxcl::MultiplyOutOfCore(c_mm, sq_mm, sq_mm), std::invalid_argument);
+
+    std::remove("test_mapped_a.bin");
+    std::remove("test_mapped_b.bin");
+    std::remove("test_mapped_c.bin");
+    std::remove("test_mapped_sq.bin");
+}
@@ -223,4 +223,9 @@ TEST(MatrixNativeTranspose, Static)
 TEST(MatrixNativeParallel, Static)
 {
     TestStatic<mxnvpl::Matrix>();
-}
\ No newline at end of file
+}
+
+TEST(MatrixGemm, Static)
+{
+    TestStatic<mxgemm::Matrix>();
+}
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Out-of-place Multiply and Gemm against mxtr operator*=
+
+const std::vector<std::array<mxcmn::SizeT, 3>> GemmSizes = {
+    { 1, 1, 1 }, { 5, 7, 3 }, { 70, 65, 130 }
+};
+
+// 2 * a * b - 3 * c of the reference matrices
+template <typename Case>
+auto GetGemmRef(const Case& test_case)
+{
+    const auto& [a_ref, b_ref, c_ref, ab_ref, a, b, c] = test_case;
+
+    typename Case::RefM gemm_ref{ c_ref.GetNumRows(), c_ref.GetNumCols() };
+    for (mxcmn::PositionT i_row = 0; i_row < c_ref.GetNumRows(); ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < c_ref.GetNumCols(); ++i_col)
+        {
+            gemm_ref[i_row][i_col] = 2 * ab_ref[i_row][i_col] - 3 * c_ref[i_row][i_col];
+        }
+    }
+    return gemm_ref;
+}
+
+template <typename M>
+void GemmTest()
+{
+    ForEachRandomGemm<M>(GemmSizes, -8, 8, [](auto& test_case) {
+        auto& [a_ref, b_ref, c_ref, ab_ref, a, b, c] = test_case;
+        const auto gemm_ref = GetGemmRef(test_case);
+
+        Gemm(2, a, b, -3, c);
+        MATRIX_IS_EQ(c, gemm_ref);
+
+        // Same out buffer is reused, beta = 0 must not read it
+        Multiply(a, b, c);
+        MATRIX_IS_EQ(c, ab_ref);
+
+        Gemm(1, a, b, 1, c);
+        Gemm(-1, a, b, 1, c);
+        MATRIX_IS_EQ(c, ab_ref);
+
+        M c_bad{ c.GetNumRows() + 1, c.GetNumCols() };
+        EXPECT_THROW(Multiply(a, b, c_bad), std::invalid_argument);
+        EXPECT_THROW(Multiply(a, a, a), std::invalid_argument);
+    });
+}
+
+template <typename T>
+void GemmTestAllEngines()
+{
+    GemmTest<mxnv::Matrix<T>>();
+    GemmTest<mxtr::Matrix<T>>();
+    GemmTest<mxnvpl::Matrix<T>>();
+    GemmTest<mxcl::Matrix<T, 32>>();
+    GemmTest<mxcl::Matrix<T, 32, mxcl::MortonLayout>>();
+    GemmTest<mxclpl::Matrix<T, 32>>();
+    GemmTest<mxgemm::Matrix<T>>();
+}
+
+TEST(Multiply, GemmAllEngines)
+{
+    GemmTestAllEngines<long>();
+    GemmTestAllEngines<float>();
+    GemmTestAllEngines<double>();
+}
+
+template <typename T, typename Alloc>
+void GemmTestAllEnginesAlloc()
+{
+    GemmTest<mxnv::Matrix<T, Alloc>>();
+    GemmTest<mxtr::Matrix<T, Alloc>>();
+    GemmTest<mxnvpl::Matrix<T, Alloc>>();
+    GemmTest<mxcl::Matrix<T, 32, mxcl::RowMajorLayout, Alloc>>();
+    GemmTest<mxclpl::Matrix<T, 32, Alloc>>();
+    GemmTest<mxgemm::Matrix<T, Alloc>>();
+}
+
+TEST(Multiply, GemmAllocators)
+{
+    GemmTestAllEnginesAlloc<long, mxcmn::AlignedAllocator<long>>();
+    GemmTestAllEnginesAlloc<double, mxcmn::AlignedAllocator<double>>();
+    GemmTestAllEnginesAlloc<double, mxcmn::HugePageAllocator<double>>();
+}
+
+TEST(Multiply, AllocatorAlignment)
+{
+    // Fresh matrices on default-init allocators must still be zero
+    mxnvpl::Matrix<double, mxcmn::HugePageAllocator<double>> big{1024, 512};
+    mxclpl::Matrix<double, 64, mxcmn::HugePageAllocator<double>> big_cl{1000, 600};
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&big[0][0]) % (2 << 20), 0);
+    EXPECT_EQ(big[1023][511], 0);
+    EXPECT_EQ(big_cl[999][599], 0);
+
+    mxnv::Matrix<float, mxcmn::AlignedAllocator<float>> small{3, 5};
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&small[0][0]) % 64, 0);
+    EXPECT_EQ(small[2][4], 0);
+}
+
+// lhs and rhs of MIn, products accumulated in the element type of MOut
+template <typename MOut, typename MIn>
+void MixedGemmTest(long min, long max)
+{
+    ForEachRandomGemm<MIn, MOut>(GemmSizes, min, max, [](auto& test_case) {
+        auto& [a_ref, b_ref, c_ref, ab_ref, a, b, c] = test_case;
+        const auto gemm_ref = GetGemmRef(test_case);
+
+        Gemm(2, a, b, -3, c);
+        MATRIX_IS_EQ(c, gemm_ref);
+
+        Multiply(a, b, c);
+        MATRIX_IS_EQ(c, ab_ref);
+    });
+}
+
+TEST(Multiply, MixedPrecision)
+{
+    MixedGemmTest<mxcl::Matrix<double, 32>, mxcl::Matrix<float, 32>>(-8, 8);
+    MixedGemmTest<mxcl::Matrix<std::int32_t, 64>, mxcl::Matrix<std::int8_t, 64>>(-128, 127);
+    MixedGemmTest<mxcl::Matrix<std::int32_t, 32>, mxcl::Matrix<std::int16_t, 32>>(-1000, 1000);
+
+    MixedGemmTest<mxclpl::Matrix<double, 64>, mxclpl::Matrix<float, 64>>(-8, 8);
+    MixedGemmTest<mxclpl::Matrix<std::int32_t, 32>, mxclpl::Matrix<std::int8_t, 32>>(-128, 127);
+    MixedGemmTest<mxclpl::Matrix<std::int32_t, 64>, mxclpl::Matrix<std::int16_t, 64>>(-1000, 1000);
+    // Temporary block of 512 KB per worker
+    MixedGemmTest<mxclpl::Matrix<double, 256>, mxclpl::Matrix<float, 256>>(-8, 8);
+}
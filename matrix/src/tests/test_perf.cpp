@@ -0,0 +1,172 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <cstdio>
+
+#include "test_common.h"
+#include "../perf_test.h"
+
+// Counters may be refused in a sandbox (-1), the report must be well formed anyway
+
+TEST(PerfReport, CsvJson)
+{
+    PerfReport report;
+    PerfTest perf_test{ { { 64, 3 }, { 96, 2 } } };
+    std::ostringstream log;
+    perf_test.Run<mxcl::Matrix<double, 32>>(report, "cachelike", log);
+
+    ASSERT_EQ(report.GetSamples().size(), 2);
+    for (const auto& sample : report.GetSamples())
+    {
+        ASSERT_EQ(sample.name, "cachelike");
+        ASSERT_GT(sample.time, 0);
+        ASSERT_GT(sample.GetGFlops(), 0);
+        for (const auto value : sample.counters)
+        {
+            ASSERT_GE(value, -1);
+        }
+    }
+
+    std::ostringstream csv, json;
+    report.WriteCsv(csv);
+    report.WriteJson(json);
+
+    std::istringstream csv_in{ csv.str() };
+    std::string line;
+    std::getline(csv_in, line);
+    ASSERT_EQ(line, "name,num_rows,num_k,num_cols,num_threads,time_ms,cycles,instructions,l1d_misses,"
+                    "llc_misses,dtlb_misses,gflops,ipc,bandwidth_gbs,intensity");
+    std::getline(csv_in, line);
+    ASSERT_EQ(line.rfind("cachelike,64,64,64,0,", 0), 0) << line;
+
+    ASSERT_EQ(json.str().front(), '[');
+    ASSERT_NE(json.str().find("\"num_rows\": 96"), std::string::npos);
+
+    // Derived metrics of the first sample: null or the value of PerfSample
+    const auto& sample = report.GetSamples().front();
+    const std::pair<std::string, double> derived[] = {
+        { "ipc", sample.GetIpc() }, { "bandwidth_gbs", sample.GetBandwidth() },
+        { "intensity", sample.GetIntensity() } };
+    for (const auto& [name, value] : derived)
+    {
+        const std::string key = "\"" + name + "\": ";
+        const auto pos = json.str().find(key);
+        ASSERT_NE(pos, std::string::npos) << name;
+
+        std::istringstream value_in{ json.str().substr(pos + key.size()) };
+        if (value < 0)
+        {
+            std::string null;
+            value_in >> std::setw(4) >> null;
+            ASSERT_EQ(null, "null") << name;
+        }
+        else
+        {
+            double json_value = -1;
+            value_in >> json_value;
+            ASSERT_NEAR(json_value, value, 1e-5 * value) << name;
+        }
+    }
+}
+
+TEST(Bench, Stats)
+{
+    const auto stats = bench::CalcStats({ 5, 1, 4, 2, 3 });
+    ASSERT_DOUBLE_EQ(stats.median, 3);
+    ASSERT_DOUBLE_EQ(stats.mean, 3);
+    ASSERT_DOUBLE_EQ(stats.min, 1);
+    ASSERT_DOUBLE_EQ(stats.p95, 4.8);
+    ASSERT_DOUBLE_EQ(stats.stddev, std::sqrt(2.5));
+    ASSERT_EQ(stats.samples.size(), 5);
+
+    ASSERT_THROW(bench::CalcStats({}), std::invalid_argument);
+}
+
+TEST(Bench, Measure)
+{
+    // Every sample gets its own operands, warmups are not in the samples
+    std::size_t num_setups = 0, num_runs = 0;
+    bench::BenchConfig config;
+    config.num_warmups = 2;
+    config.num_repeats = 5;
+    config.pin_cpu = 0;
+    const auto stats = bench::Measure(config, [&] { return ++num_setups; },
+                                      [&](std::size_t i_setup) { num_runs += i_setup == num_runs + 1; });
+    ASSERT_EQ(num_setups, 7);
+    ASSERT_EQ(num_runs, 7);
+    ASSERT_EQ(stats.samples.size(), 5);
+}
+
+TEST(Bench, Baseline)
+{
+    const std::string path = "test_bench_baseline.txt";
+
+    bench::BenchRunner base;
+    base.Add("fast", bench::CalcStats({ 10, 10, 10 }));
+    base.Add("slow", bench::CalcStats({ 10, 10, 10 }));
+    base.SaveBaseline(path);
+
+    bench::BenchRunner current;
+    current.Add("fast", bench::CalcStats({ 10.2, 10.2, 10.2 }));
+    current.Add("slow", bench::CalcStats({ 12, 12, 12 }));
+    current.Add("new", bench::CalcStats({ 1 }));
+
+    std::ostringstream log;
+    ASSERT_EQ(current.CompareWithBaseline(path, 0.05, log), 1);
+    ASSERT_NE(log.str().find("slow 10 12 +20% REGRESSION"), std::string::npos) << log.str();
+    ASSERT_EQ(log.str().find("fast 10 10.2 +2% REGRESSION"), std::string::npos) << log.str();
+    std::remove(path.c_str());
+
+    ASSERT_THROW(current.Add("with space", bench::CalcStats({ 1 })), std::invalid_argument);
+}
+
+TEST(Bench, BaselineArgs)
+{
+    const char* argv[] = { "bench", "--baseline", "old.txt", "--save-baseline", "new.txt" };
+    const auto args = bench::ParseBaselineArgs(5, argv);
+    ASSERT_EQ(args.compare_path, "old.txt");
+    ASSERT_EQ(args.save_path, "new.txt");
+
+    ASSERT_TRUE(bench::ParseBaselineArgs(1, argv).compare_path.empty());
+    ASSERT_THROW(bench::ParseBaselineArgs(2, argv), std::invalid_argument);
+    const char* bad_argv[] = { "bench", "--baseline-path", "old.txt" };
+    ASSERT_THROW(bench::ParseBaselineArgs(3, bad_argv), std::invalid_argument);
+}
+
+// Workers are pinned before every run, only when pinning is requested
+TEST(Bench, PinWorkers)
+{
+    std::vector<unsigned> cpus_begin;
+    bench::BenchConfig config;
+    config.num_warmups = 1;
+    config.num_repeats = 2;
+    config.pin_cpu = 0;
+    config.pin_workers = [&](unsigned cpu_begin, bench::ThreadPins&) { cpus_begin.push_back(cpu_begin); };
+    bench::Measure(config, [] {});
+    ASSERT_EQ(cpus_begin, std::vector<unsigned>(3, 1));
+
+    config.pin_cpu = -1;
+    bench::Measure(config, [] {});
+    ASSERT_EQ(cpus_begin.size(), 3);
+
+    // The perf tests pin the workers of the pool, which keep working
+    using M = mxclpl::Matrix<double, 16>;
+    const M a{ 64, 64, 4 };
+    ASSERT_GT(RunPerfTest(a, a, 2), 0);
+
+#ifdef __linux__
+    // and get their affinity back after the measurement
+    const auto get_cpu_counts = [] {
+        std::vector<int> cpu_counts;
+        mxcmn::ThreadPool::Get().ForEachWorker([&](std::thread& worker) {
+            cpu_set_t cpu_set;
+            pthread_getaffinity_np(worker.native_handle(), sizeof(cpu_set), &cpu_set);
+            cpu_counts.push_back(CPU_COUNT(&cpu_set));
+        });
+        return cpu_counts;
+    };
+    const auto cpu_counts = get_cpu_counts();
+    ASSERT_GT(RunPerfTest(a, a, 2), 0);
+    ASSERT_EQ(get_cpu_counts(), cpu_counts);
+#endif
+}
@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Results of the parallel engines must not change by a single bit with the number of threads
+
+namespace
+{
+
+template <typename M>
+M GetRandomReal(mxcmn::SizeT num_rows, mxcmn::SizeT num_cols)
+{
+    M m{ num_rows, num_cols, 1 };
+    seclib::RandomGenerator rand;
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            m[i_row][i_col] = static_cast<double>(rand.get_rand_val<long>(-1000000, 1000000)) / 999983;
+        }
+    }
+    return m;
+}
+
+template <typename M>
+bool IsBitEqual(const M& lhs, const M& rhs)
+{
+    for (mxcmn::PositionT i_row = 0; i_row < lhs.GetNumRows(); ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < lhs.GetNumCols(); ++i_col)
+        {
+            if (std::memcmp(&lhs[i_row][i_col], &rhs[i_row][i_col], sizeof(lhs[i_row][i_col])) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename M>
+void ThreadCountTest(mxcmn::Reduction reduction)
+{
+    const mxcmn::SizeT num_rows = 67, num_k = 1000, num_cols = 45;
+    const auto a = GetRandomReal<M>(num_rows, num_k);
+    const auto b = GetRandomReal<M>(num_k, num_cols);
+    const auto c = GetRandomReal<M>(num_rows, num_cols);
+
+    auto ref = c;
+    ref.SetReduction(reduction);
+    ref.Gemm(0.5, a, b, 2);
+
+    for (int num_threads : { 2, 3, 5, 8 })
+    {
+        M out{ num_rows, num_cols, num_threads };
+        for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+        {
+            for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+            {
+                out[i_row][i_col] = c[i_row][i_col];
+            }
+        }
+        out.SetReduction(reduction);
+        out.Gemm(0.5, a, b, 2);
+        ASSERT_TRUE(IsBitEqual(out, ref)) << "num_threads " << num_threads;
+    }
+
+    // Different order, the same sum up to rounding
+    auto default_out = c;
+    default_out.Gemm(0.5, a, b, 2);
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            ASSERT_NEAR(ref[i_row][i_col], default_out[i_row][i_col], 1e-9);
+        }
+    }
+}
+
+// Chunk sums 1e16, 1, -1e16: plain addition loses the 1
+template <typename M>
+void CompensatedTest()
+{
+    const mxcmn::SizeT num_k = 3 * mxcmn::DeterministicKChunk;
+    M a{ 2, num_k }, b{ num_k, 3 };
+    a[0][0] = 1e16;
+    a[0][mxcmn::DeterministicKChunk] = 1;
+    a[0][2 * mxcmn::DeterministicKChunk] = -1e16;
+    for (mxcmn::PositionT k = 0; k < num_k; ++k)
+    {
+        b[k][0] = b[k][1] = b[k][2] = 1;
+    }
+
+    M out{ 2, 3 };
+    out.SetReduction(mxcmn::Reduction::Compensated);
+    out.Gemm(1, a, b, 0);
+    ASSERT_EQ(out[0][0], 1);
+    ASSERT_EQ(out[0][2], 1);
+    ASSERT_EQ(out[1][1], 0);
+
+    out.SetReduction(mxcmn::Reduction::Deterministic);
+    out.Gemm(1, a, b, 0);
+    ASSERT_EQ(out[0][1], 0);
+}
+
+} // namespace
+
+TEST(Reduction, ThreadCount)
+{
+    for (auto reduction : { mxcmn::Reduction::Default, mxcmn::Reduction::Deterministic,
+                            mxcmn::Reduction::Compensated })
+    {
+        ThreadCountTest<mxnvpl::Matrix<double>>(reduction);
+        ThreadCountTest<mxclpl::Matrix<double, 16>>(reduction);
+        ThreadCountTest<mxclpl::Matrix<double, 64>>(reduction);
+    }
+}
+
+TEST(Reduction, Compensated)
+{
+    CompensatedTest<mxnvpl::Matrix<double>>();
+    CompensatedTest<mxclpl::Matrix<double, 16>>();
+    CompensatedTest<mxclpl::Matrix<double, 128>>();
+}
+
+TEST(Reduction, PairwiseSum)
+{
+    for (std::size_t num_values = 1; num_values < 40; ++num_values)
+    {
+        mxcmn::PairwiseSum<long> pairwise{ num_values };
+        for (std::size_t i_repeat = 0; i_repeat < 2; ++i_repeat)
+        {
+            pairwise.Reset();
+            for (std::size_t i_value = 0; i_value < num_values; ++i_value)
+            {
+                pairwise.GetNext() = static_cast<long>(i_value + 1);
+                pairwise.Push();
+            }
+            ASSERT_EQ(pairwise.GetSum(), static_cast<long>(num_values * (num_values + 1) / 2));
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Factorizations and solves are checked by residuals on the original matrix
+
+template <typename M>
+M MultiplyRef(const M& lhs, const M& rhs)
+{
+    M res{ lhs.GetNumRows(), rhs.GetNumCols() };
+    mxcl::Multiply(lhs, rhs, res);
+    return res;
+}
+
+template <typename M>
+double CalcMaxDiff(const M& lhs, const M& rhs)
+{
+    double max_diff = 0;
+    for (mxcmn::PositionT i_row = 0; i_row < lhs.GetNumRows(); ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < lhs.GetNumCols(); ++i_col)
+        {
+            max_diff = std::max(max_diff, std::abs(double(lhs[i_row][i_col]) - rhs[i_row][i_col]));
+        }
+    }
+    return max_diff;
+}
+
+template <typename M>
+void LuTest(unsigned num_threads)
+{
+    for (const mxcmn::SizeT size : { 1u, 7u, 32u, 70u, 130u })
+    {
+        // Half-integer values have no zeros, the rows still need pivoting
+        auto a = GetRandomMatrix<M>(size, size, -8, 8);
+        for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+        {
+            for (mxcmn::PositionT i_col = 0; i_col < size; ++i_col)
+            {
+                a[i_row][i_col] += 0.5;
+            }
+        }
+        auto lu = a;
+        const auto pivots = mxcl::LuFactorize(lu, num_threads);
+
+        // P a = L U
+        M l{ size, size }, u{ size, size }, pa = a;
+        for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+        {
+            mxcl::SwapRows(pa, i_row, pivots[i_row]);
+            for (mxcmn::PositionT i_col = 0; i_col < size; ++i_col)
+            {
+                if (i_col < i_row)
+                {
+                    l[i_row][i_col] = lu[i_row][i_col];
+                }
+                else
+                {
+                    u[i_row][i_col] = lu[i_row][i_col];
+                }
+            }
+            l[i_row][i_row] = 1;
+        }
+        ASSERT_LT(CalcMaxDiff(MultiplyRef(l, u), pa), 1e-9 * size) << size;
+
+        const auto b = GetRandomMatrix<M>(size, 5, -8, 8);
+        auto x = b;
+        mxcl::LuSolve(lu, pivots, x, num_threads);
+        ASSERT_LT(CalcMaxDiff(MultiplyRef(a, x), b), 1e-8 * size) << size;
+    }
+}
+
+TEST(Solve, Lu)
+{
+    LuTest<mxcl::Matrix<double, 16>>(0);
+    LuTest<mxcl::Matrix<double, 32>>(1);
+    LuTest<mxcl::Matrix<double, 8, mxcl::MortonLayout>>(0);
+
+    mxcl::Matrix<double, 16> singular{ 40, 40 };
+    singular.Fill(1);
+    ASSERT_THROW(mxcl::LuFactorize(singular), std::runtime_error);
+
+    mxcl::Matrix<double, 16> rect{ 40, 20 };
+    ASSERT_THROW(mxcl::LuFactorize(rect), std::invalid_argument);
+}
+
+template <typename M>
+void CholeskyTest(unsigned num_threads)
+{
+    for (const mxcmn::SizeT size : { 1u, 7u, 32u, 70u, 130u })
+    {
+        // a = c c^T + size I is symmetric positive definite
+        const auto c = GetRandomMatrix<M>(size, size, -4, 4);
+        M a{ size, size };
+        a.GemmRhsTransposed(1, c, c, 0);
+        for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+        {
+            a[i_row][i_row] += size;
+        }
+
+        auto l = a;
+        mxcl::CholeskyFactorize(l, num_threads);
+
+        M llt{ size, size };
+        llt.GemmRhsTransposed(1, l, l, 0);
+        ASSERT_LT(CalcMaxDiff(llt, a), 1e-9 * size * size) << size;
+        for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+        {
+            for (mxcmn::PositionT i_col = i_row + 1; i_col < size; ++i_col)
+            {
+                ASSERT_EQ(l[i_row][i_col], 0);
+            }
+        }
+
+        const auto b = GetRandomMatrix<M>(size, 3, -8, 8);
+        auto x = b;
+        mxcl::CholeskySolve(l, x, num_threads);
+        ASSERT_LT(CalcMaxDiff(MultiplyRef(a, x), b), 1e-8 * size) << size;
+    }
+}
+
+TEST(Solve, Cholesky)
+{
+    CholeskyTest<mxcl::Matrix<double, 16>>(0);
+    CholeskyTest<mxcl::Matrix<double, 32, mxcl::MortonLayout>>(1);
+
+    mxcl::Matrix<double, 16> a{ 20, 20 };
+    a.Fill(1);
+    a[5][5] = -1;
+    ASSERT_THROW(mxcl::CholeskyFactorize(a), std::runtime_error);
+}
+
+TEST(Solve, Trsm)
+{
+    using M = mxcl::Matrix<double, 16>;
+    const mxcmn::SizeT size = 75;
+
+    // The other triangle is garbage, it must not be read. Small off-diagonal values keep
+    // the unit diagonal solve from growing
+    auto a = GetRandomMatrix<M>(size, size, -4, 4);
+    for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < size; ++i_col)
+        {
+            a[i_row][i_col] /= 64;
+        }
+        a[i_row][i_row] = 2 + i_row % 3;
+    }
+    const auto b = GetRandomMatrix<M>(size, 40, -8, 8);
+
+    for (const auto uplo : { mxcl::Uplo::Lower, mxcl::Uplo::Upper })
+    {
+        for (const auto op : { mxcl::TrOp::NoTrans, mxcl::TrOp::Trans })
+        {
+            for (const auto diag : { mxcl::Diag::NonUnit, mxcl::Diag::Unit })
+            {
+                M op_a{ size, size };
+                for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+                {
+                    for (mxcmn::PositionT i_col = 0; i_col < size; ++i_col)
+                    {
+                        const bool is_used = uplo == mxcl::Uplo::Lower ? i_col < i_row : i_col > i_row;
+                        const double value = is_used ? a[i_row][i_col] :
+                                             i_row == i_col ? (diag == mxcl::Diag::Unit ? 1 : a[i_row][i_col]) : 0;
+                        if (op == mxcl::TrOp::Trans)
+                        {
+                            op_a[i_col][i_row] = value;
+                        }
+                        else
+                        {
+                            op_a[i_row][i_col] = value;
+                        }
+                    }
+                }
+
+                auto x = b;
+                mxcl::Trsm(uplo, op, diag, a, x);
+                ASSERT_LT(CalcMaxDiff(MultiplyRef(op_a, x), b), 1e-9);
+            }
+        }
+    }
+
+    M wrong{ size + 1, 3 };
+    ASSERT_THROW(mxcl::Trsm(mxcl::Uplo::Lower, mxcl::TrOp::NoTrans, mxcl::Diag::Unit, a, wrong),
+                 std::invalid_argument);
+}
@@ -0,0 +1,134 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Sparse products against mxnv on the same values. Values are small integers in double,
+// so the sums are exact in any order
+
+using RefM = mxnv::Matrix<double>;
+
+// About fill_percent of the elements are not zero, whole QSize blocks may be empty
+RefM GetRandomSparse(mxcmn::SizeT num_rows, mxcmn::SizeT num_cols, long fill_percent)
+{
+    auto dense = GetRandomMatrix<RefM>(num_rows, num_cols, -8, 8);
+    const auto mask = GetRandomMatrix<RefM>(num_rows, num_cols, 0, 99);
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            const bool is_empty_block = (i_row / 16 + i_col / 16) % 3 == 0;
+            if (is_empty_block || mask[i_row][i_col] >= fill_percent)
+            {
+                dense[i_row][i_col] = 0;
+            }
+        }
+    }
+    return dense;
+}
+
+template <typename A>
+void GemvTest(mxcmn::SizeT num_rows, mxcmn::SizeT num_cols)
+{
+    const auto a_ref = GetRandomSparse(num_rows, num_cols, 10);
+    const auto a = A::FromDense(a_ref);
+    MATRIX_IS_EQ(a.template ToDense<RefM>(), a_ref);
+
+    const auto x_ref = GetRandomMatrix<RefM>(num_cols, 1, -8, 8);
+    const auto y_ref = GetRandomMatrix<RefM>(num_rows, 1, -8, 8);
+    std::vector<double> x(num_cols), y(num_rows);
+    for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+    {
+        x[i_col] = x_ref[i_col][0];
+    }
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        y[i_row] = y_ref[i_row][0];
+    }
+
+    mxcmn::Gemv(2, a, x, 3, y);
+
+    auto ax_ref = a_ref;
+    ax_ref *= x_ref;
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        ASSERT_EQ(y[i_row], 2 * ax_ref[i_row][0] + 3 * y_ref[i_row][0]) << num_rows << 'x' << num_cols;
+    }
+}
+
+TEST(Sparse, Gemv)
+{
+    for (const auto& [num_rows, num_cols] : { std::pair{ 1u, 1u }, { 37u, 50u }, { 300u, 130u } })
+    {
+        GemvTest<mxsp::CsrMatrix<double>>(num_rows, num_cols);
+        GemvTest<mxsp::BsrMatrix<double, 16>>(num_rows, num_cols);
+    }
+}
+
+template <typename A, typename M>
+void GemmTest(mxcmn::SizeT num_rows, mxcmn::SizeT num_k, mxcmn::SizeT num_cols, unsigned num_threads)
+{
+    const auto a_ref = GetRandomSparse(num_rows, num_k, 5);
+    const auto b_ref = GetRandomMatrix<RefM>(num_k, num_cols, -8, 8);
+    const auto c_ref = GetRandomMatrix<RefM>(num_rows, num_cols, -8, 8);
+
+    const auto a = A::FromDense(a_ref);
+    const auto b = CopyMatrix<M>(b_ref);
+    auto out = CopyMatrix<M>(c_ref);
+    mxsp::Gemm(2, a, b, -1, out, num_threads);
+
+    auto ab_ref = a_ref;
+    ab_ref *= b_ref;
+    RefM res_ref{ num_rows, num_cols };
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            res_ref[i_row][i_col] = 2 * ab_ref[i_row][i_col] - c_ref[i_row][i_col];
+        }
+    }
+    MATRIX_IS_EQ(out, res_ref);
+
+    // beta == 0 does not read out
+    auto nan_ref = c_ref;
+    for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+        {
+            nan_ref[i_row][i_col] = std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+    auto nan_out = CopyMatrix<M>(nan_ref);
+    mxsp::Gemm(1, a, b, 0, nan_out, num_threads);
+    MATRIX_IS_EQ(nan_out, ab_ref);
+}
+
+TEST(Sparse, Gemm)
+{
+    using Csr = mxsp::CsrMatrix<double>;
+    using Bsr = mxsp::BsrMatrix<double, 16>;
+
+    for (const unsigned num_threads : { 1u, 0u })
+    {
+        GemmTest<Csr, mxtr::Matrix<double>>(70, 90, 33, num_threads);
+        GemmTest<Csr, mxcl::Matrix<double, 16>>(70, 90, 33, num_threads);
+        GemmTest<Csr, mxcl::Matrix<double, 16, mxcl::MortonLayout>>(300, 200, 100, num_threads);
+        GemmTest<Bsr, mxtr::Matrix<double>>(70, 90, 33, num_threads);
+        GemmTest<Bsr, mxcl::Matrix<double, 16>>(70, 90, 33, num_threads);
+        GemmTest<Bsr, mxcl::Matrix<double, 16, mxcl::MortonLayout>>(300, 200, 100, num_threads);
+    }
+
+    const auto a = Csr::FromDense(GetRandomSparse(10, 20, 10));
+    mxtr::Matrix<double> b{ 21, 5 }, out{ 10, 5 };
+    ASSERT_THROW(mxsp::Gemm(1, a, b, 0, out), std::invalid_argument);
+}
+
+TEST(Sparse, InvalidArrays)
+{
+    using Csr = mxsp::CsrMatrix<double>;
+    ASSERT_NO_THROW(Csr(2, 3, { 0, 1, 2 }, { 0, 2 }, { 1, 2 }));
+    ASSERT_THROW(Csr(2, 3, { 0, 1 }, { 0 }, { 1 }), std::invalid_argument);
+    ASSERT_THROW(Csr(2, 3, { 0, 2, 1 }, { 0, 1 }, { 1, 2 }), std::invalid_argument);
+    ASSERT_THROW(Csr(2, 3, { 0, 1, 2 }, { 0, 3 }, { 1, 2 }), std::invalid_argument);
+    ASSERT_THROW((mxsp::BsrMatrix<double, 16>(20, 20, { 0, 1, 1 }, { 2 }, { {} })), std::invalid_argument);
+}
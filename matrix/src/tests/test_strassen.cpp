@@ -0,0 +1,33 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Odd block counts exercise the peeling path, small cutoffs force several recursion levels
+
+template <typename T, std::size_t QSize>
+void StrassenTest(mxcmn::SizeT cutoff_qnum)
+{
+    using M = mxcl::Matrix<T, QSize>;
+
+    const std::vector<std::array<mxcmn::SizeT, 3>> sizes = {
+        { 1, 1, 1 }, { 4 * QSize, 4 * QSize, 4 * QSize }, { 5 * QSize - 3, 7 * QSize + 1, 6 * QSize },
+        { 9 * QSize, 2 * QSize, 8 * QSize + 5 }
+    };
+
+    mxcl::QArena<qmx::QMatrix<T, QSize>> arena;
+    ForEachRandomGemm<M>(sizes, -8, 8, [&](auto& test_case) {
+        auto& [a_ref, b_ref, c_ref, ab_ref, a, b, c] = test_case;
+        mxcl::StrassenMultiply(a, b, c, arena, cutoff_qnum);
+        MATRIX_IS_EQ(c, ab_ref);
+    });
+}
+
+TEST(MatrixStrassen, Random)
+{
+    StrassenTest<long,   16>(1);
+    StrassenTest<long,   16>(2);
+    StrassenTest<double, 16>(1);
+    StrassenTest<float,  32>(2);
+    StrassenTest<double, 64>(mxcl::strassen::DefaultCutoff);
+}
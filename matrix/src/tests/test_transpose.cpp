@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Transpose() of every engine and QMatrix::Transpose against element-wise checks
+
+template <typename M>
+void TransposeTest()
+{
+    const std::vector<std::pair<mxcmn::SizeT, mxcmn::SizeT>> sizes = {
+        { 1, 1 }, { 1, 9 }, { 8, 8 }, { 7, 5 }, { 64, 64 }, { 70, 130 }, { 131, 33 }
+    };
+
+    for (const auto& [num_rows, num_cols] : sizes)
+    {
+        const auto m = GetRandomMatrix<M>(num_rows, num_cols, -100, 100);
+        M m_tr{num_cols, num_rows};
+        m.Transpose(m_tr);
+
+        for (mxcmn::PositionT i_row = 0; i_row < num_rows; ++i_row)
+        {
+            for (mxcmn::PositionT i_col = 0; i_col < num_cols; ++i_col)
+            {
+                ASSERT_EQ(m_tr[i_col][i_row], m[i_row][i_col]) << num_rows << 'x' << num_cols;
+            }
+        }
+    }
+
+    M m{3, 4}, m_bad{3, 4};
+    ASSERT_THROW(m.Transpose(m_bad), std::invalid_argument);
+}
+
+TEST(Transpose, Engines)
+{
+    TransposeTest<mxnv::Matrix<double>>();
+    TransposeTest<mxnv::Matrix<float>>();
+    TransposeTest<mxtr::Matrix<long>>();
+    TransposeTest<mxnvpl::Matrix<double>>();
+    TransposeTest<mxgemm::Matrix<float>>();
+    TransposeTest<mxcl::Matrix<double, 16>>();
+    TransposeTest<mxcl::Matrix<float, 8, mxcl::MortonLayout>>();
+    TransposeTest<mxclpl::Matrix<float, 32>>();
+    TransposeTest<mxclpl::Matrix<int, 4>>();
+}
+
+template <typename T, std::size_t N>
+void QMatrixTransposeTest()
+{
+    qmx::QMatrix<T, N> qm, qm_tr;
+    for (std::size_t i_row = 0; i_row < N; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < N; ++i_col)
+        {
+            qm.m_buf[i_row][i_col] = static_cast<T>(i_row * N + i_col);
+        }
+    }
+
+    qm.Transpose(qm_tr);
+    for (std::size_t i_row = 0; i_row < N; ++i_row)
+    {
+        for (std::size_t i_col = 0; i_col < N; ++i_col)
+        {
+            ASSERT_EQ(qm_tr.m_buf[i_col][i_row], qm.m_buf[i_row][i_col]) << N;
+        }
+    }
+}
+
+TEST(Transpose, QMatrix)
+{
+    QMatrixTransposeTest<double, 2>();
+    QMatrixTransposeTest<double, 4>();
+    QMatrixTransposeTest<double, 32>();
+    QMatrixTransposeTest<float, 4>();
+    QMatrixTransposeTest<float, 8>();
+    QMatrixTransposeTest<float, 64>();
+    QMatrixTransposeTest<int, 16>();
+}
@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+
+#include "test_common.h"
+#include "../matrix.h"
+
+// Products on strided views against mxnv operator*= on copies
+
+using RefM = mxnv::Matrix<long>;
+
+RefM TransposeCopy(const RefM& m)
+{
+    RefM res{m.GetNumCols(), m.GetNumRows()};
+    for (mxcmn::PositionT i_row = 0; i_row < m.GetNumRows(); ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < m.GetNumCols(); ++i_col)
+        {
+            res[i_col][i_row] = m[i_row][i_col];
+        }
+    }
+
+    return res;
+}
+
+template <typename M, typename GemmF>
+void TransposedRhsTest(GemmF&& gemm)
+{
+    const std::vector<std::array<mxcmn::SizeT, 3>> sizes = {
+        { 1, 1, 1 }, { 7, 5, 3 }, { 70, 130, 65 }
+    };
+
+    for (const auto [m, k, n] : sizes)
+    {
+        auto a_ref = GetRandomMatrix<RefM>(m, k, -8, 8);
+        auto b_ref = GetRandomMatrix<RefM>(k, n, -8, 8);
+        auto bt_ref = TransposeCopy(b_ref);
+
+        auto a = CopyMatrix<M>(a_ref);
+        auto bt = CopyMatrix<M>(bt_ref);
+        M c{m, n};
+        gemm(a, bt, c);
+
+        a_ref *= b_ref;
+        MATRIX_IS_EQ(c, a_ref);
+    }
+}
+
+TEST(MatrixView, TransposedRhs)
+{
+    const auto view_gemm = [](const auto& a, const auto& bt, auto& c) {
+        mxcmn::Gemm(1, a.GetView(), bt.GetView().Transposed(), 0, c.GetView());
+    };
+    TransposedRhsTest<mxnv::Matrix<long>>(view_gemm);
+    TransposedRhsTest<mxtr::Matrix<double>>(view_gemm);
+
+    TransposedRhsTest<mxgemm::Matrix<double>>([](const auto& a, const auto& bt, auto& c) {
+        mxgemm::Gemm(1, a.GetView(), bt.GetView().Transposed(), 0, c.GetView());
+    });
+
+    TransposedRhsTest<mxcl::Matrix<long, 32>>([](const auto& a, const auto& bt, auto& c) {
+        c.GemmRhsTransposed(1, a, bt, 0);
+    });
+
+    // Scaled blocks of rhs: 2 * a * b - a * b
+    TransposedRhsTest<mxcl::Matrix<double, 16>>([](const auto& a, const auto& bt, auto& c) {
+        c.GemmRhsTransposed(2, a, bt, 0);
+        c.GemmRhsTransposed(-1, a, bt, 1);
+    });
+}
+
+// x[p:, p:] = 2 * x[p:, p:] - x[p:, :p] * x[:p, p:], the trailing update of a blocked LU
+template <typename M, typename GemmF>
+void PanelUpdateTest(GemmF&& gemm)
+{
+    const mxcmn::SizeT size = 75, p = 20, q = size - p;
+
+    auto x_ref = GetRandomMatrix<RefM>(size, size, -8, 8);
+    auto x = CopyMatrix<M>(x_ref);
+
+    const auto view = x.GetView();
+    gemm(view.Sub(p, 0, q, p), view.Sub(0, p, p, q), view.Sub(p, p, q, q));
+
+    RefM l{q, p}, r{p, q};
+    for (mxcmn::PositionT i_row = 0; i_row < size; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = 0; i_col < size; ++i_col)
+        {
+            if (i_row >= p && i_col < p)
+            {
+                l[i_row - p][i_col] = x_ref[i_row][i_col];
+            }
+            else if (i_row < p && i_col >= p)
+            {
+                r[i_row][i_col - p] = x_ref[i_row][i_col];
+            }
+        }
+    }
+
+    l *= r;
+    for (mxcmn::PositionT i_row = p; i_row < size; ++i_row)
+    {
+        for (mxcmn::PositionT i_col = p; i_col < size; ++i_col)
+        {
+            x_ref[i_row][i_col] = 2 * x_ref[i_row][i_col] - l[i_row - p][i_col - p];
+        }
+    }
+
+    MATRIX_IS_EQ(x, x_ref);
+}
+
+TEST(MatrixView, PanelUpdate)
+{
+    PanelUpdateTest<mxnv::Matrix<long>>([](auto lhs, auto rhs, auto out) {
+        mxcmn::Gemm(-1, lhs, rhs, 2, out);
+    });
+    PanelUpdateTest<mxgemm::Matrix<double>>([](auto lhs, auto rhs, auto out) {
+        mxgemm::Gemm(-1, lhs, rhs, 2, out);
+    });
+
+    // out^T = rhs^T * lhs^T with out^T column-strided
+    PanelUpdateTest<mxgemm::Matrix<double>>([](auto lhs, auto rhs, auto out) {
+        mxgemm::Gemm(-1, rhs.Transposed(), lhs.Transposed(), 2, out.Transposed());
+    });
+    PanelUpdateTest<mxnvpl::Matrix<long>>([](auto lhs, auto rhs, auto out) {
+        mxcmn::Gemm(-1, rhs.Transposed(), lhs.Transposed(), 2, out.Transposed());
+    });
+}
+
+TEST(MatrixView, InvalidArgs)
+{
+    mxnv::Matrix<long> a{3, 4}, b{5, 3};
+    EXPECT_THROW(mxcmn::Gemm(1, a.GetView(), b.GetView(), 0, a.GetView()), std::invalid_argument);
+    EXPECT_THROW(mxcmn::Gemm(1, b.GetView(), a.GetView(), 0, a.GetView()), std::invalid_argument);
+
+    mxcl::Matrix<long, 32> c{3, 4}, d{5, 3};
+    EXPECT_THROW(c.GemmRhsTransposed(1, c, d, 0), std::invalid_argument);
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+
+namespace mxcmn
+{
+
+// Process-wide pool of worker threads shared by the parallel engines.
+// Workers are created lazily and live until the end of the program.
+class ThreadPool
+{
+public:
+    static ThreadPool& Get();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    // Calls func(i_task) for every i_task in [0, num_tasks) and returns when all of them
+    // are finished. The calling thread executes task 0 and then claims the unclaimed tasks
+    // of this call, so nested calls from worker threads do not deadlock. It never runs
+    // tasks of other calls or submitted ones. The pool grows to at most one worker per
+    // hardware thread, the tasks left over are run by the threads already there.
+    // If func throws, the tasks not claimed yet are skipped and the first exception
+    // is rethrown once the running ones are finished
+    template <typename F>
+    void Run(unsigned num_tasks, F&& func);
+
+    // Queues func() for the existing workers (starts one if there are none) and returns at once,
+    // the future gets its result or exception. func may call Run. Workers take the tasks of Run
+    // before submitted ones, so a submitted task does not hold up a parallel loop.
+    template <typename F>
+    std::future<std::invoke_result_t<std::decay_t<F>>> Submit(F&& func);
+
+    unsigned GetNumWorkers() const;
+
+    // Calls func(worker) for every started worker, e.g. to pin them to cores
+    template <typename F>
+    void ForEachWorker(F&& func);
+
+private:
+    ThreadPool() = default;
+
+    // Tasks of one Run call, claimed by index
+    struct Group
+    {
+        explicit Group(unsigned num_tasks) noexcept
+            : num_tasks{ num_tasks }, num_left{ num_tasks - 1 }
+        {}
+
+        // Keeps the first exception and drops the unclaimed tasks,
+        // the task that threw is still counted by its thread
+        void Cancel(std::exception_ptr task_error) noexcept
+        {
+            const auto i_first_unclaimed = std::min(i_next_task.exchange(num_tasks), num_tasks);
+
+            std::lock_guard lock{ mutex };
+            if (!error)
+            {
+                error = std::move(task_error);
+            }
+            num_left -= num_tasks - i_first_unclaimed;
+        }
+
+        const unsigned num_tasks;
+        std::atomic<unsigned> i_next_task{ 1 };
+        std::mutex mutex;
+        std::condition_variable cv;
+        unsigned num_left;
+        std::exception_ptr error;
+    };
+
+    // Runs unclaimed tasks of group until there are none
+    template <typename F>
+    static void RunClaimed(Group& group, F& func);
+
+    // Starts workers up to num_workers, but not more than MaxWorkers. Returns the number of workers
+    unsigned Reserve(unsigned num_workers);
+    void WorkerLoop();
+
+    static unsigned MaxWorkers() noexcept { return std::max(std::thread::hardware_concurrency(), 1u); }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // Helpers of Run calls
+    std::deque<std::function<void()>> m_tasks;
+    // Tasks of Submit
+    std::deque<std::function<void()>> m_submitted;
+    std::vector<std::thread> m_workers;
+    bool m_stop = false;
+};
+
+inline ThreadPool& ThreadPool::Get()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_stop = true;
+    }
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+inline unsigned ThreadPool::GetNumWorkers() const
+{
+    std::lock_guard lock{ m_mutex };
+    return m_workers.size();
+}
+
+template <typename F>
+void ThreadPool::ForEachWorker(F&& func)
+{
+    std::lock_guard lock{ m_mutex };
+    for (auto& worker : m_workers)
+    {
+        func(worker);
+    }
+}
+
+inline unsigned ThreadPool::Reserve(unsigned num_workers)
+{
+    num_workers = std::min(num_workers, MaxWorkers());
+
+    std::lock_guard lock{ m_mutex };
+    while (m_workers.size() < num_workers)
+    {
+        m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+    return m_workers.size();
+}
+
+inline void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{ m_mutex };
+            m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty() || !m_submitted.empty(); });
+
+            auto& queue = m_tasks.empty() ? m_submitted : m_tasks;
+            if (queue.empty())
+            {
+                return;
+            }
+
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        task();
+    }
+}
+
+template <typename F>
+void ThreadPool::RunClaimed(Group& group, F& func)
+{
+    for (unsigned i_task = group.i_next_task++; i_task < group.num_tasks; i_task = group.i_next_task++)
+    {
+        try
+        {
+            func(i_task);
+        }
+        catch (...)
+        {
+            group.Cancel(std::current_exception());
+        }
+
+        std::lock_guard lock{ group.mutex };
+        if (--group.num_left == 0)
+        {
+            group.cv.notify_one();
+        }
+    }
+}
+
+template <typename F>
+void ThreadPool::Run(unsigned num_tasks, F&& func)
+{
+    if (num_tasks == 0)
+    {
+        return;
+    }
+
+    if (num_tasks == 1)
+    {
+        func(0u);
+        return;
+    }
+
+    // Helpers may be taken from the queue after Run returns, then they find no task to claim
+    // and do not touch func. The group itself lives until the last of them
+    auto group = std::make_shared<Group>(num_tasks);
+
+    const unsigned num_helpers = std::min(num_tasks - 1, Reserve(num_tasks - 1));
+    {
+        std::lock_guard lock{ m_mutex };
+        for (unsigned i_helper = 0; i_helper < num_helpers; ++i_helper)
+        {
+            m_tasks.push_back([group, &func] { RunClaimed(*group, func); });
+        }
+    }
+    m_cv.notify_all();
+
+    // func and this frame must outlive the helpers running it, so an exception of the
+    // calling thread waits for them too
+    try
+    {
+        func(0u);
+    }
+    catch (...)
+    {
+        group->Cancel(std::current_exception());
+    }
+    RunClaimed(*group, func);
+
+    std::unique_lock lock{ group->mutex };
+    group->cv.wait(lock, [&group] { return group->num_left == 0; });
+
+    if (group->error)
+    {
+        std::rethrow_exception(group->error);
+    }
+}
+
+template <typename F>
+std::future<std::invoke_result_t<std::decay_t<F>>> ThreadPool::Submit(F&& func)
+{
+    // std::function needs a copyable task
+    using ResultT = std::invoke_result_t<std::decay_t<F>>;
+    auto task = std::make_shared<std::packaged_task<ResultT()>>(std::forward<F>(func));
+    auto future = task->get_future();
+
+    Reserve(1);
+    {
+        std::lock_guard lock{ m_mutex };
+        m_submitted.push_back([task] { (*task)(); });
+    }
+    m_cv.notify_one();
+
+    return future;
+}
+
+} // namespace mxcmn